@@ -251,11 +251,6 @@ ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
         atError("Unknown blmode provided.");    
     } 
 
-    #ifdef _MSC_VER
-    if(Elem->blmode==2){
-        atError("Beam loading Phasor mode not implemented in Windows.");
-    }
-    #endif
     BeamLoadingCavityPass(r_in,num_particles,Param->nbunch,Param->bunch_spos,
                           Param->bunch_currents,rl,nturn,Elem);
     return Elem;
@@ -1,4 +1,5 @@
 #include "atelem.c"
+#include "atimplib.c"
 #include <math.h>
 #include <float.h>
 
@@ -16,42 +17,7 @@ struct elem
   double fz;
   double fqx;
   double fqy;
-  double *waketableT;
-  double *waketableDX;
-  double *waketableDY;
-  double *waketableQX;
-  double *waketableQY;
-  double *waketableZ;
-};
-
-
-double getWake(double *waketable,double *waketableT,double distance,int index){
-    double w = waketable[index] + (distance-waketableT[index])*(waketable[index+1]-waketable[index])/
-          (waketableT[index+1]-waketableT[index]);
-    if(atIsNaN(w)){
-        return 0;
-    }else{
-        return w;
-    };
-};
-
-
-int binarySearch(double *array,double value,int upper,int lower,int nStep){
-    int pivot = (int)(lower+upper)/2;
-    if ((upper-lower)<=1){
-        return lower;
-    };
-    if (value < array[pivot]){
-        upper = pivot;
-        nStep+=1;
-        return binarySearch(array,value,upper,lower,nStep);
-    } else if (value > array[pivot]){
-        lower = pivot;
-        nStep+=1;
-        return binarySearch(array,value,upper,lower,nStep);
-    }else{
-        return pivot;
-    };
+  struct waketable *waketable;
 };
 
 
@@ -63,18 +29,14 @@ void impedance_tablePass(double *r_in,int num_particles, struct elem *Elem){
      */
     
     long nslice = Elem->nslice;
-    long nelem = Elem->nelem;
     double fx = Elem->fx;
     double fy = Elem->fy;
     double fqx = Elem->fqx;
     double fqy = Elem->fqy;
     double fz = Elem->fz;
-    double *waketableT = Elem->waketableT;
-    double *waketableDX = Elem->waketableDX;
-    double *waketableDY = Elem->waketableDY;
-    double *waketableQX = Elem->waketableQX;
-    double *waketableQY = Elem->waketableQY;
-    double *waketableZ = Elem->waketableZ;
+    struct waketable *waketable = Elem->waketable;
+    double tmin = waketable->tmin;
+    double tmax = waketable->tmax;
     
     size_t sz = 9*nslice*sizeof(double) + (nslice+num_particles)*sizeof(int);
     double *rtmp;
@@ -205,16 +167,16 @@ void impedance_tablePass(double *r_in,int num_particles, struct elem *Elem){
           for (ii=0;ii<nslice;ii++){
               register double posi = zpos[ii];
               double ds = posi-pos0;
-              if(countslc[ii]>0.0 && -ds>waketableT[0] && -ds<waketableT[nelem-1]){
+              if(countslc[ii]>0.0 && -ds>tmin && -ds<tmax){
                 register double wi = weight[ii];
                 register double dx = xpos[ii];
                 register double dy = ypos[ii];
-                int index = binarySearch(waketableT,-ds,nelem,0,0);              
-                double fieldx = getWake(waketableDX,waketableT,-ds,index);
-                double fieldy = getWake(waketableDY,waketableT,-ds,index);
-                double fieldx2 = getWake(waketableQX,waketableT,-ds,index);
-                double fieldy2 = getWake(waketableQY,waketableT,-ds,index);
-                double fieldz = getWake(waketableZ,waketableT,-ds,index);
+                const double *rec = waketable_record(waketable,-ds);
+                double fieldx = waketable_value(rec,waketable->offset[WAKE_DX],-ds);
+                double fieldy = waketable_value(rec,waketable->offset[WAKE_DY],-ds);
+                double fieldx2 = waketable_value(rec,waketable->offset[WAKE_QX],-ds);
+                double fieldy2 = waketable_value(rec,waketable->offset[WAKE_QY],-ds);
+                double fieldz = waketable_value(rec,waketable->offset[WAKE_Z],-ds);
                 kx[i] += fx*wi*fieldx*dx;
                 ky[i] += fy*wi*fieldy*dy;
                 kx2[i] += fqx*wi*fieldx2;
@@ -251,11 +213,7 @@ ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
         double on_x,on_y,on_qx,on_qy,on_z;
         double intensity, wakefact, normfactx,normfacty;
         double *waketableT;
-        double *waketableDX;
-        double *waketableDY;
-        double *waketableQX;
-        double *waketableQY;
-        double *waketableZ;
+        double *components[WAKE_NCOMP];
         
         nslice=atGetLong(ElemData,"Nslice"); check_error();
         nelem=atGetLong(ElemData,"Nelem"); check_error();
@@ -269,13 +227,14 @@ ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
         normfactx=atGetDouble(ElemData,"Normfactx"); check_error();
         normfacty=atGetDouble(ElemData,"Normfacty"); check_error();
         waketableT=atGetDoubleArray(ElemData,"WakeT"); check_error();
-        waketableDX=atGetDoubleArray(ElemData,"WakeDX"); check_error();
-        waketableDY=atGetDoubleArray(ElemData,"WakeDY"); check_error();
-        waketableQX=atGetDoubleArray(ElemData,"WakeQX"); check_error();
-        waketableQY=atGetDoubleArray(ElemData,"WakeQY"); check_error();
-        waketableZ=atGetDoubleArray(ElemData,"WakeZ"); check_error();
+        components[WAKE_DX]=atGetDoubleArray(ElemData,"WakeDX"); check_error();
+        components[WAKE_DY]=atGetDoubleArray(ElemData,"WakeDY"); check_error();
+        components[WAKE_QX]=atGetDoubleArray(ElemData,"WakeQX"); check_error();
+        components[WAKE_QY]=atGetDoubleArray(ElemData,"WakeQY"); check_error();
+        components[WAKE_Z]=atGetDoubleArray(ElemData,"WakeZ"); check_error();
         
-        Elem = (struct elem*)atMalloc(sizeof(struct elem));
+        /* The wake table is stored after the element structure and released with it */
+        Elem = (struct elem*)atMalloc(sizeof(struct elem)+waketable_size(nelem,components));
         Elem->nslice=nslice;
         Elem->nelem=nelem;
         Elem->fx=intensity*wakefact*normfactx*on_x;
@@ -283,12 +242,7 @@ ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
         Elem->fqx=intensity*wakefact*normfactx*on_qx;
         Elem->fqy=intensity*wakefact*normfacty*on_qy;
         Elem->fz=intensity*wakefact*on_z;
-        Elem->waketableT=waketableT;
-        Elem->waketableDX=waketableDX;
-        Elem->waketableDY=waketableDY;
-        Elem->waketableQX=waketableQX;
-        Elem->waketableQY=waketableQY;
-        Elem->waketableZ=waketableZ;
+        Elem->waketable=waketable_init(Elem+1,waketableT,nelem,components);
     }
     impedance_tablePass(r_in,num_particles,Elem);
     return Elem;
@@ -312,11 +266,7 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
         double on_x,on_y,on_qx,on_qy,on_z;
         double intensity, wakefact, normfactx,normfacty;
         double *waketableT;
-        double *waketableDX;
-        double *waketableDY;
-        double *waketableQX;
-        double *waketableQY;
-        double *waketableZ;
+        double *components[WAKE_NCOMP];
         
         nslice=atGetLong(ElemData,"Nslice"); check_error();
         nelem=atGetLong(ElemData,"Nelem"); check_error();
@@ -330,11 +280,11 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
         normfactx=atGetDouble(ElemData,"Normfactx"); check_error();
         normfacty=atGetDouble(ElemData,"Normfacty"); check_error();
         waketableT=atGetDoubleArray(ElemData,"WakeT"); check_error();
-        waketableDX=atGetDoubleArray(ElemData,"WakeDX"); check_error();
-        waketableDY=atGetDoubleArray(ElemData,"WakeDY"); check_error();
-        waketableQX=atGetDoubleArray(ElemData,"WakeQX"); check_error();
-        waketableQY=atGetDoubleArray(ElemData,"WakeQY"); check_error();
-        waketableZ=atGetDoubleArray(ElemData,"WakeZ"); check_error();
+        components[WAKE_DX]=atGetDoubleArray(ElemData,"WakeDX"); check_error();
+        components[WAKE_DY]=atGetDoubleArray(ElemData,"WakeDY"); check_error();
+        components[WAKE_QX]=atGetDoubleArray(ElemData,"WakeQX"); check_error();
+        components[WAKE_QY]=atGetDoubleArray(ElemData,"WakeQY"); check_error();
+        components[WAKE_Z]=atGetDoubleArray(ElemData,"WakeZ"); check_error();
         
         Elem->nslice=nslice;
         Elem->nelem=nelem;
@@ -343,18 +293,15 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
         Elem->fqx=intensity*wakefact*normfactx*on_qx;
         Elem->fqy=intensity*wakefact*normfacty*on_qy;
         Elem->fz=intensity*wakefact*on_z;
-        Elem->waketableT=waketableT;
-        Elem->waketableDX=waketableDX;
-        Elem->waketableDY=waketableDY;
-        Elem->waketableQX=waketableQX;
-        Elem->waketableQY=waketableQY;
-        Elem->waketableZ=waketableZ;
+        Elem->waketable=waketable_init(atMalloc(waketable_size(nelem,components)),
+                                       waketableT,nelem,components);
 
         if (mxGetM(prhs[1]) != 6) mexErrMsgIdAndTxt("AT:WrongArg","Second argument must be a 6 x N matrix: particle array");
         /* ALLOCATE memory for the output array of the same size as the input  */
         plhs[0] = mxDuplicateArray(prhs[1]);
         r_in = mxGetDoubles(plhs[0]);
         impedance_tablePass(r_in, num_particles, Elem);
+        atFree(Elem->waketable);
     }
     else if (nrhs == 0) {
         /* list of required fields */
@@ -0,0 +1,218 @@
+#include "atconstants.h"
+#include "atelem.c"
+#include "atimplib.c"
+
+/*
+ * Longitudinal resonators computed with the phasor method.
+ * All resonator modes share the same slicing of the beam and are
+ * propagated together in a single pass over the slices.
+ */
+
+struct elem
+{
+  int nslice;
+  int nturns;
+  int nmodes;
+  double normfact;
+  double beta;
+  double *frequency;
+  double *qfactor;
+  double *rshunt;
+  double *turnhistory;
+  double *z_cuts;
+  double *vbeam_phasor;
+  double *vbeam;
+};
+
+
+void PhasorResonatorPass(double *r_in,int num_particles,int nbunch,
+                         double *bunch_spos,double *bunch_currents,
+                         double circumference,double energy,struct elem *Elem) {
+    /*
+     * r_in - 6-by-N matrix of initial conditions reshaped into
+     * 1-d array of 6*N elements
+     */
+    long nslice = Elem->nslice;
+    long nturns = Elem->nturns;
+    long nmodes = Elem->nmodes;
+    double normfact = Elem->normfact;
+    double beta = Elem->beta;
+    double *turnhistory = Elem->turnhistory;
+    double *z_cuts = Elem->z_cuts;
+    double tot_current=0.0;
+    int i, c;
+    size_t sz = nslice*nbunch*sizeof(double) + num_particles*sizeof(int);
+    int *pslice;
+    double *kz;
+
+    for(i=0;i<nbunch;i++){
+        tot_current += bunch_currents[i];
+    }
+
+    /*Only allocate memory if current is > 0*/
+    if(tot_current>0){
+        void *buffer = atMalloc(sz);
+        double *dptr = (double *) buffer;
+        int *iptr;
+        kz = dptr;
+        dptr += nslice*nbunch;
+        iptr = (int *) dptr;
+        pslice = iptr; iptr += num_particles;
+
+        rotate_table_history(nturns,nslice*nbunch,turnhistory,circumference);
+        slice_bunch(r_in,num_particles,nslice,nturns,nbunch,bunch_spos,bunch_currents,
+                    turnhistory,pslice,z_cuts);
+        compute_kicks_phasor_modes(nslice,nbunch,nturns,turnhistory,normfact,kz,nmodes,
+                                   Elem->frequency,Elem->qfactor,Elem->rshunt,
+                                   Elem->vbeam_phasor,circumference,energy,beta,
+                                   Elem->vbeam,NULL);
+        /*apply kicks*/
+        for (c=0; c<num_particles; c++) {
+            double *r6 = r_in+c*6;
+            int islice=pslice[c];
+            if (!atIsNaN(r6[0])) {
+                r6[4] += kz[islice];
+            }
+        }
+        atFree(buffer);
+    }
+}
+
+
+#if defined(MATLAB_MEX_FILE) || defined(PYAT)
+ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
+        double *r_in, int num_particles, struct parameters *Param)
+{
+    if (!Elem) {
+        long nslice,nturns,nmodes;
+        double wakefact,normfact,beta;
+        double *frequency;
+        double *qfactor;
+        double *rshunt;
+        double *turnhistory;
+        double *z_cuts;
+        double *vbeam_phasor;
+        double *vbeam;
+
+        nslice=atGetLong(ElemData,"_nslice"); check_error();
+        nturns=atGetLong(ElemData,"_nturns"); check_error();
+        nmodes=atGetLong(ElemData,"_nmodes"); check_error();
+        wakefact=atGetDouble(ElemData,"_wakefact"); check_error();
+        beta=atGetDouble(ElemData,"_beta"); check_error();
+        normfact=atGetDouble(ElemData,"NormFact"); check_error();
+        frequency=atGetDoubleArray(ElemData,"ResFrequency"); check_error();
+        qfactor=atGetDoubleArray(ElemData,"Qfactor"); check_error();
+        rshunt=atGetDoubleArray(ElemData,"Rshunt"); check_error();
+        turnhistory=atGetDoubleArray(ElemData,"_turnhistory"); check_error();
+        vbeam_phasor=atGetDoubleArray(ElemData,"_vbeam_phasor"); check_error();
+        vbeam=atGetDoubleArray(ElemData,"_vbeam"); check_error();
+        /*optional attributes*/
+        z_cuts=atGetOptionalDoubleArray(ElemData,"ZCuts"); check_error();
+
+        int dimsth[] = {Param->nbunch*nslice*nturns, 4};
+        atCheckArrayDims(ElemData,"_turnhistory", 2, dimsth); check_error();
+        int dimsmd[] = {nmodes};
+        atCheckArrayDims(ElemData,"ResFrequency", 1, dimsmd); check_error();
+        atCheckArrayDims(ElemData,"Qfactor", 1, dimsmd); check_error();
+        atCheckArrayDims(ElemData,"Rshunt", 1, dimsmd); check_error();
+        int dimsvb[] = {nmodes, 2};
+        atCheckArrayDims(ElemData,"_vbeam_phasor", 2, dimsvb); check_error();
+        atCheckArrayDims(ElemData,"_vbeam", 2, dimsvb); check_error();
+
+        Elem = (struct elem*)atMalloc(sizeof(struct elem));
+        Elem->nslice=nslice;
+        Elem->nturns=nturns;
+        Elem->nmodes=nmodes;
+        Elem->normfact=normfact*wakefact;
+        Elem->beta=beta;
+        Elem->frequency=frequency;
+        Elem->qfactor=qfactor;
+        Elem->rshunt=rshunt;
+        Elem->turnhistory=turnhistory;
+        Elem->z_cuts=z_cuts;
+        Elem->vbeam_phasor=vbeam_phasor;
+        Elem->vbeam=vbeam;
+    }
+    if(num_particles<Param->nbunch){
+        atError("Number of particles has to be greater or equal to the number of bunches.");
+    }else if (num_particles%Param->nbunch!=0){
+        atWarning("Number of particles not a multiple of the number of bunches: uneven bunch load.");
+    }
+    PhasorResonatorPass(r_in,num_particles,Param->nbunch,Param->bunch_spos,
+                        Param->bunch_currents,Param->RingLength,Param->energy,Elem);
+    return Elem;
+}
+
+MODULE_DEF(PhasorResonatorPass)        /* Dummy module initialisation */
+
+#endif /*defined(MATLAB_MEX_FILE) || defined(PYAT)*/
+
+
+#ifdef MATLAB_MEX_FILE
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs == 2) {
+        double *r_in;
+        const mxArray *ElemData = prhs[0];
+        int num_particles = mxGetN(prhs[1]);
+        struct elem El, *Elem=&El;
+
+        long nslice,nturns,nmodes;
+        double wakefact,normfact,beta;
+
+        nslice=atGetLong(ElemData,"_nslice"); check_error();
+        nturns=atGetLong(ElemData,"_nturns"); check_error();
+        nmodes=atGetLong(ElemData,"_nmodes"); check_error();
+        wakefact=atGetDouble(ElemData,"_wakefact"); check_error();
+        beta=atGetDouble(ElemData,"_beta"); check_error();
+        normfact=atGetDouble(ElemData,"NormFact"); check_error();
+
+        Elem->nslice=nslice;
+        Elem->nturns=nturns;
+        Elem->nmodes=nmodes;
+        Elem->normfact=normfact*wakefact;
+        Elem->beta=beta;
+        Elem->frequency=atGetDoubleArray(ElemData,"ResFrequency"); check_error();
+        Elem->qfactor=atGetDoubleArray(ElemData,"Qfactor"); check_error();
+        Elem->rshunt=atGetDoubleArray(ElemData,"Rshunt"); check_error();
+        Elem->turnhistory=atGetDoubleArray(ElemData,"_turnhistory"); check_error();
+        Elem->vbeam_phasor=atGetDoubleArray(ElemData,"_vbeam_phasor"); check_error();
+        Elem->vbeam=atGetDoubleArray(ElemData,"_vbeam"); check_error();
+        Elem->z_cuts=atGetOptionalDoubleArray(ElemData,"ZCuts"); check_error();
+
+        if (mxGetM(prhs[1]) != 6) mexErrMsgIdAndTxt("AT:WrongArg","Second argument must be a 6 x N matrix: particle array");
+        /* ALLOCATE memory for the output array of the same size as the input  */
+        plhs[0] = mxDuplicateArray(prhs[1]);
+        r_in = mxGetDoubles(plhs[0]);
+        double bspos = 0.0;
+        double bcurr = 0.0;
+        PhasorResonatorPass(r_in,num_particles,1,&bspos,&bcurr,1,1,Elem);
+    }
+    else if (nrhs == 0) {
+        /* list of required fields */
+        plhs[0] = mxCreateCellMatrix(12,1);
+        mxSetCell(plhs[0],0,mxCreateString("_nslice"));
+        mxSetCell(plhs[0],1,mxCreateString("_nturns"));
+        mxSetCell(plhs[0],2,mxCreateString("_nmodes"));
+        mxSetCell(plhs[0],3,mxCreateString("_wakefact"));
+        mxSetCell(plhs[0],4,mxCreateString("_beta"));
+        mxSetCell(plhs[0],5,mxCreateString("NormFact"));
+        mxSetCell(plhs[0],6,mxCreateString("ResFrequency"));
+        mxSetCell(plhs[0],7,mxCreateString("Qfactor"));
+        mxSetCell(plhs[0],8,mxCreateString("Rshunt"));
+        mxSetCell(plhs[0],9,mxCreateString("_turnhistory"));
+        mxSetCell(plhs[0],10,mxCreateString("_vbeam_phasor"));
+        mxSetCell(plhs[0],11,mxCreateString("_vbeam"));
+
+        if (nlhs>1) {
+            /* list of optional fields */
+            plhs[1] = mxCreateCellMatrix(1,1);
+            mxSetCell(plhs[1],0,mxCreateString("ZCuts"));
+        }
+    }
+    else {
+        mexErrMsgIdAndTxt("AT:WrongArg","Needs 2 or 0 arguments");
+    }
+}
+#endif
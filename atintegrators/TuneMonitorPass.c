@@ -0,0 +1,152 @@
+#include "atconstants.h"
+#include "atelem.c"
+#include <math.h>
+
+/*
+ * Tune monitor: estimates the transverse tunes of each particle during
+ * tracking, without storing turn-by-turn data.
+ *
+ * The tracked turns are divided in NWindows windows. In each window the
+ * phase advance per turn in normalised coordinates is accumulated with the
+ * weights w(t) = exp(-1/(t(1-t))), t in ]0, 1[ (weighted Birkhoff average).
+ * For regular orbits the average converges faster than any power of the
+ * window length. The normalisation by the sum of weights is done in Python.
+ */
+
+struct elem
+{
+  int turn;
+  int nwin;
+  int wlength;
+  double *beta;
+  double *alpha;
+  double *orbit;
+  double *phase;
+  double *sums;
+};
+
+static double birkhoff_weight(int k, int length)
+{
+    double t = (double)k/length;
+    return exp(-1.0/(t*(1.0-t)));
+}
+
+void TuneMonitorPass(double *r_in, int num_particles, struct elem *Elem)
+{
+    int turn = Elem->turn;
+    int wlength = Elem->wlength;
+    int iwin = (wlength > 0) ? turn/wlength : Elem->nwin;
+    int k = turn - iwin*wlength;
+    double *beta = Elem->beta;
+    double *alpha = Elem->alpha;
+    double *orbit = Elem->orbit;
+    double *phase = Elem->phase;
+    double *sums;
+    double w;
+    int c;
+
+    if (iwin >= Elem->nwin) return;
+    w = (k > 0) ? birkhoff_weight(k, wlength) : 0.0;
+    sums = Elem->sums + 2*num_particles*iwin;
+
+    #pragma omp parallel for if (num_particles > OMP_PARTICLE_THRESHOLD) default(none) \
+    shared(r_in,num_particles,beta,alpha,orbit,phase,sums,w,k) private(c)
+    for (c = 0; c<num_particles; c++) {
+        double *r6 = r_in+c*6;
+        int p;
+        if (atIsNaN(r6[0])) {   /* lost particle */
+            sums[2*c] = sums[2*c+1] = atGetNaN();
+            continue;
+        }
+        for (p = 0; p<2; p++) {
+            double x = r6[2*p] - orbit[2*p];
+            double xp = r6[2*p+1] - orbit[2*p+1];
+            double sqb = sqrt(beta[p]);
+            /* x = sqrt(2J beta) cos(phi), px = -sqrt(2J/beta) (sin(phi) + alpha cos(phi)) */
+            double phi = atan2(-(alpha[p]*x + beta[p]*xp)/sqb, x/sqb);
+            if (k > 0) {
+                double dphi = phi - phase[2*c+p];
+                dphi -= TWOPI*floor(dphi/TWOPI);
+                sums[2*c+p] += w*dphi;
+            }
+            phase[2*c+p] = phi;
+        }
+    }
+}
+
+#if defined(MATLAB_MEX_FILE) || defined(PYAT)
+ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
+                                      double *r_in, int num_particles, struct parameters *Param)
+{
+    if (!Elem) {
+        int nwin;
+        double *beta, *alpha, *orbit, *phase, *sums;
+        nwin=atGetLong(ElemData,"NWindows"); check_error();
+        beta=atGetDoubleArray(ElemData,"Beta"); check_error();
+        alpha=atGetDoubleArray(ElemData,"Alpha"); check_error();
+        orbit=atGetDoubleArray(ElemData,"ClosedOrbit"); check_error();
+        phase=atGetDoubleArray(ElemData,"_phase"); check_error();
+        sums=atGetDoubleArray(ElemData,"_sums"); check_error();
+        int dimso[] = {4};
+        atCheckArrayDims(ElemData,"ClosedOrbit", 1, dimso); check_error();
+        int dimsp[] = {2, num_particles};
+        atCheckArrayDims(ElemData,"_phase", 2, dimsp); check_error();
+        int dimss[] = {2, num_particles, nwin};
+        atCheckArrayDims(ElemData,"_sums", 3, dimss); check_error();
+        Elem = (struct elem*)atMalloc(sizeof(struct elem));
+        Elem->turn = 0;
+        Elem->nwin = nwin;
+        Elem->wlength = Param->num_turns/nwin;
+        Elem->beta = beta;
+        Elem->alpha = alpha;
+        Elem->orbit = orbit;
+        Elem->phase = phase;
+        Elem->sums = sums;
+    }
+    TuneMonitorPass(r_in, num_particles, Elem);
+    Elem->turn++;
+    return Elem;
+}
+
+MODULE_DEF(TuneMonitorPass)        /* Dummy module initialisation */
+#endif
+
+#ifdef MATLAB_MEX_FILE
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    if (nrhs == 2) {
+        double *r_in;
+        const mxArray *ElemData = prhs[0];
+        int num_particles = mxGetN(prhs[1]);
+        struct elem El, *Elem=&El;
+
+        Elem->turn = 0;
+        Elem->nwin = atGetLong(ElemData,"NWindows"); check_error();
+        Elem->wlength = 1;
+        Elem->beta = atGetDoubleArray(ElemData,"Beta"); check_error();
+        Elem->alpha = atGetDoubleArray(ElemData,"Alpha"); check_error();
+        Elem->orbit = atGetDoubleArray(ElemData,"ClosedOrbit"); check_error();
+        Elem->phase = atGetDoubleArray(ElemData,"_phase"); check_error();
+        Elem->sums = atGetDoubleArray(ElemData,"_sums"); check_error();
+        if (mxGetM(prhs[1]) != 6) mexErrMsgIdAndTxt("AT:WrongArg","Second argument must be a 6 x N matrix: particle array");
+        /* ALLOCATE memory for the output array of the same size as the input  */
+        plhs[0] = mxDuplicateArray(prhs[1]);
+        r_in = mxGetDoubles(plhs[0]);
+        TuneMonitorPass(r_in, num_particles, Elem);
+    }
+    else if (nrhs == 0) {
+        /* list of required fields */
+        plhs[0] = mxCreateCellMatrix(6,1);
+        mxSetCell(plhs[0],0,mxCreateString("NWindows"));
+        mxSetCell(plhs[0],1,mxCreateString("Beta"));
+        mxSetCell(plhs[0],2,mxCreateString("Alpha"));
+        mxSetCell(plhs[0],3,mxCreateString("ClosedOrbit"));
+        mxSetCell(plhs[0],4,mxCreateString("_phase"));
+        mxSetCell(plhs[0],5,mxCreateString("_sums"));
+    }
+    else {
+        mexErrMsgIdAndTxt("AT:WrongArg","Needs 2 or 0 arguments");
+    }
+}
+#endif
@@ -13,12 +13,7 @@ struct elem
   int nelem;
   int nturns;
   double *normfact;
-  double *waketableT;
-  double *waketableDX;
-  double *waketableDY;
-  double *waketableQX;
-  double *waketableQY;
-  double *waketableZ;
+  struct waketable *waketable;
   double *turnhistory;
   double *z_cuts;
 };
@@ -31,15 +26,9 @@ void WakeFieldPass(double *r_in,int num_particles,double circumference,int nbunc
      * 1-d array of 6*N elements
      */   
     long nslice = Elem->nslice;
-    long nelem = Elem->nelem;
     long nturns = Elem->nturns;
     double *normfact = Elem->normfact;
-    double *waketableT = Elem->waketableT;
-    double *waketableDX = Elem->waketableDX;
-    double *waketableDY = Elem->waketableDY;
-    double *waketableQX = Elem->waketableQX;
-    double *waketableQY = Elem->waketableQY;
-    double *waketableZ = Elem->waketableZ;
+    struct waketable *waketable = Elem->waketable;
     double *turnhistory = Elem->turnhistory;
     double *z_cuts = Elem->z_cuts;    
 
@@ -70,8 +59,7 @@ void WakeFieldPass(double *r_in,int num_particles,double circumference,int nbunc
     rotate_table_history(nturns,nslice*nbunch,turnhistory,circumference);
     slice_bunch(r_in,num_particles,nslice,nturns,nbunch,bunch_spos,bunch_currents,
                 turnhistory,pslice,z_cuts);
-    compute_kicks(nslice*nbunch,nturns,nelem,turnhistory,waketableT,waketableDX,
-                  waketableDY,waketableQX,waketableQY,waketableZ,
+    compute_kicks(nslice*nbunch,nturns,waketable,turnhistory,
                   normfact,kx,ky,kx2,ky2,kz);
     
     /*apply kicks*/
@@ -102,11 +90,7 @@ ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
         static double lnf[3];
         double *normfact;
         double *waketableT;
-        double *waketableDX;
-        double *waketableDY;
-        double *waketableQX;
-        double *waketableQY;
-        double *waketableZ;
+        double *components[WAKE_NCOMP];
         double *turnhistory;
         double *z_cuts;
         int i;
@@ -119,17 +103,18 @@ ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
         turnhistory=atGetDoubleArray(ElemData,"_turnhistory"); check_error();
         normfact=atGetDoubleArray(ElemData,"NormFact"); check_error();
         /*optional attributes*/
-        waketableDX=atGetOptionalDoubleArray(ElemData,"_wakeDX"); check_error();
-        waketableDY=atGetOptionalDoubleArray(ElemData,"_wakeDY"); check_error();
-        waketableQX=atGetOptionalDoubleArray(ElemData,"_wakeQX"); check_error();
-        waketableQY=atGetOptionalDoubleArray(ElemData,"_wakeQY"); check_error();
-        waketableZ=atGetOptionalDoubleArray(ElemData,"_wakeZ"); check_error();
+        components[WAKE_DX]=atGetOptionalDoubleArray(ElemData,"_wakeDX"); check_error();
+        components[WAKE_DY]=atGetOptionalDoubleArray(ElemData,"_wakeDY"); check_error();
+        components[WAKE_QX]=atGetOptionalDoubleArray(ElemData,"_wakeQX"); check_error();
+        components[WAKE_QY]=atGetOptionalDoubleArray(ElemData,"_wakeQY"); check_error();
+        components[WAKE_Z]=atGetOptionalDoubleArray(ElemData,"_wakeZ"); check_error();
         z_cuts=atGetOptionalDoubleArray(ElemData,"ZCuts"); check_error();
 
         int dimsth[] = {Param->nbunch*nslice*nturns, 4};
         atCheckArrayDims(ElemData,"_turnhistory", 2, dimsth); check_error();
         
-        Elem = (struct elem*)atMalloc(sizeof(struct elem));
+        /* The wake table is stored after the element structure and released with it */
+        Elem = (struct elem*)atMalloc(sizeof(struct elem)+waketable_size(nelem,components));
         Elem->nslice=nslice;
         Elem->nelem=nelem;
         Elem->nturns=nturns;
@@ -137,12 +122,7 @@ ExportMode struct elem *trackFunction(const atElem *ElemData,struct elem *Elem,
            lnf[i]=normfact[i]*wakefact;
         }
         Elem->normfact=lnf;
-        Elem->waketableT=waketableT;
-        Elem->waketableDX=waketableDX;
-        Elem->waketableDY=waketableDY;
-        Elem->waketableQX=waketableQX;
-        Elem->waketableQY=waketableQY;
-        Elem->waketableZ=waketableZ;
+        Elem->waketable=waketable_init(Elem+1,waketableT,nelem,components);
         Elem->turnhistory=turnhistory;
         Elem->z_cuts=z_cuts;
     }
@@ -177,11 +157,7 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
         static double lnf[3];
         double *normfact;
         double *waketableT;
-        double *waketableDX;
-        double *waketableDY;
-        double *waketableQX;
-        double *waketableQY;
-        double *waketableZ;
+        double *components[WAKE_NCOMP];
         double *turnhistory;
         double *z_cuts;
 
@@ -193,11 +169,11 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
         turnhistory=atGetDoubleArray(ElemData,"_turnhistory"); check_error();
         normfact=atGetDoubleArray(ElemData,"NormFact"); check_error();
         /*optional attributes*/
-        waketableDX=atGetOptionalDoubleArray(ElemData,"_wakeDX"); check_error();
-        waketableDY=atGetOptionalDoubleArray(ElemData,"_wakeDY"); check_error();
-        waketableQX=atGetOptionalDoubleArray(ElemData,"_wakeQX"); check_error();
-        waketableQY=atGetOptionalDoubleArray(ElemData,"_wakeQY"); check_error();
-        waketableZ=atGetOptionalDoubleArray(ElemData,"_wakeZ"); check_error();
+        components[WAKE_DX]=atGetOptionalDoubleArray(ElemData,"_wakeDX"); check_error();
+        components[WAKE_DY]=atGetOptionalDoubleArray(ElemData,"_wakeDY"); check_error();
+        components[WAKE_QX]=atGetOptionalDoubleArray(ElemData,"_wakeQX"); check_error();
+        components[WAKE_QY]=atGetOptionalDoubleArray(ElemData,"_wakeQY"); check_error();
+        components[WAKE_Z]=atGetOptionalDoubleArray(ElemData,"_wakeZ"); check_error();
         z_cuts=atGetOptionalDoubleArray(ElemData,"ZCuts"); check_error();
         
         Elem->nslice=nslice;
@@ -207,12 +183,8 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
            lnf[i]=normfact[i]*wakefact;
         }
         Elem->normfact=lnf;
-        Elem->waketableT=waketableT;
-        Elem->waketableDX=waketableDX;
-        Elem->waketableDY=waketableDY;
-        Elem->waketableQX=waketableQX;
-        Elem->waketableQY=waketableQY;
-        Elem->waketableZ=waketableZ;
+        Elem->waketable=waketable_init(atMalloc(waketable_size(nelem,components)),
+                                       waketableT,nelem,components);
         Elem->turnhistory=turnhistory;
         Elem->z_cuts=z_cuts;
 
@@ -227,6 +199,7 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
         WakeFieldPass(r_in,num_particles, 1, 1, bspos, bcurr, Elem);
         free(bspos);
         free(bcurr);
+        atFree(Elem->waketable);
     }
     else if (nrhs == 0) {
         /* list of required fields */
@@ -2,40 +2,136 @@
 #include "atelem.c"
 #include <math.h>
 #include <float.h>
-#include <complex.h>
 #ifdef MPI
 #include <mpi.h>
 #include <mpi4py/mpi4py.h>
 #endif
 
-int binarySearch(double *array,double value,int upper,int lower,int nStep){
-    int pivot = (int)(lower+upper)/2;
-    if ((upper-lower)<=1){
-        return lower;
-    };
-    if (value < array[pivot]){
-        upper = pivot;
-        nStep+=1;
-        return binarySearch(array,value,upper,lower,nStep);
-    } else if (value > array[pivot]){
-        lower = pivot;
-        nStep+=1;
-        return binarySearch(array,value,upper,lower,nStep);
-    }else{
-        return pivot;
-    };
+/*
+ * Wake table with precomputed lookup.
+ *
+ * The table abscissa and all wake components are stored interleaved with
+ * one record per table point: t, then (w, dw/dt) for each available
+ * component, so that a single index lookup serves all components.
+ * A uniform grid with stored reciprocal spacing gives for each cell the
+ * range of table points it covers: locating a distance is O(1) index
+ * arithmetic for uniform tables and a short bisection within one cell for
+ * non-uniform ones (Wake.build_srange).
+ */
+
+#define WAKE_NCOMP 5
+
+enum wakecomp {WAKE_DX, WAKE_DY, WAKE_QX, WAKE_QY, WAKE_Z};
+
+struct waketable {
+    int nelem;                  /* number of table points */
+    int ngrid;                  /* number of grid cells */
+    int stride;                 /* length of a record */
+    int offset[WAKE_NCOMP];     /* location of each component in a record, 0 if absent */
+    double tmin;                /* first table point */
+    double tmax;                /* last table point */
+    double rstep;               /* reciprocal grid spacing */
+    double *data;               /* nelem records */
+    int *grid;                  /* ngrid+1 indices */
 };
 
+static size_t waketable_size(int nelem, double **components)
+{
+    int ic, stride = 1;
+    int ngrid = (nelem > 1) ? 2*(nelem-1) : 1;
+    for (ic=0; ic<WAKE_NCOMP; ic++)
+        if (components[ic]) stride += 2;
+    return sizeof(struct waketable) + nelem*stride*sizeof(double) + (ngrid+1)*sizeof(int);
+}
 
-static double getTableWake(double *waketable,double *waketableT,double distance,int index){
-    double w = waketable[index] + (distance-waketableT[index])*(waketable[index+1]-waketable[index])/
-          (waketableT[index+1]-waketableT[index]);
-    if(atIsNaN(w)){
+/* Build the table in buffer, which must hold waketable_size(nelem, components) bytes */
+static struct waketable *waketable_init(void *buffer, double *waketableT, int nelem,
+                                        double **components)
+{
+    struct waketable *wt = (struct waketable *) buffer;
+    int i, ic, k, stride = 1;
+    double step;
+
+    for (ic=0; ic<WAKE_NCOMP; ic++) {
+        if (components[ic]) {
+            wt->offset[ic] = stride;
+            stride += 2;
+        }
+        else {
+            wt->offset[ic] = 0;
+        }
+    }
+    wt->nelem = nelem;
+    wt->stride = stride;
+    wt->ngrid = (nelem > 1) ? 2*(nelem-1) : 1;
+    wt->tmin = waketableT[0];
+    wt->tmax = waketableT[nelem-1];
+    wt->data = (double *)(wt+1);
+    wt->grid = (int *)(wt->data + nelem*stride);
+
+    for (i=0; i<nelem; i++) {
+        double *rec = wt->data + i*stride;
+        rec[0] = waketableT[i];
+        for (ic=0; ic<WAKE_NCOMP; ic++) {
+            int off = wt->offset[ic];
+            if (off) {
+                double *w = components[ic];
+                rec[off] = w[i];
+                rec[off+1] = (i < nelem-1) ? (w[i+1]-w[i])/(waketableT[i+1]-waketableT[i]) : 0.0;
+            }
+        }
+    }
+
+    /* grid[k]: last table point below the start of cell k, excluding the last point */
+    if (wt->tmax > wt->tmin) {
+        step = (wt->tmax-wt->tmin)/wt->ngrid;
+        wt->rstep = 1.0/step;
+    }
+    else {
+        step = 0.0;
+        wt->rstep = 0.0;
+    }
+    for (k=0, i=0; k<=wt->ngrid; k++) {
+        double tk = wt->tmin + k*step;
+        while ((i < nelem-2) && (waketableT[i+1] <= tk)) i++;
+        wt->grid[k] = i;
+    }
+    return wt;
+}
+
+/* Return the record of the last table point <= ds. tmin <= ds < tmax is assumed */
+static const double *waketable_record(const struct waketable *wt, double ds)
+{
+    int stride = wt->stride;
+    const double *data = wt->data;
+    int k = (int)((ds-wt->tmin)*wt->rstep);
+    int lo, hi;
+    if (k < 0) k = 0;
+    if (k >= wt->ngrid) k = wt->ngrid-1;
+    lo = wt->grid[k];
+    hi = wt->grid[k+1];
+    /* guard against rounding at cell boundaries */
+    while ((lo > 0) && (data[lo*stride] > ds)) lo--;
+    while ((hi < wt->nelem-2) && (data[(hi+1)*stride] <= ds)) hi++;
+    while (hi > lo) {
+        int mid = (lo+hi+1)/2;
+        if (data[mid*stride] <= ds) lo = mid;
+        else hi = mid-1;
+    }
+    return data + lo*stride;
+}
+
+/* Linear interpolation of the component stored at offset off */
+static double waketable_value(const double *rec, int off, double ds)
+{
+    double w = rec[off] + (ds-rec[0])*rec[off+1];
+    if (atIsNaN(w)) {
         return 0;
-    }else{
+    }
+    else {
         return w;
-    };
-};
+    }
+}
 
 static void rotate_table_history(long nturns,long nslice,double *turnhistory,double circumference){
 
@@ -198,19 +294,25 @@ static void slice_bunch(double *r_in,int num_particles,int nslice,int nturns,
     atFree(hz);
 };
 
-static void compute_kicks(int nslice,int nturns,int nelem,
-                   double *turnhistory,double *waketableT,double *waketableDX,
-                   double *waketableDY,double *waketableQX,double *waketableQY,
-                   double *waketableZ,double *normfact, double *kx,double *ky,
+static void compute_kicks(int nslice,int nturns,struct waketable *waketable,
+                   double *turnhistory,double *normfact, double *kx,double *ky,
                    double *kx2,double *ky2,double *kz){
     int rank=0;
     int size=1;
-    int i,ii,index;
+    int i,ii;
     double ds,wi,dx,dy;
+    const double *rec;
     double *turnhistoryX = turnhistory;
     double *turnhistoryY = turnhistory+nslice*nturns;
     double *turnhistoryZ = turnhistory+nslice*nturns*2;
     double *turnhistoryW = turnhistory+nslice*nturns*3;
+    int offDX = waketable->offset[WAKE_DX];
+    int offDY = waketable->offset[WAKE_DY];
+    int offQX = waketable->offset[WAKE_QX];
+    int offQY = waketable->offset[WAKE_QY];
+    int offZ = waketable->offset[WAKE_Z];
+    double tmin = waketable->tmin;
+    double tmax = waketable->tmax;
 
     for (i=0;i<nslice;i++) {
         kx[i]=0.0;
@@ -229,25 +331,25 @@ static void compute_kicks(int nslice,int nturns,int nelem,
             for (ii=0;ii<nslice*nturns;ii++){
                 ds = turnhistoryZ[i]-turnhistoryZ[ii];
                 wi = turnhistoryW[ii];
-                if(wi>0.0 && ds>=waketableT[0] && ds<waketableT[nelem-1]){
+                if(wi>0.0 && ds>=tmin && ds<tmax){
                     dx = turnhistoryX[ii];
                     dy = turnhistoryY[ii];
-                    index = binarySearch(waketableT,ds,nelem,0,0);          
-                    if(waketableDX)kx[i-nslice*(nturns-1)] += dx*normfact[0]*wi*getTableWake(waketableDX,waketableT,ds,index);
-                    if(waketableDY)ky[i-nslice*(nturns-1)] += dy*normfact[1]*wi*getTableWake(waketableDY,waketableT,ds,index);
-                    if(waketableQX)kx2[i-nslice*(nturns-1)] += normfact[0]*wi*getTableWake(waketableQX,waketableT,ds,index);
-                    if(waketableQY)ky2[i-nslice*(nturns-1)] += normfact[1]*wi*getTableWake(waketableQY,waketableT,ds,index);
-                    if(waketableZ) kz[i-nslice*(nturns-1)] += normfact[2]*wi*getTableWake(waketableZ,waketableT,ds,index);
+                    rec = waketable_record(waketable,ds);
+                    if(offDX)kx[i-nslice*(nturns-1)] += dx*normfact[0]*wi*waketable_value(rec,offDX,ds);
+                    if(offDY)ky[i-nslice*(nturns-1)] += dy*normfact[1]*wi*waketable_value(rec,offDY,ds);
+                    if(offQX)kx2[i-nslice*(nturns-1)] += normfact[0]*wi*waketable_value(rec,offQX,ds);
+                    if(offQY)ky2[i-nslice*(nturns-1)] += normfact[1]*wi*waketable_value(rec,offQY,ds);
+                    if(offZ) kz[i-nslice*(nturns-1)] += normfact[2]*wi*waketable_value(rec,offZ,ds);
                 }            
             }
         }
     }
     #ifdef MPI
-    if(waketableDX)MPI_Allreduce(MPI_IN_PLACE,kx,nslice,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
-    if(waketableDY)MPI_Allreduce(MPI_IN_PLACE,ky,nslice,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
-    if(waketableQX)MPI_Allreduce(MPI_IN_PLACE,kx2,nslice,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
-    if(waketableQY)MPI_Allreduce(MPI_IN_PLACE,ky2,nslice,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
-    if(waketableZ)MPI_Allreduce(MPI_IN_PLACE,kz,nslice,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
+    if(offDX)MPI_Allreduce(MPI_IN_PLACE,kx,nslice,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
+    if(offDY)MPI_Allreduce(MPI_IN_PLACE,ky,nslice,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
+    if(offQX)MPI_Allreduce(MPI_IN_PLACE,kx2,nslice,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
+    if(offQY)MPI_Allreduce(MPI_IN_PLACE,ky2,nslice,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
+    if(offZ)MPI_Allreduce(MPI_IN_PLACE,kz,nslice,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
     MPI_Barrier(MPI_COMM_WORLD);
     #endif
 };
@@ -372,42 +474,66 @@ static void compute_kicks_longres(int nslice,int nbunch,int nturns, double *turn
 };
 
 
-static void compute_kicks_phasor(int nslice, int nbunch, int nturns, double *turnhistory,
-                          double normfact, double *kz,double freq, double qfactor,
-                          double rshunt, double *vbeam, double circumference,
-                          double energy, double beta, double *vbeamk, double *vbunch){  
-    #ifndef _MSC_VER  
-    int i,ib,is;
-    double wi;
-    double selfkick;
+/*
+ * Phasor method for a set of longitudinal resonator modes.
+ *
+ * The voltage induced in each mode is a phasor propagated from slice to
+ * slice by the decay and rotation factor exp((i*omega-alpha)*dt). All modes
+ * are advanced together in a single pass over the slices, the mode loop
+ * working on contiguous arrays. The propagation factors only depend on the
+ * slice spacing and are reused when it does not change (uniform slicing,
+ * empty slices).
+ *
+ * vbeam:  (nmodes, 2) phasor (amplitude, phase) of each mode, updated
+ * vbeamk: (nmodes, 2) beam-averaged voltage of each mode
+ * vbunch: (nbunch, 2, nmodes) bunch-averaged voltage of each mode, may be NULL
+ */
+static void compute_kicks_phasor_modes(int nslice, int nbunch, int nturns, double *turnhistory,
+                                       double normfact, double *kz, int nmodes, double *freq,
+                                       double *qfactor, double *rshunt, double *vbeam,
+                                       double circumference, double energy, double beta,
+                                       double *vbeamk, double *vbunch){
+    int i,ib,m;
     int sliceperturn = nslice*nbunch;
-    double dt =0.0;
-    double *turnhistoryZ = turnhistory+nslice*nbunch*nturns*2;
-    double *turnhistoryW = turnhistory+nslice*nbunch*nturns*3;
-    double omr = TWOPI*freq;
-    double complex vbeamc = vbeam[0]*cexp(I*vbeam[1]);
-    double complex vbeamkc = 0.0;
-    double kloss = rshunt*omr/(2*qfactor);
+    double *turnhistoryZ = turnhistory+sliceperturn*nturns*2+sliceperturn*(nturns-1);
+    double *turnhistoryW = turnhistory+sliceperturn*nturns*3+sliceperturn*(nturns-1);
     double bc = beta*C0;
-    double *vbr = vbunch;
-    double *vbi = vbunch+nbunch;
-    double totalW=0.0;
-    double *totalWb = atMalloc(nbunch*sizeof(double));
-    
-    for (i=0;i<sliceperturn;i++) {
-        ib = (int)(i/nslice);
-        kz[i]=0.0;
-        vbr[ib] = 0.0;
-        vbi[ib] = 0.0;
-        totalWb[ib] = 0.0;
+    double totalW = 0.0;
+    double dt;
+    double lastdt = atGetNaN();
+    double *buffer = atMalloc((9*nmodes+nbunch)*sizeof(double));
+    double *omega = buffer;
+    double *alpha = omega+nmodes;
+    double *kloss = alpha+nmodes;
+    double *vr = kloss+nmodes;
+    double *vi = vr+nmodes;
+    double *fr = vi+nmodes;
+    double *fi = fr+nmodes;
+    double *sumr = fi+nmodes;
+    double *sumi = sumr+nmodes;
+    double *totalWb = sumi+nmodes;
+
+    for (m=0;m<nmodes;m++) {
+        omega[m] = TWOPI*freq[m];
+        alpha[m] = omega[m]/(2*qfactor[m]);
+        kloss[m] = rshunt[m]*alpha[m];
+        vr[m] = vbeam[m]*cos(vbeam[m+nmodes]);
+        vi[m] = vbeam[m]*sin(vbeam[m+nmodes]);
+        sumr[m] = 0.0;
+        sumi[m] = 0.0;
     }
-    
-    for(i=sliceperturn*(nturns-1);i<sliceperturn*nturns;i++){
-        ib = (int)((i-sliceperturn*(nturns-1))/nslice);
-        wi = turnhistoryW[i];
-        selfkick = normfact*wi*kloss*energy;
-        if(i==sliceperturn*(nturns-1)){
-            /*At the end of the turn, the vbeamc is
+    for (ib=0;ib<nbunch;ib++) totalWb[ib] = 0.0;
+    if (vbunch) {
+        for (i=0;i<2*nbunch*nmodes;i++) vbunch[i] = 0.0;
+    }
+
+    for(i=0;i<sliceperturn;i++){
+        double wi = turnhistoryW[i];
+        double selfkick = normfact*wi*energy;
+        double kick = 0.0;
+        ib = (int)(i/nslice);
+        if(i==0){
+            /*At the end of the turn, the phasor is
             reverted to -final value, which stores the
             dt information from previous turn. This extra
             circumference is needed to take this into account. */
@@ -416,36 +542,68 @@ static void compute_kicks_phasor(int nslice, int nbunch, int nturns, double *tur
             /* This is dt between each slice*/
             dt = (turnhistoryZ[i]-turnhistoryZ[i-1])/bc;
         }
-        vbeamc *= cexp((I*omr-omr/(2*qfactor))*dt);
-        /*vbeamkc is average kick i.e. average vbeam*/   
-        vbeamkc += (vbeamc+selfkick)*wi;
+        if (dt != lastdt) {
+            for (m=0;m<nmodes;m++) {
+                double decay = exp(-alpha[m]*dt);
+                fr[m] = decay*cos(omega[m]*dt);
+                fi[m] = decay*sin(omega[m]*dt);
+            }
+            lastdt = dt;
+        }
+        for (m=0;m<nmodes;m++) {
+            double sk = selfkick*kloss[m];
+            double re = vr[m]*fr[m] - vi[m]*fi[m] + sk;
+            double im = vr[m]*fi[m] + vi[m]*fr[m];
+            kick += re;
+            sumr[m] += re*wi;
+            sumi[m] += im*wi;
+            if (vbunch) {
+                vbunch[2*nbunch*m+ib] += re*wi;
+                vbunch[2*nbunch*m+nbunch+ib] += im*wi;
+            }
+            vr[m] = re + sk;
+            vi[m] = im;
+        }
+        kz[i] = kick/energy;
         totalW += wi;
         totalWb[ib] += wi;
-        kz[i-sliceperturn*(nturns-1)] = creal((vbeamc + selfkick)/energy);
-        vbr[ib] += creal((vbeamc + selfkick)*wi);
-        vbi[ib] += cimag((vbeamc + selfkick)*wi);
-        vbeamc += 2*selfkick;    
     }
-    
-    /*This takes the vbeam backwards in time to effectively store the
+
+    /*This takes the phasors backwards in time to effectively store the
     final slice position */
-    dt = -turnhistoryZ[sliceperturn*nturns-1]/bc;    
-    vbeamc *= cexp((I*omr-omr/(2*qfactor))*dt);
-
-    vbeam[0] = cabs(vbeamc);
-    vbeam[1] = carg(vbeamc);
-    vbeamkc /= (totalW);
-    vbeamk[0] = cabs(vbeamkc);
-    vbeamk[1] = carg(vbeamkc);   
-    
-    for(i=0;i<nbunch;i++){
-        double vr = vbr[i]/totalWb[i];
-        double vi = vbi[i]/totalWb[i];
-        vbr[i] = sqrt(vr*vr+vi*vi); 
-        vbi[i] = atan2(vi,vr);
+    dt = -turnhistoryZ[sliceperturn-1]/bc;
+    for (m=0;m<nmodes;m++) {
+        double decay = exp(-alpha[m]*dt);
+        double re = decay*(vr[m]*cos(omega[m]*dt) - vi[m]*sin(omega[m]*dt));
+        double im = decay*(vr[m]*sin(omega[m]*dt) + vi[m]*cos(omega[m]*dt));
+        vbeam[m] = sqrt(re*re+im*im);
+        vbeam[m+nmodes] = atan2(im,re);
+        vbeamk[m] = sqrt(sumr[m]*sumr[m]+sumi[m]*sumi[m])/totalW;
+        vbeamk[m+nmodes] = atan2(sumi[m],sumr[m]);
     }
-    atFree(totalWb);
-    #endif    
+
+    if (vbunch) {
+        for (m=0;m<nmodes;m++) {
+            double *vb = vbunch+2*nbunch*m;
+            for(ib=0;ib<nbunch;ib++){
+                double vre = vb[ib]/totalWb[ib];
+                double vim = vb[ib+nbunch]/totalWb[ib];
+                vb[ib] = sqrt(vre*vre+vim*vim);
+                vb[ib+nbunch] = atan2(vim,vre);
+            }
+        }
+    }
+    atFree(buffer);
+};
+
+
+static void compute_kicks_phasor(int nslice, int nbunch, int nturns, double *turnhistory,
+                          double normfact, double *kz,double freq, double qfactor,
+                          double rshunt, double *vbeam, double circumference,
+                          double energy, double beta, double *vbeamk, double *vbunch){
+    compute_kicks_phasor_modes(nslice,nbunch,nturns,turnhistory,normfact,kz,1,&freq,
+                               &qfactor,&rshunt,vbeam,circumference,energy,beta,
+                               vbeamk,vbunch);
 };
 
 
@@ -1,75 +1,82 @@
 /*
  *  This code is based on the elegant function computeDrivingTerms
- *  it has been modified to be used from the matlab accelerator toolbox 
+ *  it has been modified to be used from the matlab accelerator toolbox
  *  using the function computeRDT()
  *  The formulas have not been changed
- *  
+ *
+ *  When compiled with PYAT defined, it builds the python extension
+ *  at.physics.rdtlib, used by at.physics.rdt. The python extension computes
+ *  the driving terms at several observation points in parallel, and can
+ *  update previously computed driving terms when only a few magnet
+ *  strengths change.
  */
 
+#if defined(PYAT)
+#include "atcommon.h"
+#else
 #include "mex.h"
+#endif
 #include <complex>
 #include <cmath>
 #include <cstring>
+#include <vector>
 
+#if !defined(PYAT) && !defined(mxGetDoubles)
 /* Get ready for R2018a C matrix API */
-#ifndef mxGetDoubles
 #define mxGetDoubles mxGetPr
 #define mxSetDoubles mxSetPr
 typedef double mxDouble;
 #endif
 
-typedef struct {
-  double betax, betay;
-  double rbetax, rbetay;           /* rbetax = sqrt(betax) */
-  double betax2, betay2;           /* betax2 = betax^2 */
-  double phix, phiy;
-  std::complex <double> px[5], py[5];    /* px[j]=(exp(i*phix))^j j>0 */
-  double b2L, b3L, s;
-} ELEMDATA;
+typedef std::complex<double> cplx;
 
-typedef struct {
-  /* First-order geometric terms (abs, real, imag) */
-  double h21000[3], h30000[3], h10110[3], h10020[3], h10200[3];
+/* Selection of driving terms */
+#define CHROMATIC1  1
+#define COUPLING1   2
+#define GEOMETRIC1  4
+#define GEOMETRIC2  8
+#define TUNESHIFTS  16
+
+/* Index of the driving terms in the output arrays */
+enum {
+  /* First-order geometric terms */
+  H21000, H30000, H10110, H10020, H10200,
   /* First order chromatic terms */
-  double h11001[3], h00111[3], h20001[3], h00201[3], h10002[3];
-  /* First order coupling terms */
-  double h10010[3], h10100[3];
-  /* Second-order geometric terms */
-  double h22000[3], h11110[3], h00220[3], h31000[3], h40000[3];
-  double h20110[3], h11200[3], h20020[3], h20200[3], h00310[3], h00400[3];
-  /* tune shifts with amplitude */
-  double dnux_dJx, dnux_dJy, dnuy_dJy;
-
-  /* resonance driving terms, obtained from hamiltonian driving terms */
-  /* First-order geometric terms (abs, real, imag) */
-  double f21000[3], f30000[3], f10110[3], f10020[3], f10200[3];
+  H11001, H00111, H20001, H00201, H10002,
   /* First order coupling terms */
-  double f10010[3], f10100[3];
+  H10010, H10100,
   /* Second-order geometric terms */
-  double f31000[3], f40000[3];
-  double f20110[3], f11200[3], f20020[3], f20200[3], f00310[3], f00400[3];
-  
-  
-} DRIVING_TERMS;
+  H22000, H11110, H00220, H31000, H40000,
+  H20110, H11200, H20020, H20200, H00310, H00400,
+  NTERMS
+};
 
-void computeDrivingTerms(DRIVING_TERMS *d, int NumElem,
-							double *s, double *betax, double *betay, double *phix, double *phiy, double *etax,
-							double *Lista2L, double *Listb2L, double *Listb3L, double *Listb4L, double *tune,
-							char Geometric1, char Geometric2, char Chromatic1, char Coupling1, char TuneShifts, long nPeriods);
+/* Index of the tune shifts with amplitude */
+enum {DNUX_DJX, DNUX_DJY, DNUY_DJY, NSHIFTS};
 
-/* The gateway function */
-void mexFunction( int nlhs, mxArray *plhs[],
-                  int nrhs, const mxArray *prhs[]);
+/* Index of the magnet strengths */
+enum {A2L, B2L, B3L, B4L, NSTRENGTHS};
+
+static const double PI = 3.141592653589793;
+static const double PIx2 = 6.283185307179586;
+
+typedef struct {
+  double betax, betay;
+  double rbetax, rbetay;           /* rbetax = sqrt(betax) */
+  double betax2, betay2;           /* betax2 = betax^2 */
+  double etax;
+  double phix, phiy;
+  cplx px[5], py[5];               /* px[j]=(exp(i*phix))^j j>0 */
+  double s;
+} ELEMDATA;
 
 /* square function */
-double sqr(double input)
+static double sqr(double input)
 {
-	double square=0;
-	square = input * input;
-	return square;
+	return input * input;
 }
 /* sign function */
-double SIGN(double number)
+static double SIGN(double number)
 {
 	if (number>0)
 		return 1;
@@ -80,371 +87,203 @@ double SIGN(double number)
 			return 0;
 }
 
-/* void computeDrivingTerms(DRIVING_TERMS *d, ELEMENT_LIST *elem, TWISS *twiss0, double *tune, long nPeriods)*/
-void computeDrivingTerms(DRIVING_TERMS *d, int NumElem,
-							double *s, double *betax, double *betay, double *phix, double *phiy, double *etax,
-							double *Lista2L, double *Listb2L, double *Listb3L, double *Listb4L, double *tune, 
-							char Chromatic1, char Coupling1, char Geometric1, char Geometric2, char TuneShifts,
-							long nPeriods)
-/* Based on J. Bengtsson, SLS Note 9/97, March 7, 1997, with corrections per W. Guo (NSLS) */
-/* Revised to follow C. X. Wang AOP-TN-2009-020 for second-order terms */
+/* Strengths below the threshold are ignored */
+static double active(double strength)
 {
-  std::complex <double> h11001, h00111, h20001, h00201, h10002, h10010, h10100;
-  std::complex <double> h21000, h30000, h10110, h10020, h10200;
-  std::complex <double> h22000, h11110, h00220, h31000, h40000;
-  std::complex <double> h20110, h11200, h20020, h20200, h00310, h00400;
-  std::complex <double> t1, t2, t3, t4;
-  std::complex <double> ii;
-  std::complex <double> periodicFactor[9][9];
-#define PF(i,j) (periodicFactor[4+i][4+j])
-  double betax1, betay1, phix1, phiy1, etax1, termSign;
-  double coef, b2L, a2L, b3L, b4L, nux, nuy;
-  double PIx2 = 6.283185307179586;
-  double PI = 3.141592653589793;
-//  ELEMENT_LIST *eptr1;
-  double two=2, three=3, four=4;
-  ELEMDATA *ed = NULL;
-  long nE=0, iE, jE, i, j;
-  double sqrt8, sqrt2, tilt;
-
-  sqrt8 = sqrt((double)8);
-  sqrt2 = sqrt((double)2);
-  ii = std::complex<double>(0,1);
-
-//printf("leading_order_driving_terms_only=%d\n",leading_order_driving_terms_only);
-
-  /* accumulate real and imaginary parts */
-  h11001 = h00111 = h20001 = h00201 = h10002 = std::complex<double>(0,0);
-  h21000 = h30000 = h10110 = h10020 = h10200 = std::complex<double>(0,0);
-  h22000 = h11110 = h00220 = h31000 = h40000 = std::complex<double>(0,0);
-  h20110 = h11200 = h20020 = h20200 = h00310 = h00400 = std::complex<double>(0,0);
-  h10100 = h10010 = std::complex<double>(0,0);
-
-  d->dnux_dJx = d->dnux_dJy = d->dnuy_dJy = 0;
-
-  if (nPeriods!=1) {
-    double a1, a2;
-    for (i=0; i<9; i++) {
-      for (j=0; j<9; j++) {
-        a1 = PIx2*(tune[0]*(i-4)+tune[1]*(j-4));
-        a2 = a1/nPeriods;
-        periodicFactor[i][j] = (exp(ii*a1)-1.0)/(exp(ii*a2)-1.0);
-      }
-    }
-  } else {
-    for (i=0; i<9; i++)
-      for (j=0; j<9; j++)
-        periodicFactor[i][j] = 1;
-  }
+  return (fabs(strength)>1e-6) ? strength : 0.0;
+}
 
-ed = (ELEMDATA*)malloc(NumElem*sizeof(ELEMDATA));
-
-/*  eptr1 = elem;*/
-/*  while (eptr1) {*/
-  for (nE=0; nE<NumElem; nE++)
-	{
-    a2L = b2L = b3L = b4L = 0;
-    a2L = Lista2L[nE];
-    
-    b2L = Listb2L[nE];
-    
-    b3L = Listb3L[nE];
-    
-    b4L = Listb4L[nE];
-        
-    //printf("a2L=%f,b2L=%f,b3L=%f,b4L=%f\n",a2L,b2L,b3L,b4L);
-    
-//    if (a2L || b2L || b3L || b4L) 
-    	{
-        betax1 = betax[nE];
-        etax1  = etax[nE];
-        phix1  = phix[nE];
-        betay1 = betay[nE];
-        phiy1  = phiy[nE];
-    	
-    
-/*      ed = (ELEMDATA*)SDDS_Realloc(ed, sizeof(*ed)*(nE+1));*/
-      ed[nE].s = s[nE];
-      ed[nE].b2L = Listb2L[nE];
-      ed[nE].b3L = Listb3L[nE]; //printf("el %d. b3L= %f \n",nE,ed[nE].b3L);
-      ed[nE].betax = betax1;
-      ed[nE].betax2 = sqr(betax1);
-      ed[nE].rbetax = sqrt(betax1);
-      ed[nE].phix = phix1;
-      ed[nE].px[1] = exp(ii*phix1);
-      ed[nE].px[2] = ed[nE].px[1]*ed[nE].px[1];
-      ed[nE].px[3] = ed[nE].px[1]*ed[nE].px[2];
-      ed[nE].px[4] = ed[nE].px[1]*ed[nE].px[3];
-      ed[nE].betay = betay1;
-      ed[nE].betay2 = sqr(betay1);
-      ed[nE].rbetay = sqrt(betay1);
-      ed[nE].phiy = phiy1;
-      ed[nE].py[1] = exp(ii*phiy1);
-      ed[nE].py[2] = ed[nE].py[1]*ed[nE].py[1];
-      ed[nE].py[3] = ed[nE].py[1]*ed[nE].py[2];
-      ed[nE].py[4] = ed[nE].py[1]*ed[nE].py[3];
-
-      if (fabs(a2L)>1e-6) {
-		if(Coupling1)
-		{	/* linear coupling terms */
-			h10010 += (a2L/4)*ed[nE].rbetax*ed[nE].rbetay*ed[nE].px[1]/ed[nE].py[1]*PF(1, -1);
-			h10100 += (a2L/4)*ed[nE].rbetax*ed[nE].rbetay*ed[nE].px[1]*ed[nE].py[1]*PF(1, 1);
-		}
-      }
-      if (fabs(b2L)>1e-6 || fabs(b3L)>1e-6) 
-      {
-		if(Chromatic1)
-		{
-			/* first-order chromatic terms */
-			/* h11001 and h00111 */
-			h11001 += (b3L*betax1*etax1/2-b2L*betax1/4)*nPeriods;
-			h00111 += (b2L*betay1/4-b3L*betay1*etax1/2)*nPeriods;
-			/* h20001, h00201 */
-			h20001 += (b3L*betax1*etax1/2-b2L*betax1/4)/2*ed[nE].px[2]*PF(2,0);
-			h00201 += (b2L*betay1/4-b3L*betay1*etax1/2)/2*ed[nE].py[2]*PF(0,2);
-
-			/* h10002 */
-			h10002 += (b3L*ed[nE].rbetax*pow(etax1,2)-b2L*ed[nE].rbetax*etax1)/2*ed[nE].px[1]*PF(1,0);
-			//	h10002 += (b3L*ed[nE].rbetax*ipow(etax1,2)-b2L*ed[nE].rbetax*etax1)/2*ed[nE].px[1]*PF(1,0);
-		}
-      }
-      if (fabs(ed[nE].b3L)>1e-6) 
-      {
-      	if(Geometric1)
-        {
-        	/* first-order geometric terms from sextupoles */
-        	/* h21000 */
-			h21000 += b3L*ed[nE].rbetax*betax1/8*ed[nE].px[1]*PF(1,0);
-        	/* h30000 */
-			h30000 += b3L*ed[nE].rbetax*betax1/24*ed[nE].px[3]*PF(3,0);
-            /* h10110 */
-			h10110 += -b3L*ed[nE].rbetax*betay1/4*ed[nE].px[1]*PF(1,0);
-	        /* h10020 and h10200 */
-			h10020 += -b3L*ed[nE].rbetax*betay1/8*ed[nE].px[1]*conj(ed[nE].py[2])*PF(1,-2);
-			h10200 += -b3L*ed[nE].rbetax*betay1/8*ed[nE].px[1]*ed[nE].py[2]*PF(1,2);
-		}
-      }
-      if (fabs(b4L)>1e-6) 
-      {
-      	if (TuneShifts)
-      	{
-        	/* second-order terms from leading order effects of octupoles */
-			/* Ignoring a large number of terms that are not also driven by sextupoles */
-        	d->dnux_dJx += 3*b4L*ed[nE].betax2/(8*PI)*nPeriods;
-        	d->dnux_dJy -= 3*b4L*betax1*betay1/(4*PI)*nPeriods;
-        	d->dnuy_dJy += 3*b4L*ed[nE].betay2/(8*PI)*nPeriods;
-		}
-	if (Geometric2)
-	{
-		h22000 += 3*b4L*ed[nE].betax2/32*nPeriods;
-		h11110 += -3*b4L*betax1*betay1/8*nPeriods;
-		h00220 += 3*b4L*ed[nE].betay2/32*nPeriods;
-		h31000 += b4L*ed[nE].betax2/16*ed[nE].px[2]*PF(2,0);
-		h40000 += b4L*ed[nE].betax2/64*ed[nE].px[4]*PF(4,0);
-		h20110 += -3*b4L*betax1*betay1/16*ed[nE].px[2]*PF(2,0);
-		h11200 += -3*b4L*betax1*betay1/16*ed[nE].py[2]*PF(0,2);
-		h20020 += -3*b4L*betax1*betay1/32*ed[nE].px[2]*conj(ed[nE].py[2])*PF(2,-2);
-		h20200 += -3*b4L*betax1*betay1/32*ed[nE].px[2]*ed[nE].py[2]*PF(2,2);
-		h00310 += b4L*ed[nE].betay2/16*ed[nE].py[2]*PF(0,2);
-		h00400 += b4L*ed[nE].betay2/64*ed[nE].py[4]*PF(0,4);
-	}
-      }
+static void setElemData(ELEMDATA *ed, double s, double betax, double betay,
+                        double etax, double phix, double phiy)
+{
+  cplx ii(0,1);
+  ed->s = s;
+  ed->betax = betax;
+  ed->betax2 = sqr(betax);
+  ed->rbetax = sqrt(betax);
+  ed->etax = etax;
+  ed->phix = phix;
+  ed->px[1] = exp(ii*phix);
+  ed->px[2] = ed->px[1]*ed->px[1];
+  ed->px[3] = ed->px[1]*ed->px[2];
+  ed->px[4] = ed->px[1]*ed->px[3];
+  ed->betay = betay;
+  ed->betay2 = sqr(betay);
+  ed->rbetay = sqrt(betay);
+  ed->phiy = phiy;
+  ed->py[1] = exp(ii*phiy);
+  ed->py[2] = ed->py[1]*ed->py[1];
+  ed->py[3] = ed->py[1]*ed->py[2];
+  ed->py[4] = ed->py[1]*ed->py[3];
+}
+
+/* First-order contributions of one element, linear in the strengths
+ * str = {a2L, b2L, b3L, b4L}. Also used with strength variations. */
+static void firstOrderTerms(const ELEMDATA *ed, const double *str, int flags,
+                            cplx *h, double *dnu)
+{
+  double a2L = str[A2L];
+  double b2L = str[B2L];
+  double b3L = str[B3L];
+  double b4L = str[B4L];
+  double betax1 = ed->betax;
+  double betay1 = ed->betay;
+  double etax1 = ed->etax;
+
+  if (a2L != 0.0 && (flags & COUPLING1)) {
+    /* linear coupling terms */
+    h[H10010] += (a2L/4)*ed->rbetax*ed->rbetay*ed->px[1]/ed->py[1];
+    h[H10100] += (a2L/4)*ed->rbetax*ed->rbetay*ed->px[1]*ed->py[1];
   }
+  if ((b2L != 0.0 || b3L != 0.0) && (flags & CHROMATIC1)) {
+    /* first-order chromatic terms */
+    /* h11001 and h00111 */
+    h[H11001] += b3L*betax1*etax1/2-b2L*betax1/4;
+    h[H00111] += b2L*betay1/4-b3L*betay1*etax1/2;
+    /* h20001, h00201 */
+    h[H20001] += (b3L*betax1*etax1/2-b2L*betax1/4)/2*ed->px[2];
+    h[H00201] += (b2L*betay1/4-b3L*betay1*etax1/2)/2*ed->py[2];
+    /* h10002 */
+    h[H10002] += (b3L*ed->rbetax*pow(etax1,2)-b2L*ed->rbetax*etax1)/2*ed->px[1];
   }
-	
-  /* Done with the leading-order quad and sext terms */
-  d->h11001[0] = std::abs<double>(h11001);
-  d->h11001[1] = h11001.real();
-  d->h11001[2] = h11001.imag();
-  d->h00111[0] = std::abs<double>(h00111);
-  d->h00111[1] = h00111.real();
-  d->h00111[2] = h00111.imag();
-  d->h20001[0] = std::abs<double>(h20001);
-  d->h20001[1] = h20001.real();
-  d->h20001[2] = h20001.imag();
-  d->h00201[0] = std::abs<double>(h00201);
-  d->h00201[1] = h00201.real();
-  d->h00201[2] = h00201.imag();
-  d->h10002[0] = std::abs<double>(h10002);
-  d->h10002[1] = h10002.real();
-  d->h10002[2] = h10002.imag();
-
-  d->h10100[0] = std::abs<double>(h10100);
-  d->h10100[1] = h10100.real();
-  d->h10100[2] = h10100.imag();
-  d->h10010[0] = std::abs<double>(h10010);
-  d->h10010[1] = h10010.real();
-  d->h10010[2] = h10010.imag();
-
-  d->h21000[0] = std::abs<double>(h21000);
-  d->h21000[1] = h21000.real();
-  d->h21000[2] = h21000.imag();
-  d->h30000[0] = std::abs<double>(h30000);
-  d->h30000[1] = h30000.real();
-  d->h30000[2] = h30000.imag();
-  d->h10110[0] = std::abs<double>(h10110);
-  d->h10110[1] = h10110.real();
-  d->h10110[2] = h10110.imag();
-  d->h10020[0] = std::abs<double>(h10020);
-  d->h10020[1] = h10020.real();
-  d->h10020[2] = h10020.imag();
-  d->h10200[0] = std::abs<double>(h10200);
-  d->h10200[1] = h10200.real();
-  d->h10200[2] = h10200.imag();
-//	printf("d->dnux_dJx=%f, d->dnux_dJy=%f, d->dnuy_dJy=%f\n",d->dnux_dJx,d->dnux_dJy,d->dnuy_dJy);
- 
-//  if (!leading_order_driving_terms_only) 
-  if (Geometric2 || TuneShifts) 
-  {
-    /* compute sextupole contributions to second-order terms */
-    if (nPeriods!=1) 
-    {
-      printf("ERROR: computating of higher-order driving terms not available when n_periods!=1");
-//      return 0;
-	}
-	//printf("entered in !leading_order_driving_terms_only\n");
-    nux = tune[0];
-    nuy = tune[1];
-
-    for (iE=0; iE<NumElem; iE++) {
-      if (fabs(ed[iE].b3L)>1e-6) {
-	for (jE=0; jE<NumElem; jE++) {
-	  if (fabs(ed[jE].b3L)>1e-6) {
-	  if(TuneShifts)
-	  {
-	    d->dnux_dJx += ed[iE].b3L*ed[jE].b3L/(-16*PI)*pow(ed[iE].betax*ed[jE].betax, 1.5)*
-	      (3*cos(fabs(ed[iE].phix-ed[jE].phix)-PI*nux)/sin(PI*nux) + cos(fabs(3*(ed[iE].phix-ed[jE].phix))-3*PI*nux)/sin(3*PI*nux));
-	    d->dnux_dJy += ed[iE].b3L*ed[jE].b3L/(8*PI)*sqrt(ed[iE].betax*ed[jE].betax)*ed[iE].betay*
-	      (2*ed[jE].betax*cos(fabs(ed[iE].phix-ed[jE].phix)-PI*nux)/sin(PI*nux) 
-	       - ed[jE].betay*cos(fabs(ed[iE].phix-ed[jE].phix)+2*fabs(ed[iE].phiy-ed[jE].phiy)-PI*(nux+2*nuy))/sin(PI*(nux+2*nuy))
-	       + ed[jE].betay*cos(fabs(ed[iE].phix-ed[jE].phix)-2*fabs(ed[iE].phiy-ed[jE].phiy)-PI*(nux-2*nuy))/sin(PI*(nux-2*nuy)));
-	    d->dnuy_dJy += ed[iE].b3L*ed[jE].b3L/(-16*PI)*sqrt(ed[iE].betax*ed[jE].betax)*ed[iE].betay*ed[jE].betay*
-	      (4*cos(fabs(ed[iE].phix-ed[jE].phix)-PI*nux)/sin(PI*nux) 
-	       + cos(fabs(ed[iE].phix-ed[jE].phix)+2*fabs(ed[iE].phiy-ed[jE].phiy)-PI*(nux+2*nuy))/sin(PI*(nux+2*nuy)) 
-	       + cos(fabs(ed[iE].phix-ed[jE].phix)-2*fabs(ed[iE].phiy-ed[jE].phiy)-PI*(nux-2*nuy))/sin(PI*(nux-2*nuy)));
-	   }
-	   if (Geometric2)
-	   {
-	    termSign = SIGN(ed[iE].s - ed[jE].s);
-            if (termSign) {
-              /* geometric terms */
-              h22000 += (1./64)*termSign*ii*ed[iE].b3L*ed[jE].b3L*
-                ed[iE].rbetax*ed[jE].rbetax*ed[iE].betax*ed[jE].betax*
-                (ed[iE].px[3]*conj(ed[jE].px[3]) + three*ed[iE].px[1]*conj(ed[jE].px[1]));
-              h31000 += (1./32)*termSign*ii*ed[iE].b3L*ed[jE].b3L*
-                ed[iE].rbetax*ed[jE].rbetax*ed[iE].betax*ed[jE].betax*
-                ed[iE].px[3]*conj(ed[jE].px[1]);
-	      t1 = conj(ed[iE].px[1])*ed[jE].px[1];
-	      t2 = ed[iE].px[1]*conj(ed[jE].px[1]);
-              h11110 += (1./16)*termSign*ii*ed[iE].b3L*ed[jE].b3L*
-                ed[iE].rbetax*ed[jE].rbetax*ed[iE].betay*
-                (ed[jE].betax*(t1 - conj(t1) )
-                 + 
-		 ed[jE].betay*ed[iE].py[2]*conj(ed[jE].py[2])*(conj(t1) + t1)
-		 );
-	      t1 = exp(-ii*(ed[iE].phix-ed[jE].phix));
-	      t2 = conj(t1);
-              h11200 += (1./32)*termSign*ii*ed[iE].b3L*ed[jE].b3L*
-                ed[iE].rbetax*ed[jE].rbetax*ed[iE].betay*exp(ii*(2*ed[iE].phiy))*
-                (ed[jE].betax*(t1 - t2)
-                 + 
-		 two*ed[jE].betay*(t2 + t1)
-		 );
-              h40000 += (1./64)*termSign*ii*ed[iE].b3L*ed[jE].b3L*
-                ed[iE].rbetax*ed[jE].rbetax*ed[iE].betax*ed[jE].betax*
-                ed[iE].px[3]*ed[jE].px[1];
-              h20020 += (1./64)*termSign*ii*ed[iE].b3L*ed[jE].b3L*
-                ed[iE].rbetax*ed[jE].rbetax*ed[iE].betay*
-                (ed[jE].betax*conj(ed[iE].px[1]*ed[iE].py[2])*ed[jE].px[3]
-                 -(ed[jE].betax+four*ed[jE].betay)*ed[iE].px[1]*ed[jE].px[1]*conj(ed[iE].py[2])
-		 );
-              h20110 += (1./32)*termSign*ii*ed[iE].b3L*ed[jE].b3L*
-                ed[iE].rbetax*ed[jE].rbetax*ed[iE].betay*
-                (ed[jE].betax*(
-			       conj(ed[iE].px[1])*ed[jE].px[3]
-			       - 
-			       ed[iE].px[1]*ed[jE].px[1]
-			       ) 
-                 + two*ed[jE].betay*ed[iE].px[1]*ed[jE].px[1]*ed[iE].py[2]*conj(ed[jE].py[2])
-		 );
-              h20200 += (1./64)*termSign*ii*ed[iE].b3L*ed[jE].b3L*
-                ed[iE].rbetax*ed[jE].rbetax*ed[iE].betay*
-                (ed[jE].betax*
-		 conj(ed[iE].px[1])*ed[jE].px[3]*ed[iE].py[2]
-                 -(ed[jE].betax-four*ed[jE].betay)*
-		 ed[iE].px[1]*ed[jE].px[1]*ed[iE].py[2]
-		 );
-              h00220 += (1./64)*termSign*ii*ed[iE].b3L*ed[jE].b3L*
-                ed[iE].rbetax*ed[jE].rbetax*ed[iE].betay*ed[jE].betay*
-		(ed[iE].px[1]*ed[iE].py[2]*conj(ed[jE].px[1]*ed[jE].py[2])
-                 + four*ed[iE].px[1]*conj(ed[jE].px[1])
-		 - conj(ed[iE].px[1]*ed[jE].py[2])*ed[jE].px[1]*ed[iE].py[2]
-		 );
-              h00310 += (1./32)*termSign*ii*ed[iE].b3L*ed[jE].b3L*
-                ed[iE].rbetax*ed[jE].rbetax*ed[iE].betay*ed[jE].betay*ed[iE].py[2]*
-                (ed[iE].px[1]*conj(ed[jE].px[1])
-		 -conj(ed[iE].px[1])*ed[jE].px[1]
-		 );
-              h00400 += (1./64)*termSign*ii*ed[iE].b3L*ed[jE].b3L*
-                ed[iE].rbetax*ed[jE].rbetax*ed[iE].betay*ed[jE].betay*
-		ed[iE].px[1]*conj(ed[jE].px[1])*ed[iE].py[2]*ed[jE].py[2];
-	    }
-	    }
-    }
-    }
+  if (b3L != 0.0 && (flags & GEOMETRIC1)) {
+    /* first-order geometric terms from sextupoles */
+    /* h21000 */
+    h[H21000] += b3L*ed->rbetax*betax1/8*ed->px[1];
+    /* h30000 */
+    h[H30000] += b3L*ed->rbetax*betax1/24*ed->px[3];
+    /* h10110 */
+    h[H10110] += -b3L*ed->rbetax*betay1/4*ed->px[1];
+    /* h10020 and h10200 */
+    h[H10020] += -b3L*ed->rbetax*betay1/8*ed->px[1]*conj(ed->py[2]);
+    h[H10200] += -b3L*ed->rbetax*betay1/8*ed->px[1]*ed->py[2];
+  }
+  if (b4L != 0.0) {
+    if (flags & TUNESHIFTS) {
+      /* second-order terms from leading order effects of octupoles */
+      /* Ignoring a large number of terms that are not also driven by sextupoles */
+      dnu[DNUX_DJX] += 3*b4L*ed->betax2/(8*PI);
+      dnu[DNUX_DJY] -= 3*b4L*betax1*betay1/(4*PI);
+      dnu[DNUY_DJY] += 3*b4L*ed->betay2/(8*PI);
     }
+    if (flags & GEOMETRIC2) {
+      h[H22000] += 3*b4L*ed->betax2/32;
+      h[H11110] += -3*b4L*betax1*betay1/8;
+      h[H00220] += 3*b4L*ed->betay2/32;
+      h[H31000] += b4L*ed->betax2/16*ed->px[2];
+      h[H40000] += b4L*ed->betax2/64*ed->px[4];
+      h[H20110] += -3*b4L*betax1*betay1/16*ed->px[2];
+      h[H11200] += -3*b4L*betax1*betay1/16*ed->py[2];
+      h[H20020] += -3*b4L*betax1*betay1/32*ed->px[2]*conj(ed->py[2]);
+      h[H20200] += -3*b4L*betax1*betay1/32*ed->px[2]*ed->py[2];
+      h[H00310] += b4L*ed->betay2/16*ed->py[2];
+      h[H00400] += b4L*ed->betay2/64*ed->py[4];
     }
   }
-//	printf("d->dnux_dJx=%f, d->dnux_dJy=%f, d->dnuy_dJy=%f\n",d->dnux_dJx,d->dnux_dJy,d->dnuy_dJy);
-  d->h22000[0] = std::abs<double>(h22000);
-  d->h22000[1] = h22000.real();
-  d->h22000[2] = h22000.imag();
-  d->h11110[0] = std::abs<double>(h11110);
-  d->h11110[1] = h11110.real();
-  d->h11110[2] = h11110.imag();
-  d->h00220[0] = std::abs<double>(h00220);
-  d->h00220[1] = h00220.real();
-  d->h00220[2] = h00220.imag();
-  d->h31000[0] = std::abs<double>(h31000);
-  d->h31000[1] = h31000.real();
-  d->h31000[2] = h31000.imag();
-  d->h40000[0] = std::abs<double>(h40000);
-  d->h40000[1] = h40000.real();
-  d->h40000[2] = h40000.imag();
-  d->h20110[0] = std::abs<double>(h20110);
-  d->h20110[1] = h20110.real();
-  d->h20110[2] = h20110.imag();
-  d->h11200[0] = std::abs<double>(h11200);
-  d->h11200[1] = h11200.real();
-  d->h11200[2] = h11200.imag();
-  d->h20020[0] = std::abs<double>(h20020);
-  d->h20020[1] = h20020.real();
-  d->h20020[2] = h20020.imag();
-  d->h20200[0] = std::abs<double>(h20200);
-  d->h20200[1] = h20200.real();
-  d->h20200[2] = h20200.imag();
-  d->h00310[0] = std::abs<double>(h00310);
-  d->h00310[1] = h00310.real();
-  d->h00310[2] = h00310.imag();
-  d->h00400[0] = std::abs<double>(h00400);
-  d->h00400[1] = h00400.real();
-  d->h00400[2] = h00400.imag();
-
-  if (ed)
-    free(ed);
 }
 
+/* Second-order contribution of a pair of sextupoles. The terms are
+ * proportional to the product of the strengths b3L_i*b3L_j, given as w. */
+static void secondOrderTerms(const ELEMDATA *ei, const ELEMDATA *ej, double w,
+                             const double *tune, int flags, cplx *h, double *dnu)
+{
+  cplx ii(0,1);
+  cplx t1, t2;
+  double two=2, three=3, four=4;
+  double nux = tune[0];
+  double nuy = tune[1];
+  double termSign;
+
+  if (flags & TUNESHIFTS) {
+    double dphix = fabs(ei->phix-ej->phix);
+    double dphiy = fabs(ei->phiy-ej->phiy);
+    dnu[DNUX_DJX] += w/(-16*PI)*pow(ei->betax*ej->betax, 1.5)*
+      (3*cos(dphix-PI*nux)/sin(PI*nux) + cos(3*dphix-3*PI*nux)/sin(3*PI*nux));
+    dnu[DNUX_DJY] += w/(8*PI)*sqrt(ei->betax*ej->betax)*ei->betay*
+      (2*ej->betax*cos(dphix-PI*nux)/sin(PI*nux)
+       - ej->betay*cos(dphix+2*dphiy-PI*(nux+2*nuy))/sin(PI*(nux+2*nuy))
+       + ej->betay*cos(dphix-2*dphiy-PI*(nux-2*nuy))/sin(PI*(nux-2*nuy)));
+    dnu[DNUY_DJY] += w/(-16*PI)*sqrt(ei->betax*ej->betax)*ei->betay*ej->betay*
+      (4*cos(dphix-PI*nux)/sin(PI*nux)
+       + cos(dphix+2*dphiy-PI*(nux+2*nuy))/sin(PI*(nux+2*nuy))
+       + cos(dphix-2*dphiy-PI*(nux-2*nuy))/sin(PI*(nux-2*nuy)));
+  }
+  termSign = SIGN(ei->s - ej->s);
+  if ((flags & GEOMETRIC2) && termSign) {
+    cplx c = termSign*ii*w*ei->rbetax*ej->rbetax;
+    /* geometric terms */
+    h[H22000] += (1./64)*c*ei->betax*ej->betax*
+      (ei->px[3]*conj(ej->px[3]) + three*ei->px[1]*conj(ej->px[1]));
+    h[H31000] += (1./32)*c*ei->betax*ej->betax*
+      ei->px[3]*conj(ej->px[1]);
+    t1 = conj(ei->px[1])*ej->px[1];
+    h[H11110] += (1./16)*c*ei->betay*
+      (ej->betax*(t1 - conj(t1))
+       + ej->betay*ei->py[2]*conj(ej->py[2])*(conj(t1) + t1));
+    t1 = exp(-ii*(ei->phix-ej->phix));
+    t2 = conj(t1);
+    h[H11200] += (1./32)*c*ei->betay*exp(ii*(2*ei->phiy))*
+      (ej->betax*(t1 - t2) + two*ej->betay*(t2 + t1));
+    h[H40000] += (1./64)*c*ei->betax*ej->betax*
+      ei->px[3]*ej->px[1];
+    h[H20020] += (1./64)*c*ei->betay*
+      (ej->betax*conj(ei->px[1]*ei->py[2])*ej->px[3]
+       -(ej->betax+four*ej->betay)*ei->px[1]*ej->px[1]*conj(ei->py[2]));
+    h[H20110] += (1./32)*c*ei->betay*
+      (ej->betax*(conj(ei->px[1])*ej->px[3] - ei->px[1]*ej->px[1])
+       + two*ej->betay*ei->px[1]*ej->px[1]*ei->py[2]*conj(ej->py[2]));
+    h[H20200] += (1./64)*c*ei->betay*
+      (ej->betax*conj(ei->px[1])*ej->px[3]*ei->py[2]
+       -(ej->betax-four*ej->betay)*ei->px[1]*ej->px[1]*ei->py[2]);
+    h[H00220] += (1./64)*c*ei->betay*ej->betay*
+      (ei->px[1]*ei->py[2]*conj(ej->px[1]*ej->py[2])
+       + four*ei->px[1]*conj(ej->px[1])
+       - conj(ei->px[1]*ej->py[2])*ej->px[1]*ei->py[2]);
+    h[H00310] += (1./32)*c*ei->betay*ej->betay*ei->py[2]*
+      (ei->px[1]*conj(ej->px[1]) - conj(ei->px[1])*ej->px[1]);
+    h[H00400] += (1./64)*c*ei->betay*ej->betay*
+      ei->px[1]*conj(ej->px[1])*ei->py[2]*ej->py[2];
+  }
+}
+
+/* Based on J. Bengtsson, SLS Note 9/97, March 7, 1997, with corrections per W. Guo (NSLS) */
+/* Revised to follow C. X. Wang AOP-TN-2009-020 for second-order terms */
+/* str holds the active strengths {a2L, b2L, b3L, b4L} of each element */
+static void computeDrivingTerms(int NumElem, const ELEMDATA *ed, const double *str,
+                                const double *tune, int flags, cplx *h, double *dnu)
+{
+  int iE;
 
+  for (iE=0; iE<NTERMS; iE++) h[iE] = 0.0;
+  for (iE=0; iE<NSHIFTS; iE++) dnu[iE] = 0.0;
 
+  for (iE=0; iE<NumElem; iE++)
+    firstOrderTerms(ed+iE, str+NSTRENGTHS*iE, flags, h, dnu);
 
+  if (flags & (GEOMETRIC2|TUNESHIFTS)) {
+    /* compute sextupole contributions to second-order terms */
+    std::vector<int> sext;
+    for (iE=0; iE<NumElem; iE++)
+      if (str[NSTRENGTHS*iE+B3L] != 0.0) sext.push_back(iE);
+    for (size_t i=0; i<sext.size(); i++) {
+      const double b3i = str[NSTRENGTHS*sext[i]+B3L];
+      for (size_t j=0; j<sext.size(); j++) {
+        const double b3j = str[NSTRENGTHS*sext[j]+B3L];
+        secondOrderTerms(ed+sext[i], ed+sext[j], b3i*b3j, tune, flags, h, dnu);
+      }
+    }
+  }
+}
+
+#if !defined(PYAT)
 
+/* The gateway function */
 void mexFunction( int nlhs, mxArray *plhs[],
                   int nrhs, const mxArray *prhs[] )
 {
     double *outMatrixRe;		/* output matrix Real part of hamiltonian driving terms */
     double *outMatrixIm;		/* output matrix Imaginary part of hamiltonian driving terms */
     double *outMatrixTSwA;		/* output matrix Tune Shifts with Amplitude */
-	DRIVING_TERMS *d;			/* output struct, to be converted in arrays */
 	double *s;
 	double *betax;
     double *betay;
@@ -455,15 +294,12 @@ void mexFunction( int nlhs, mxArray *plhs[],
     double *Listb2L;
     double *Listb3L;
     double *Listb4L;
-    int leading_order_driving_terms_only;
-	double Tunex;
-	double Tuney;
 	double tune[2];
-	int nPeriods = 1;
-	int NumElem, ncols;
-	char Geometric1, Geometric2, Chromatic1, Coupling1, TuneShifts;	/*boolean values, taken as input*/
-	
-	d = (DRIVING_TERMS*)malloc(sizeof(DRIVING_TERMS));
+	int NumElem, nE, i;
+	int flags = 0;
+	cplx h[NTERMS];
+	double dnu[NSHIFTS];
+
     /* check for proper number of arguments */
     if(nrhs!=18) {
         mexErrMsgIdAndTxt("MyToolbox:RDTelegantAT:nrhs","18 inputs required.");
@@ -471,26 +307,17 @@ void mexFunction( int nlhs, mxArray *plhs[],
     if(nlhs!=3) {
         mexErrMsgIdAndTxt("MyToolbox:RDTelegantAT:nlhs","3 outputs required.");
     }
-	
-//	printf("entered\n");
-	
-	/* the number of rows of all the inputs must be 1 and the number of columns NumElem, i.e. the 13th input element */
-    ncols = mxGetN(prhs[0]);
-    
-    /* get the value of the 4 scalar inputs: 11,12,13,14 (Tunex, Tuney, NumElem,leading_order_driving_terms_only)  */
-    Tunex = mxGetScalar(prhs[10]);
-    Tuney = mxGetScalar(prhs[11]);
+
+    /* get the value of the scalar inputs: Tunex, Tuney, NumElem and the selected terms */
+	tune[0] = mxGetScalar(prhs[10]);
+	tune[1] = mxGetScalar(prhs[11]);
     NumElem = mxGetScalar(prhs[12]);
-    //leading_order_driving_terms_only=mxGetScalar(prhs[13]);
-    Geometric1 = mxGetScalar(prhs[13]);
-    Geometric2 = mxGetScalar(prhs[14]);
-    Chromatic1 = mxGetScalar(prhs[15]);
-    Coupling1 = mxGetScalar(prhs[16]);
-    TuneShifts = mxGetScalar(prhs[17]);
-    
-	tune[0]=Tunex;
-	tune[1]=Tuney;
-		
+    if (mxGetScalar(prhs[13])) flags |= CHROMATIC1;
+    if (mxGetScalar(prhs[14])) flags |= COUPLING1;
+    if (mxGetScalar(prhs[15])) flags |= GEOMETRIC1;
+    if (mxGetScalar(prhs[16])) flags |= GEOMETRIC2;
+    if (mxGetScalar(prhs[17])) flags |= TUNESHIFTS;
+
     /* create a pointer to the real data in the input matrix  */
     s = mxGetDoubles(prhs[0]);
     betax = mxGetDoubles(prhs[1]);
@@ -502,167 +329,331 @@ void mexFunction( int nlhs, mxArray *plhs[],
     Listb2L = mxGetDoubles(prhs[7]);
     Listb3L = mxGetDoubles(prhs[8]);
     Listb4L = mxGetDoubles(prhs[9]);
-	
-	//printf("s0=%f, s1=%f, s2=%f \n",s[0],s[1],s[2]);	
-	//printf("NumElem=%d\n",NumElem);
-    /* get dimensions of the input matrix */
-    ncols = mxGetN(prhs[0]);
 
-    /* create the output matrix */
-    plhs[0] = mxCreateDoubleMatrix(1,(mwSize)23,mxREAL);
-    plhs[1] = mxCreateDoubleMatrix(1,(mwSize)23,mxREAL);
-    plhs[2] = mxCreateDoubleMatrix(1,(mwSize)3,mxREAL);
-	plhs[3] = mxCreateDoubleMatrix(1,(mwSize)15,mxREAL);
-    plhs[4] = mxCreateDoubleMatrix(1,(mwSize)15,mxREAL);
-    
+    std::vector<ELEMDATA> ed(NumElem);
+    std::vector<double> str(NSTRENGTHS*NumElem);
+    for (nE=0; nE<NumElem; nE++) {
+        setElemData(&ed[nE], s[nE], betax[nE], betay[nE], etax[nE], phix[nE], phiy[nE]);
+        str[NSTRENGTHS*nE+A2L] = active(Lista2L[nE]);
+        str[NSTRENGTHS*nE+B2L] = active(Listb2L[nE]);
+        str[NSTRENGTHS*nE+B3L] = active(Listb3L[nE]);
+        str[NSTRENGTHS*nE+B4L] = active(Listb4L[nE]);
+    }
+
     /* call the computational routine */
-    computeDrivingTerms(d, NumElem,
-							s, betax, betay, phix, phiy, etax,
-							Lista2L, Listb2L, Listb3L, Listb4L, tune, 
-							Geometric1, Geometric2, Chromatic1, Coupling1, TuneShifts, nPeriods);
+    computeDrivingTerms(NumElem, ed.data(), str.data(), tune, flags, h, dnu);
 
+    /* create the output matrix */
+    plhs[0] = mxCreateDoubleMatrix(1,(mwSize)NTERMS,mxREAL);
+    plhs[1] = mxCreateDoubleMatrix(1,(mwSize)NTERMS,mxREAL);
+    plhs[2] = mxCreateDoubleMatrix(1,(mwSize)NSHIFTS,mxREAL);
 	outMatrixRe = mxGetDoubles(plhs[0]);
 	outMatrixIm = mxGetDoubles(plhs[1]);
 	outMatrixTSwA = mxGetDoubles(plhs[2]);
-	/* Compute the resonance driving terms from the hamiltonian driving terms */
-	
-	    
-	/* put the output d in the vectors outMatrixRe, outMatrixIm and outMatrixTSwA that will be sent to matlab */
-	/* First-order geometric terms (real, imag) */
-	outMatrixRe[0] = d->h21000[1];
-	outMatrixIm[0] = d->h21000[2];
-	outMatrixRe[1] = d->h30000[1];
-	outMatrixIm[1] = d->h30000[2];
-	outMatrixRe[2] = d->h10110[1];
-	outMatrixIm[2] = d->h10110[2];
-	outMatrixRe[3] = d->h10020[1];
-	outMatrixIm[3] = d->h10020[2];
-	outMatrixRe[4] = d->h10200[1];
-	outMatrixIm[4] = d->h10200[2];
-	/* First order chromatic terms */
-	outMatrixRe[5] = d->h11001[1];
-	outMatrixIm[5] = d->h11001[2];
-	outMatrixRe[6] = d->h00111[1];
-	outMatrixIm[6] = d->h00111[2];
-	outMatrixRe[7] = d->h20001[1];
-	outMatrixIm[7] = d->h20001[2];
-	outMatrixRe[8] = d->h00201[1];
-	outMatrixIm[8] = d->h00201[2];
-	outMatrixRe[9] = d->h10002[1];
-	outMatrixIm[9] = d->h10002[2];
-	/* First order coupling terms */	
-	outMatrixRe[10] = d->h10010[1];
-	outMatrixIm[10] = d->h10010[2];
-	outMatrixRe[11] = d->h10100[1];
-	outMatrixIm[11] = d->h10100[2];
-	/* Second-order geometric terms */
-	outMatrixRe[12] = d->h22000[1];
-	outMatrixIm[12] = d->h22000[2];
-	outMatrixRe[13] = d->h11110[1];
-	outMatrixIm[13] = d->h11110[2];
-	outMatrixRe[14] = d->h00220[1];
-	outMatrixIm[14] = d->h00220[2];
-	outMatrixRe[15] = d->h31000[1];
-	outMatrixIm[15] = d->h31000[2];
-	outMatrixRe[16] = d->h40000[1];
-	outMatrixIm[16] = d->h40000[2];
-	outMatrixRe[17] = d->h20110[1];
-	outMatrixIm[17] = d->h20110[2];
-	outMatrixRe[18] = d->h11200[1];
-	outMatrixIm[18] = d->h11200[2];	
-	outMatrixRe[19] = d->h20020[1];
-	outMatrixIm[19] = d->h20020[2];	
-	outMatrixRe[20] = d->h20200[1];
-	outMatrixIm[20] = d->h20200[2];
-	outMatrixRe[21] = d->h00310[1];
-	outMatrixIm[21] = d->h00310[2];
-	outMatrixRe[22] = d->h00400[1];
-	outMatrixIm[22] = d->h00400[2];
-	/* tune shifts with amplitude */
-	outMatrixTSwA[0] = d->dnux_dJx;
-	outMatrixTSwA[1] = d->dnux_dJy;
-	outMatrixTSwA[2] = d->dnuy_dJy;
-
-
-
-
-/*	outMatrix[0] = d->h21000[0];
-	outMatrix[1] = d->h21000[1];
-	outMatrix[2] = d->h21000[2];
-	outMatrix[3] = d->h30000[0];
-	outMatrix[4] = d->h30000[1];
-	outMatrix[5] = d->h30000[2];
-	outMatrix[6] = d->h10110[0];
-	outMatrix[7] = d->h10110[1];
-	outMatrix[8] = d->h10110[2];
-	outMatrix[9] = d->h10020[0];
-	outMatrix[10] = d->h10020[1];
-	outMatrix[11] = d->h10020[2];
-	outMatrix[12] = d->h10200[0];
-	outMatrix[13] = d->h10200[1];
-	outMatrix[14] = d->h10200[2];*/
-
-/*	outMatrix[15] = d->h11001[0];
-	outMatrix[16] = d->h11001[1];
-	outMatrix[17] = d->h11001[2];
-	outMatrix[18] = d->h00111[0];
-	outMatrix[19] = d->h00111[1];
-	outMatrix[20] = d->h00111[2];
-	outMatrix[21] = d->h20001[0];
-	outMatrix[22] = d->h20001[1];
-	outMatrix[23] = d->h20001[2];
-	outMatrix[24] = d->h00201[0];
-	outMatrix[25] = d->h00201[1];
-	outMatrix[26] = d->h00201[2];
-	outMatrix[27] = d->h10002[0];
-	outMatrix[28] = d->h10002[1];
-	outMatrix[29] = d->h10002[2];*/
-
-/*	outMatrix[30] = d->h10010[0];
-	outMatrix[31] = d->h10010[1];
-	outMatrix[32] = d->h10010[2];
-	outMatrix[33] = d->h10100[0];
-	outMatrix[34] = d->h10100[1];
-	outMatrix[35] = d->h10100[2];*/
-	
-/*	outMatrix[36] = d->h22000[0];
-	outMatrix[37] = d->h22000[1];
-	outMatrix[38] = d->h22000[2];
-	outMatrix[39] = d->h11110[0];
-	outMatrix[40] = d->h11110[1];
-	outMatrix[41] = d->h11110[2];
-	outMatrix[42] = d->h00220[0];
-	outMatrix[43] = d->h00220[1];
-	outMatrix[44] = d->h00220[2];
-	outMatrix[45] = d->h31000[0];
-	outMatrix[46] = d->h31000[1];
-	outMatrix[47] = d->h31000[2];
-	outMatrix[48] = d->h40000[0];
-	outMatrix[49] = d->h40000[1];
-	outMatrix[50] = d->h40000[2];
-	outMatrix[51] = d->h20110[0];
-	outMatrix[52] = d->h20110[1];
-	outMatrix[53] = d->h20110[2];
-	outMatrix[54] = d->h11200[0];
-	outMatrix[55] = d->h11200[1];
-	outMatrix[56] = d->h11200[2];
-	outMatrix[57] = d->h20020[0];
-	outMatrix[58] = d->h20020[1];
-	outMatrix[59] = d->h20020[2];
-	outMatrix[60] = d->h20200[0];
-	outMatrix[61] = d->h20200[1];
-	outMatrix[62] = d->h20200[2];
-	outMatrix[63] = d->h00310[0];
-	outMatrix[64] = d->h00310[1];
-	outMatrix[65] = d->h00310[2];
-    outMatrix[66] = d->h00400[0];
-	outMatrix[67] = d->h00400[1];
-	outMatrix[68] = d->h00400[2];*/
-	
-	
+
+	/* First-order geometric terms, first order chromatic terms,
+	 * first order coupling terms, second-order geometric terms (real, imag) */
+	for (i=0; i<NTERMS; i++) {
+	    outMatrixRe[i] = h[i].real();
+	    outMatrixIm[i] = h[i].imag();
+	}
 	/* tune shifts with amplitude */
-/*	outMatrix[69] = d->dnux_dJx;
-	outMatrix[70] = d->dnux_dJy;
-	outMatrix[71] = d->dnuy_dJy;*/
+	for (i=0; i<NSHIFTS; i++)
+	    outMatrixTSwA[i] = dnu[i];
+}
+
+#else /* PYAT */
+
+#define MODULE_NAME rdtlib
+#define MODULE_DESCR "Resonance driving terms"
+
+/* Check the type and shape of an input array. A negative dimension is not checked */
+static int checkArray(PyArrayObject *array, const char *name, int type,
+                      int ndim, npy_intp dim0, npy_intp dim1)
+{
+    if (PyArray_TYPE(array) != type) {
+        PyErr_Format(PyExc_ValueError, "%s has the wrong type", name);
+        return 0;
+    }
+    if ((PyArray_FLAGS(array) & NPY_ARRAY_CARRAY_RO) != NPY_ARRAY_CARRAY_RO) {
+        PyErr_Format(PyExc_ValueError, "%s is not C-aligned", name);
+        return 0;
+    }
+    if ((PyArray_NDIM(array) != ndim) ||
+        ((dim0 >= 0) && (PyArray_DIM(array, 0) != dim0)) ||
+        ((ndim > 1) && (dim1 >= 0) && (PyArray_DIM(array, 1) != dim1))) {
+        PyErr_Format(PyExc_ValueError, "%s has the wrong shape", name);
+        return 0;
+    }
+    return 1;
+}
+
+/* Set the element data as seen from an observation point: elements upstream
+ * of the observation point are moved to the end of the ring. If which is
+ * not NULL, only the nwhich listed elements are set */
+static void rotateElemData(int NumElem, ELEMDATA *ed, const double *elemdata,
+                           npy_intp first, const double *ref,
+                           const double *tune, double circumference,
+                           int nwhich=0, const npy_intp *which=NULL)
+{
+    int nset = which ? nwhich : NumElem;
+    for (int k=0; k<nset; k++) {
+        npy_intp nE = which ? which[k] : k;
+        const double *e = elemdata+6*nE;
+        double ds = -ref[0], dphix = -ref[1], dphiy = -ref[2];
+        if (nE < first) {
+            ds += circumference;
+            dphix += PIx2*tune[0];
+            dphiy += PIx2*tune[1];
+        }
+        setElemData(ed+nE, e[0]+ds, e[1], e[2], e[3], e[4]+dphix, e[5]+dphiy);
+    }
+}
+
+static void activeStrengths(int NumElem, const double *strengths, double *str)
+{
+    for (int k=0; k<NSTRENGTHS*NumElem; k++) str[k] = active(strengths[k]);
+}
+
+/* Add to h and dnu the variation of the driving terms when the strengths of
+ * the elements listed in changed go from str0 to str1 */
+static void updateDrivingTerms(int NumElem, const ELEMDATA *ed,
+                               const double *str0, const double *str1,
+                               int nchanged, const npy_intp *changed,
+                               const double *tune, int flags, cplx *h, double *dnu)
+{
+  int k, jE;
+
+  for (k=0; k<nchanged; k++) {
+    npy_intp iE = changed[k];
+    double dstr[NSTRENGTHS];
+    for (jE=0; jE<NSTRENGTHS; jE++)
+      dstr[jE] = str1[NSTRENGTHS*iE+jE] - str0[NSTRENGTHS*iE+jE];
+    firstOrderTerms(ed+iE, dstr, flags, h, dnu);
+  }
+
+  if (flags & (GEOMETRIC2|TUNESHIFTS)) {
+    /* b1_i*b1_j - b0_i*b0_j = db_i*b1_j + b0_i*db_j */
+    for (k=0; k<nchanged; k++) {
+      npy_intp iE = changed[k];
+      double db3 = str1[NSTRENGTHS*iE+B3L] - str0[NSTRENGTHS*iE+B3L];
+      if (db3 == 0.0) continue;
+      for (jE=0; jE<NumElem; jE++) {
+        double b31 = str1[NSTRENGTHS*jE+B3L];
+        double b30 = str0[NSTRENGTHS*jE+B3L];
+        if (b31 != 0.0)
+          secondOrderTerms(ed+iE, ed+jE, db3*b31, tune, flags, h, dnu);
+        if (b30 != 0.0)
+          secondOrderTerms(ed+jE, ed+iE, b30*db3, tune, flags, h, dnu);
+      }
+    }
+  }
+}
+
+static PyObject *drivingterms(PyObject *self, PyObject *args)
+{
+    PyArrayObject *pyelem, *pystr, *pyfirst, *pyref, *pytune;
+    PyObject *pyh, *pydnu;
+    double circumference;
+    int flags;
+    npy_intp dims[2];
+
+    if (!PyArg_ParseTuple(args, "O!O!O!O!O!di",
+        &PyArray_Type, &pyelem, &PyArray_Type, &pystr, &PyArray_Type, &pyfirst,
+        &PyArray_Type, &pyref, &PyArray_Type, &pytune, &circumference, &flags)) {
+        return NULL;
+    }
+    if (!checkArray(pyelem, "elemdata", NPY_DOUBLE, 2, -1, 6)) return NULL;
+    int nelem = PyArray_DIM(pyelem, 0);
+    if (!checkArray(pystr, "strengths", NPY_DOUBLE, 2, nelem, NSTRENGTHS)) return NULL;
+    if (!checkArray(pyfirst, "first", NPY_INTP, 1, -1, -1)) return NULL;
+    npy_intp nrefs = PyArray_DIM(pyfirst, 0);
+    if (!checkArray(pyref, "refdata", NPY_DOUBLE, 2, nrefs, 3)) return NULL;
+    if (!checkArray(pytune, "tune", NPY_DOUBLE, 1, 2, -1)) return NULL;
+
+    dims[0] = nrefs;
+    dims[1] = NTERMS;
+    pyh = PyArray_ZEROS(2, dims, NPY_CDOUBLE, 0);
+    dims[0] = NSHIFTS;
+    pydnu = PyArray_ZEROS(1, dims, NPY_DOUBLE, 0);
+    if (!(pyh && pydnu)) {
+        Py_XDECREF(pyh);
+        Py_XDECREF(pydnu);
+        return NULL;
+    }
+    const double *elemdata = (const double *)PyArray_DATA(pyelem);
+    const npy_intp *first = (const npy_intp *)PyArray_DATA(pyfirst);
+    const double *refdata = (const double *)PyArray_DATA(pyref);
+    const double *tune = (const double *)PyArray_DATA(pytune);
+    cplx *h = (cplx *)PyArray_DATA((PyArrayObject *)pyh);
+    double *dnu = (double *)PyArray_DATA((PyArrayObject *)pydnu);
+    std::vector<double> str(NSTRENGTHS*nelem);
+    activeStrengths(nelem, (const double *)PyArray_DATA(pystr), str.data());
+
+    Py_BEGIN_ALLOW_THREADS
+    /* Tune shifts do not depend on the observation point */
+    if (flags & TUNESHIFTS) {
+        std::vector<ELEMDATA> ed(nelem);
+        cplx hdummy[NTERMS];
+        double zero[3] = {0.0, 0.0, 0.0};
+        rotateElemData(nelem, ed.data(), elemdata, 0, zero, tune, circumference);
+        computeDrivingTerms(nelem, ed.data(), str.data(), tune, TUNESHIFTS, hdummy, dnu);
+    }
+    #pragma omp parallel
+    {
+        std::vector<ELEMDATA> ed(nelem);
+        double dnudummy[NSHIFTS];
+        npy_intp ir;
+        #pragma omp for schedule(dynamic)
+        for (ir=0; ir<nrefs; ir++) {
+            rotateElemData(nelem, ed.data(), elemdata, first[ir], refdata+3*ir, tune, circumference);
+            computeDrivingTerms(nelem, ed.data(), str.data(), tune, flags & ~TUNESHIFTS,
+                                h+NTERMS*ir, dnudummy);
+        }
+    }
+    Py_END_ALLOW_THREADS
+
+    return Py_BuildValue("NN", pyh, pydnu);
+}
+
+static PyObject *update(PyObject *self, PyObject *args)
+{
+    PyArrayObject *pyelem, *pystr0, *pystr1, *pychanged, *pyfirst, *pyref, *pytune;
+    PyArrayObject *pyh, *pydnu;
+    double circumference;
+    int flags;
+
+    if (!PyArg_ParseTuple(args, "O!O!O!O!O!O!O!diO!O!",
+        &PyArray_Type, &pyelem, &PyArray_Type, &pystr0, &PyArray_Type, &pystr1,
+        &PyArray_Type, &pychanged, &PyArray_Type, &pyfirst, &PyArray_Type, &pyref,
+        &PyArray_Type, &pytune, &circumference, &flags,
+        &PyArray_Type, &pyh, &PyArray_Type, &pydnu)) {
+        return NULL;
+    }
+    if (!checkArray(pyelem, "elemdata", NPY_DOUBLE, 2, -1, 6)) return NULL;
+    int nelem = PyArray_DIM(pyelem, 0);
+    if (!checkArray(pystr0, "old_strengths", NPY_DOUBLE, 2, nelem, NSTRENGTHS)) return NULL;
+    if (!checkArray(pystr1, "new_strengths", NPY_DOUBLE, 2, nelem, NSTRENGTHS)) return NULL;
+    if (!checkArray(pychanged, "changed", NPY_INTP, 1, -1, -1)) return NULL;
+    int nchanged = PyArray_DIM(pychanged, 0);
+    if (!checkArray(pyfirst, "first", NPY_INTP, 1, -1, -1)) return NULL;
+    npy_intp nrefs = PyArray_DIM(pyfirst, 0);
+    if (!checkArray(pyref, "refdata", NPY_DOUBLE, 2, nrefs, 3)) return NULL;
+    if (!checkArray(pytune, "tune", NPY_DOUBLE, 1, 2, -1)) return NULL;
+    if (!checkArray(pyh, "rdts", NPY_CDOUBLE, 2, nrefs, NTERMS)) return NULL;
+    if (!checkArray(pydnu, "tuneshifts", NPY_DOUBLE, 1, NSHIFTS, -1)) return NULL;
+    if (!(PyArray_FLAGS(pyh) & PyArray_FLAGS(pydnu) & NPY_ARRAY_WRITEABLE)) {
+        PyErr_SetString(PyExc_ValueError, "output arrays are not writeable");
+        return NULL;
+    }
+
+    const double *elemdata = (const double *)PyArray_DATA(pyelem);
+    const npy_intp *changed = (const npy_intp *)PyArray_DATA(pychanged);
+    const npy_intp *first = (const npy_intp *)PyArray_DATA(pyfirst);
+    const double *refdata = (const double *)PyArray_DATA(pyref);
+    const double *tune = (const double *)PyArray_DATA(pytune);
+    cplx *h = (cplx *)PyArray_DATA(pyh);
+    double *dnu = (double *)PyArray_DATA(pydnu);
+    for (int k=0; k<nchanged; k++) {
+        if (changed[k] < 0 || changed[k] >= nelem) {
+            PyErr_SetString(PyExc_IndexError, "changed element out of range");
+            return NULL;
+        }
+    }
+    std::vector<double> str0(NSTRENGTHS*nelem);
+    std::vector<double> str1(NSTRENGTHS*nelem);
+    activeStrengths(nelem, (const double *)PyArray_DATA(pystr0), str0.data());
+    activeStrengths(nelem, (const double *)PyArray_DATA(pystr1), str1.data());
+    /* Only the modified magnets and the sextupoles contribute to the variation */
+    std::vector<char> isneeded(nelem, 0);
+    std::vector<npy_intp> needed;
+    for (int k=0; k<nchanged; k++) isneeded[changed[k]] = 1;
+    for (int k=0; k<nelem; k++) {
+        if (isneeded[k] || str0[NSTRENGTHS*k+B3L] != 0.0 || str1[NSTRENGTHS*k+B3L] != 0.0)
+            needed.push_back(k);
+    }
+    int nneeded = needed.size();
+
+    Py_BEGIN_ALLOW_THREADS
+    if (flags & TUNESHIFTS) {
+        std::vector<ELEMDATA> ed(nelem);
+        cplx hdummy[NTERMS];
+        double zero[3] = {0.0, 0.0, 0.0};
+        rotateElemData(nelem, ed.data(), elemdata, 0, zero, tune, circumference,
+                       nneeded, needed.data());
+        updateDrivingTerms(nelem, ed.data(), str0.data(), str1.data(), nchanged, changed,
+                           tune, TUNESHIFTS, hdummy, dnu);
+    }
+    #pragma omp parallel
+    {
+        std::vector<ELEMDATA> ed(nelem);
+        double dnudummy[NSHIFTS];
+        npy_intp ir;
+        #pragma omp for schedule(dynamic)
+        for (ir=0; ir<nrefs; ir++) {
+            rotateElemData(nelem, ed.data(), elemdata, first[ir], refdata+3*ir, tune,
+                           circumference, nneeded, needed.data());
+            updateDrivingTerms(nelem, ed.data(), str0.data(), str1.data(), nchanged, changed,
+                               tune, flags & ~TUNESHIFTS, h+NTERMS*ir, dnudummy);
+        }
+    }
+    Py_END_ALLOW_THREADS
+
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef AtMethods[] = {
+    {"drivingterms", (PyCFunction)drivingterms, METH_VARARGS,
+    PyDoc_STR(
+    "drivingterms(elemdata, strengths, first, refdata, tune, circumference, flags)\n\n"
+    "Compute the hamiltonian driving terms at several observation points\n\n"
+    "The observation points are processed in parallel when OpenMP is enabled.\n\n"
+    "Args:\n"
+    "    elemdata:      (nelem, 6) array of [s, betax, betay, etax, phix, phiy]\n"
+    "      for each magnet\n"
+    "    strengths:     (nelem, 4) array of [a2L, b2L, b3L, b4L] for each magnet\n"
+    "    first:         (nrefs,) index of the first magnet downstream of each\n"
+    "      observation point\n"
+    "    refdata:       (nrefs, 3) array of [s, phix, phiy] at each observation point\n"
+    "    tune:          (2,) total tunes\n"
+    "    circumference: ring circumference\n"
+    "    flags:         selected terms: 1: chromatic, 2: coupling, 4: geometric1,\n"
+    "      8: geometric2, 16: tune shifts\n\n"
+    "Returns:\n"
+    "    h:             (nrefs, 23) complex driving terms\n"
+    "    tuneshifts:    (3,) [dnux/dJx, dnux/dJy, dnuy/dJy]\n"
+    )},
+    {"update", (PyCFunction)update, METH_VARARGS,
+    PyDoc_STR(
+    "update(elemdata, old_strengths, new_strengths, changed, first, refdata, tune,\n"
+    "       circumference, flags, h, tuneshifts)\n\n"
+    "Update in place the driving terms h and tuneshifts computed by\n"
+    ":py:func:`drivingterms` for a change of the strengths of the magnets\n"
+    "listed in changed. The computation time is proportional to the number of\n"
+    "changed magnets.\n\n"
+    "The linear optics in elemdata is assumed to be unchanged, so only b3L and\n"
+    "b4L variations give exact results.\n"
+    )},
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+PyMODINIT_FUNC MOD_INIT(MODULE_NAME)
+{
+    static struct PyModuleDef moduledef = {
+    PyModuleDef_HEAD_INIT,
+    STR(MODULE_NAME), /* m_name */
+    PyDoc_STR(MODULE_DESCR),      /* m_doc */
+    -1,           /* m_size */
+    AtMethods,    /* m_methods */
+    NULL,         /* m_reload */
+    NULL,         /* m_traverse */
+    NULL,         /* m_clear */
+    NULL,         /* m_free */
+    };
+    PyObject *m = PyModule_Create(&moduledef);
+    if (m == NULL) return MOD_ERROR_VAL;
+    import_array();
+    return MOD_SUCCESS_VAL(m);
+}
 
-}                                    
+#endif /* PYAT */
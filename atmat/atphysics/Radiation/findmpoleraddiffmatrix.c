@@ -527,7 +527,9 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
 }
 #endif /*MATLAB_MEX_FILE*/
 
-#if defined(PYAT)
+/* DIFFMATRIX_KERNEL: include only the computation kernels, for use in
+   another extension module */
+#if defined(PYAT) && !defined(DIFFMATRIX_KERNEL)
 
 #define MODULE_NAME diffmatrix
 #define MODULE_DESCR "Computation of the radiation diffusion matrix"
@@ -619,4 +621,4 @@ PyMODINIT_FUNC MOD_INIT(MODULE_NAME)
     return MOD_SUCCESS_VAL(m);
 }
 
-#endif /*PYAT*/
+#endif /*PYAT && !DIFFMATRIX_KERNEL*/
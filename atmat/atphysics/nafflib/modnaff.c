@@ -27,7 +27,7 @@
 #include "complexe.h"
 
 /*variable globale de naf */
-t_naf g_NAFVariable;
+NAF_THREAD_LOCAL t_naf g_NAFVariable;
 
 /*legere difference entre NAF_USE_OPTIMIZE=0 et NAF_USE_OPTIMIZE=1*/
 /* car division differente dans naf_gramsc */
@@ -169,8 +169,8 @@ t_naf g_NAFVariable;
 !  ZALP(NBTERM,NBTERM) : TABLEAU DE CHANGEMENT DE BASE
 !
 !-----------------------------------------------------------------------*/
-static double AF,BF;
-static double *TWIN=NULL;
+static NAF_THREAD_LOCAL double AF,BF;
+static NAF_THREAD_LOCAL double *TWIN=NULL;
 
 /*!-----------------------------------------------------------------------	  
 ! VARIABLES A INITIALISER PAR L'UTILISATEUR AVANT DE LANCER INITNAF
@@ -1313,7 +1313,10 @@ void naf_modfre(int NUMFR, double *A, double *B)
       ZI = cmplx(0.E0,1.E0);
       ZOM=muldoublcomplexe(g_NAFVariable.TFS[NUMFR]/g_NAFVariable.UNIANG,ZI); /*ZOM=g_NAFVariable.TFS[NUMFR]/g_NAFVariable.UNIANG*ZI*/
       ZA=cmplx(*A,*B);
-      fprintf(g_NAFVariable.NFPRT,"CORRECTION DE  IFR = %d AMPLITUDE  = %g",NUMFR, module(ZA));
+      if (g_NAFVariable.IPRT==1)
+      {
+        fprintf(g_NAFVariable.NFPRT,"CORRECTION DE  IFR = %d AMPLITUDE  = %g",NUMFR, module(ZA));
+      }
 /*!-----------! L' AMPLITUDES DU TERMES EST CORRIGEES
 !-----------! ATTENTION ICI (CAS REEL) ON AURA AUSSI LE TERME CONJUGUE
 !-----------! QU'ON NE CALCULE PAS. LE TERME TOTAL EST
@@ -1371,7 +1374,10 @@ void naf_modfre(int NUMFR, double *A, double *B)
       i_compl_cmplx(&ZI,0.E0,1.E0);
       ZOM=i_compl_muldoubl(g_NAFVariable.TFS[NUMFR]/g_NAFVariable.UNIANG,ZI); /*ZOM=g_NAFVariable.TFS[NUMFR]/g_NAFVariable.UNIANG*ZI*/
       i_compl_cmplx(&ZA,*A,*B);
-      fprintf(g_NAFVariable.NFPRT,"CORRECTION DE  IFR = %d AMPLITUDE  = %g",NUMFR, i_compl_module(ZA));
+      if (g_NAFVariable.IPRT==1)
+      {
+        fprintf(g_NAFVariable.NFPRT,"CORRECTION DE  IFR = %d AMPLITUDE  = %g",NUMFR, i_compl_module(ZA));
+      }
 /*!-----------! L' AMPLITUDES DU TERMES EST CORRIGEES
 !-----------! ATTENTION ICI (CAS REEL) ON AURA AUSSI LE TERME CONJUGUE
 !-----------! QU'ON NE CALCULE PAS. LE TERME TOTAL EST
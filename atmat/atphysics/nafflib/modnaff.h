@@ -3,6 +3,9 @@
 #define _USE_MATH_DEFINES	/* For Visual Studio */
 #include <math.h>
 #include <float.h>
+#ifndef M_PI                /* Not defined by strict ISO C */
+#define M_PI 3.14159265358979323846
+#endif
 
 /*--------*/
 /* define */
@@ -104,7 +107,18 @@ typedef struct stnaf t_naf;
 /*-----------------*/
 /*variable globale */
 /*-----------------*/
-extern t_naf g_NAFVariable;
+/* With OpenMP, the NAFF state is thread-local so that several signals
+ * can be analysed concurrently */
+#ifndef NAF_THREAD_LOCAL
+#if defined(_OPENMP) && defined(_MSC_VER)
+#define NAF_THREAD_LOCAL __declspec(thread)
+#elif defined(_OPENMP)
+#define NAF_THREAD_LOCAL __thread
+#else
+#define NAF_THREAD_LOCAL
+#endif
+#endif
+extern NAF_THREAD_LOCAL t_naf g_NAFVariable;
 extern double pi;
 
 
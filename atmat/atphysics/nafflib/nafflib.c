@@ -8,20 +8,27 @@
  * known NAFF bugs: data length has to be at least 64
  */
 
+#if defined(PYAT)
+#include "atcommon.h"
+#endif
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#if !defined(PYAT)
 #include "mex.h"
 #ifndef OCTAVE
 #include "matrix.h"
 #endif
+#else
+#define mexPrintf printf
+#endif
 /* #include "gpfunc.h" */
 #include "modnaff.h"
 #include "complexe.h"
 /* #include <sys/ddi.h> */
 
 /* Get ready for R2018a C matrix API */
-#ifndef mxGetDoubles
+#if !defined(PYAT) && !defined(mxGetDoubles)
 #define mxGetDoubles mxGetPr
 #define mxSetDoubles mxSetPr
 typedef double mxDouble;
@@ -39,12 +46,15 @@ typedef double mxDouble;
 #define	AMPLITUDE_OUT plhs[1]
 #define	PHASE_OUT plhs[2]
 
-unsigned int call_naff(double *ydata, double *ypdata, int ndata, double  *nu_out,
-double *amplitude_out, double *phase_out, int win, int nfreq, int debug)
+/* ydata and ypdata are read with a stride of "stride" doubles, so that
+ * interleaved complex data can be analysed in place. A NULL ypdata
+ * stands for a real signal */
+unsigned int call_naff(const double *ydata, const double *ypdata, int stride, int ndata,
+double *nu_out, double *amplitude_out, double *phase_out, int win, int nfreq, int debug)
 {
-    int i, iCpt;
-    unsigned int numfreq;
-    double *d_in, *d_out;
+    int i;
+    unsigned int iCpt, numfreq;
+    double *d_in;
     t_complexe *c_in;
     
     /* ndata is truncated to be a multiple of 6 if is not yet)
@@ -83,8 +93,8 @@ double *amplitude_out, double *phase_out, int win, int nfreq, int debug)
     
  /*Transform initial data to complex data since algorithm is optimized for cx data*/
     for (i=0;i<=ndata;i++) {
-        g_NAFVariable.ZTABS[i].reel = ydata[i];
-        g_NAFVariable.ZTABS[i].imag = ypdata[i];
+        g_NAFVariable.ZTABS[i].reel = ydata[i*stride];
+        g_NAFVariable.ZTABS[i].imag = ypdata ? ypdata[i*stride] : 0.0;
     }
     
     /*Frequency map analysis*/
@@ -125,6 +135,8 @@ double *amplitude_out, double *phase_out, int win, int nfreq, int debug)
     return numfreq;
 }
 
+#if !defined(PYAT)
+
 #define min(a, b)       ((a) < (b) ? (a) : (b))
 #define max(a, b)       ((a) < (b) ? (b) : (a))
 #define NFREQMAX 10 /* maximum number of frequencies to look for */
@@ -209,7 +221,7 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
     phase = (double *) mxMalloc(nfreq*sizeof(double));
     
     /* call subroutine that calls routine for all NAFF computation */
-    numfreq = call_naff(mxGetDoubles(Y_IN),mxGetDoubles(YP_IN),(int )max(m,n),
+    numfreq = call_naff(mxGetDoubles(Y_IN),mxGetDoubles(YP_IN),1,(int )max(m,n),
             nu, amplitude, phase,  win, nfreq, debug);
     
     NU_OUT = mxCreateDoubleMatrix(numfreq, 1, mxREAL);
@@ -232,3 +244,133 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
     
     return;
 } /* end of mexFunction */
+
+#else /* PYAT */
+
+#define MODULE_NAME nafflib
+#define MODULE_DESCR "Numerical Analysis of Fundamental Frequencies"
+
+static PyObject *naff(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"data", "nfreq", "window", NULL};
+    PyArrayObject *pydata;
+    PyObject *pyfreq, *pyamp, *pyphase;
+    npy_intp outdims[2];
+    npy_intp npart, nturns, ip, k;
+    double *data, *freq, *amp, *phase;
+    int nfreq = 1;
+    int win = 1;
+    int is_complex;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O!|ii", kwlist,
+        &PyArray_Type, &pydata, &nfreq, &win)) {
+        return NULL;
+    }
+    if (PyArray_NDIM(pydata) != 2) {
+        PyErr_SetString(PyExc_ValueError, "data is not a 2D array");
+        return NULL;
+    }
+    if (PyArray_TYPE(pydata) == NPY_CDOUBLE) is_complex = 1;
+    else if (PyArray_TYPE(pydata) == NPY_DOUBLE) is_complex = 0;
+    else {
+        PyErr_SetString(PyExc_ValueError, "data is not a double or complex array");
+        return NULL;
+    }
+    if ((PyArray_FLAGS(pydata) & NPY_ARRAY_CARRAY_RO) != NPY_ARRAY_CARRAY_RO) {
+        PyErr_SetString(PyExc_ValueError, "data is not C-aligned");
+        return NULL;
+    }
+    if (nfreq < 1) {
+        PyErr_SetString(PyExc_ValueError, "nfreq must be positive");
+        return NULL;
+    }
+    npart = PyArray_DIM(pydata, 0);
+    nturns = PyArray_DIM(pydata, 1);
+    if (nturns < 66) {
+        PyErr_SetString(PyExc_ValueError, "NAFF requires at least 66 samples");
+        return NULL;
+    }
+
+    outdims[0] = npart;
+    outdims[1] = nfreq;
+    pyfreq = PyArray_SimpleNew(2, outdims, NPY_DOUBLE);
+    pyamp = PyArray_SimpleNew(2, outdims, NPY_DOUBLE);
+    pyphase = PyArray_SimpleNew(2, outdims, NPY_DOUBLE);
+    if (!(pyfreq && pyamp && pyphase)) {
+        Py_XDECREF(pyfreq);
+        Py_XDECREF(pyamp);
+        Py_XDECREF(pyphase);
+        return NULL;
+    }
+    data = PyArray_DATA(pydata);
+    freq = PyArray_DATA((PyArrayObject *)pyfreq);
+    amp = PyArray_DATA((PyArrayObject *)pyamp);
+    phase = PyArray_DATA((PyArrayObject *)pyphase);
+    for (k=0; k<npart*nfreq; k++) freq[k] = amp[k] = phase[k] = NAN;
+
+    Py_BEGIN_ALLOW_THREADS
+    #pragma omp parallel for schedule(dynamic)
+    for (ip=0; ip<npart; ip++) {
+        int stride = is_complex ? 2 : 1;
+        const double *y = data + ip*nturns*stride;
+        const double *yp = is_complex ? y+1 : NULL;
+        double *nu = freq + ip*nfreq;
+        unsigned int i, numfreq;
+        npy_intp it;
+        for (it=0; it<nturns*stride; it++) {
+            if (isnan(y[it])) break;
+        }
+        if (it < nturns*stride) continue;   /* lost particle */
+        numfreq = call_naff(y, yp, stride, (int)nturns, nu, amp + ip*nfreq,
+                            phase + ip*nfreq, win, nfreq, 0);
+        for (i=0; i<numfreq; i++) nu[i] /= 2.0*M_PI;
+    }
+    Py_END_ALLOW_THREADS
+
+    return Py_BuildValue("NNN", pyfreq, pyamp, pyphase);
+}
+
+static PyMethodDef AtMethods[] = {
+    {"naff",
+    (PyCFunction)naff, METH_VARARGS | METH_KEYWORDS,
+    PyDoc_STR(
+    "naff(data, nfreq=1, window=1)\n\n"
+    "Numerical Analysis of Fundamental Frequencies of a set of signals\n\n"
+    "The signals are analysed in parallel when OpenMP is enabled.\n\n"
+    "Args:\n"
+    "    data:       (nsignals, nsamples) real or complex C-aligned array.\n"
+    "      A complex signal is usually :math:`x - ip_x`. At least 66\n"
+    "      samples are required.\n"
+    "    nfreq:      Number of fundamental frequencies to look for\n"
+    "    window:     Window exponent: 0: no window, 1: Hann window, n:\n"
+    "      :math:`(1+\\cos(\\pi t))^n`\n\n"
+    "Returns:\n"
+    "    frequency:  (nsignals, nfreq) frequencies in units of the sampling\n"
+    "      frequency, sorted by decreasing amplitude\n"
+    "    amplitude:  (nsignals, nfreq) amplitudes\n"
+    "    phase:      (nsignals, nfreq) phases\n\n"
+    "Frequencies not found, and signals containing NaN, give NaN values.\n"
+    )},
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+PyMODINIT_FUNC MOD_INIT(MODULE_NAME)
+{
+    static struct PyModuleDef moduledef = {
+    PyModuleDef_HEAD_INIT,
+    STR(MODULE_NAME), /* m_name */
+    PyDoc_STR(MODULE_DESCR),      /* m_doc */
+    -1,           /* m_size */
+    AtMethods,    /* m_methods */
+    NULL,         /* m_reload */
+    NULL,         /* m_traverse */
+    NULL,         /* m_clear */
+    NULL,         /* m_free */
+    };
+    PyObject *m = PyModule_Create(&moduledef);
+    if (m == NULL) return MOD_ERROR_VAL;
+    import_array();
+    return MOD_SUCCESS_VAL(m);
+}
+
+#endif /* PYAT */
@@ -59,6 +59,10 @@ typedef struct elem *(*track_function)(const PyObject *element,
                                       int num_particles,
                                       struct parameters *param);
 
+/* Kernels for the radiation diffusion matrix */
+#define DIFFMATRIX_KERNEL
+#include "findmpoleraddiffmatrix.c"
+
 static npy_uint32 num_elements = 0;
 static struct elem **elemdata_list = NULL;
 static PyObject **element_list = NULL;
@@ -90,6 +94,15 @@ static PyObject *print_error(int elem_number, PyObject *rout)
     return NULL;
 }
 
+static void release_views(PyObject **views, npy_uint32 nviews)
+{
+    npy_uint32 i;
+    if (views) {
+        for (i=0; i<nviews; i++) Py_XDECREF(views[i]);
+        free(views);
+    }
+}
+
 static const char *pyprint(PyObject* pyobj) {
     PyObject *pystr = PyObject_Str(pyobj);
     const char* str = PyUnicode_AsUTF8(pystr);
@@ -332,15 +345,52 @@ void set_current_fillpattern(PyArrayObject *bspos, PyArrayObject *bcurrents,
  *  - nturns: int number of turns to simulate
  *  - refpts: numpy uint32 array denoting elements at which to return state
  *  - reuse: whether to reuse the cached state of the ring
+ *  - nseeds: number of lattices of an ensemble. line then contains nseeds
+ *    lattices with identical structure one after the other, and the
+ *    particles are split in nseeds contiguous groups, one per lattice
+ */
+/*
+ * Copy the coordinates of all particles at a reference point to the output
+ * array. coords selects the output coordinates (NULL for all 6), single
+ * selects a float32 output. Returns the next output location
  */
+static char *output_coordinates(char *out, const double *drin,
+        npy_uint32 num_particles, const npy_uint32 *coords,
+        unsigned int ncoords, int single)
+{
+    npy_uint32 c;
+    unsigned int i;
+
+    if (single) {
+        float *fout = (float *)out;
+        for (c = 0; c < num_particles; c++, drin += 6)
+            for (i = 0; i < ncoords; i++)
+                *fout++ = (float)drin[coords ? coords[i] : i];
+        return (char *)fout;
+    }
+    else if (coords) {
+        double *dout = (double *)out;
+        for (c = 0; c < num_particles; c++, drin += 6)
+            for (i = 0; i < ncoords; i++)
+                *dout++ = drin[coords[i]];
+        return (char *)dout;
+    }
+    else {
+        memcpy(out, drin, 6*num_particles*sizeof(double));
+        return out + 6*num_particles*sizeof(double);
+    }
+}
+
 static PyObject *at_atpass(PyObject *self, PyObject *args, PyObject *kwargs) {
     static char *kwlist[] = {"line","rin","nturns","refpts","turn",
                              "energy", "particle", "keep_counter",
                              "reuse","omp_num_threads","losses",
-                             "bunch_spos", "bunch_currents", NULL};
+                             "bunch_spos", "bunch_currents", "nseeds",
+                             "coords", "single", NULL};
     static double lattice_length = 0.0;
     static int last_turn = 0;
     static int valid = 0;
+    static npy_uint32 last_nseeds = 1;
 
     PyObject *lattice;
     PyObject *particle;
@@ -348,7 +398,12 @@ static PyObject *at_atpass(PyObject *self, PyObject *args, PyObject *kwargs) {
     PyArrayObject *rin;
     PyArrayObject *refs;
     PyObject *rout;
-    double *drin, *drout;
+    double *drin;
+    char *drout;
+    PyArrayObject *outcoords;
+    npy_uint32 *coords = NULL;
+    unsigned int ncoords = 6;
+    int single = 0;
     PyObject *xnturn = NULL;
     PyObject *xnelem = NULL;
     PyObject *xlost = NULL;
@@ -361,8 +416,11 @@ static PyObject *at_atpass(PyObject *self, PyObject *args, PyObject *kwargs) {
     PyArrayObject *bspos;
     int num_turns;
     npy_uint32 omp_num_threads=0;
-    npy_uint32 num_particles, np6;
+    npy_uint32 num_particles;
     npy_uint32 elem_index;
+    npy_uint32 nseeds = 1;
+    npy_uint32 seed, seed_particles, seed_elements;
+    PyObject **seed_rin = NULL;
     npy_uint32 *refpts = NULL;
     npy_uint32 nextref;
     unsigned int nextrefindex;
@@ -386,13 +444,15 @@ static PyObject *at_atpass(PyObject *self, PyObject *args, PyObject *kwargs) {
     refs=NULL;
     bspos=NULL;
     bcurrents=NULL;
+    outcoords=NULL;
     
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O!O!i|O!$iO!O!ppIpO!O!", kwlist,
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O!O!i|O!$iO!O!ppIpO!O!IO!p", kwlist,
         &PyList_Type, &lattice, &PyArray_Type, &rin, &num_turns,
         &PyArray_Type, &refs, &counter,
         &PyFloat_Type ,&energy, particle_type, &particle,
         &keep_counter, &keep_lattice, &omp_num_threads, &losses,
-        &PyArray_Type, &bspos, &PyArray_Type, &bcurrents)) {
+        &PyArray_Type, &bspos, &PyArray_Type, &bcurrents, &nseeds,
+        &PyArray_Type, &outcoords, &single)) {
         return NULL;
     }
     if (PyArray_DIM(rin,0) != 6) {
@@ -421,9 +481,21 @@ static PyObject *at_atpass(PyObject *self, PyObject *args, PyObject *kwargs) {
     set_current_fillpattern(bspos, bcurrents, &param);
 
     num_particles = (PyArray_SIZE(rin)/6);
-    np6 = num_particles*6;
     drin = PyArray_DATA(rin);
 
+    if (nseeds == 0) {
+        return PyErr_Format(PyExc_ValueError, "nseeds must be positive");
+    }
+    if ((num_particles % nseeds) != 0) {
+        return PyErr_Format(PyExc_ValueError,
+            "the number of particles is not a multiple of nseeds");
+    }
+    if ((PyList_Size(lattice) % nseeds) != 0) {
+        return PyErr_Format(PyExc_ValueError,
+            "the number of elements is not a multiple of nseeds");
+    }
+    seed_particles = num_particles / nseeds;
+
     if (refs) {
         if (PyArray_TYPE(refs) != NPY_UINT32) {
             return PyErr_Format(PyExc_ValueError, "refpts is not a uint32 array");
@@ -435,11 +507,23 @@ static PyObject *at_atpass(PyObject *self, PyObject *args, PyObject *kwargs) {
         refpts = NULL;
         num_refpts = 0;
     }
-    outdims[0] = 6;
+    if (outcoords) {
+        unsigned int i;
+        if (PyArray_TYPE(outcoords) != NPY_UINT32) {
+            return PyErr_Format(PyExc_ValueError, "coords is not a uint32 array");
+        }
+        coords = PyArray_DATA(outcoords);
+        ncoords = PyArray_SIZE(outcoords);
+        for (i = 0; i < ncoords; i++) {
+            if (coords[i] > 5)
+                return PyErr_Format(PyExc_ValueError, "coords must be in [0, 5]");
+        }
+    }
+    outdims[0] = ncoords;
     outdims[1] = num_particles;
     outdims[2] = num_refpts;
     outdims[3] = num_turns;
-    rout = PyArray_EMPTY(4, outdims, NPY_DOUBLE, 1);
+    rout = PyArray_EMPTY(4, outdims, single ? NPY_FLOAT : NPY_DOUBLE, 1);
     drout = PyArray_DATA((PyArrayObject *)rout);
 
     if(losses){
@@ -475,7 +559,7 @@ static PyObject *at_atpass(PyObject *self, PyObject *args, PyObject *kwargs) {
     }
     #endif /*_OPENMP*/
 
-    if (!(keep_lattice && valid)) {
+    if (!(keep_lattice && valid && (nseeds == last_nseeds))) {
         PyObject **element;
         double *elem_length;
         track_function *integrator;
@@ -510,6 +594,7 @@ static PyObject *at_atpass(PyObject *self, PyObject *args, PyObject *kwargs) {
         free(kwargs_list);
         kwargs_list = (PyObject **)calloc(num_elements, sizeof(PyObject *));
 
+        seed_elements = num_elements / nseeds;
         lattice_length = 0.0;
         element = element_list;
         elem_length = elemlength_list;
@@ -531,7 +616,17 @@ static PyObject *at_atpass(PyObject *self, PyObject *args, PyObject *kwargs) {
                 length = 0.0;
                 PyErr_Clear();
             }
-            lattice_length += length;
+            if (elem_index < seed_elements) {
+                lattice_length += length;
+            }
+            else if ((LibraryListPtr->FunctionHandle != integrator_list[elem_index-seed_elements]) ||
+                     (LibraryListPtr->PyFunctionHandle != pyintegrator_list[elem_index-seed_elements])) {
+                valid = 0;
+                PyErr_Format(PyExc_ValueError,
+                    "element %d of seed %d has a different PassMethod from seed 0",
+                    elem_index % seed_elements, elem_index / seed_elements);
+                return print_error(elem_index, rout);
+            }
             *integrator++ = LibraryListPtr->FunctionHandle;
             *pyintegrator++ = LibraryListPtr->PyFunctionHandle;
             *element++ = el;
@@ -539,6 +634,26 @@ static PyObject *at_atpass(PyObject *self, PyObject *args, PyObject *kwargs) {
             Py_INCREF(el);                          /* Keep a reference to each element in case of reuse */
         }
         valid = 0;
+        last_nseeds = nseeds;
+    }
+    seed_elements = num_elements / nseeds;
+
+    if (nseeds > 1) {
+        /* Views on the particles of each seed, for python integrators */
+        seed_rin = (PyObject **)calloc(nseeds, sizeof(PyObject *));
+        for (seed = 0; seed < nseeds; seed++) {
+            PyObject *start = PyLong_FromUnsignedLong(seed*seed_particles);
+            PyObject *stop = PyLong_FromUnsignedLong((seed+1)*seed_particles);
+            PyObject *cols = PySlice_New(start, stop, NULL);
+            PyObject *all = PySlice_New(NULL, NULL, NULL);
+            PyObject *key = PyTuple_Pack(2, all, cols);
+            seed_rin[seed] = PyObject_GetItem((PyObject *)rin, key);
+            Py_DECREF(key);
+            Py_DECREF(all);
+            Py_DECREF(cols);
+            Py_DECREF(stop);
+            Py_DECREF(start);
+        }
     }
 
     param.RingLength = lattice_length;
@@ -553,32 +668,39 @@ static PyObject *at_atpass(PyObject *self, PyObject *args, PyObject *kwargs) {
     }
 
     for (turn = 0; turn < num_turns; turn++) {
-        PyObject **element = element_list;
         double *elem_length = elemlength_list;
-        track_function *integrator = integrator_list;
-        PyObject **pyintegrator = pyintegrator_list;
-        PyObject **kwargs = kwargs_list;
-        struct elem **elemdata = elemdata_list;
         double s_coord = 0.0;
 
       /*PySys_WriteStdout("turn: %i\n", param.nturn);*/
         nextrefindex = 0;
         nextref= (nextrefindex<num_refpts) ? refpts[nextrefindex++] : INT_MAX;
-        for (elem_index = 0; elem_index < num_elements; elem_index++) {
+        for (elem_index = 0; elem_index < seed_elements; elem_index++) {
             param.s_coord = s_coord;
             if (elem_index == nextref) {
-                memcpy(drout, drin, np6*sizeof(double));
-                drout += np6; /*  shift the location to write to in the output array */
+                /* copy and shift the location to write to in the output array */
+                drout = output_coordinates(drout, drin, num_particles, coords, ncoords, single);
                 nextref = (nextrefindex<num_refpts) ? refpts[nextrefindex++] : INT_MAX;
             }
-            /* the actual integrator call */
-            if (*pyintegrator) {
-                PyObject *res = PyObject_CallFunctionObjArgs(*pyintegrator, rin, *element, NULL);
-                if (!res) return print_error(elem_index, rout);       /* trackFunction failed */
-                Py_DECREF(res);
-            } else {
-                *elemdata = (*integrator)(*element, *elemdata, drin, num_particles, &param);
-                if (!*elemdata) return print_error(elem_index, rout);       /* trackFunction failed */
+            /* the actual integrator call, for each lattice of the ensemble */
+            for (seed = 0; seed < nseeds; seed++) {
+                npy_uint32 idx = seed*seed_elements + elem_index;
+                PyObject *pyintegrator = pyintegrator_list[idx];
+                if (pyintegrator) {
+                    PyObject *prin = (nseeds > 1) ? seed_rin[seed] : (PyObject *)rin;
+                    PyObject *res = PyObject_CallFunctionObjArgs(pyintegrator, prin, element_list[idx], NULL);
+                    if (!res) {                                         /* trackFunction failed */
+                        release_views(seed_rin, nseeds);
+                        return print_error(elem_index, rout);
+                    }
+                    Py_DECREF(res);
+                } else {
+                    elemdata_list[idx] = (integrator_list[idx])(element_list[idx], elemdata_list[idx],
+                            drin + 6*seed*seed_particles, seed_particles, &param);
+                    if (!elemdata_list[idx]) {                          /* trackFunction failed */
+                        release_views(seed_rin, nseeds);
+                        return print_error(elem_index, rout);
+                    }
+                }
             }
             if (losses) {
                 checkiflost(drin, num_particles, elem_index, param.nturn, ixnturn, ixnelem, bxlost, dxlostcoord);
@@ -586,19 +708,14 @@ static PyObject *at_atpass(PyObject *self, PyObject *args, PyObject *kwargs) {
                 setlost(drin, num_particles);
             }
             s_coord += *elem_length++;
-            element++;
-            integrator++;
-            pyintegrator++;
-            elemdata++;
-            kwargs++;
         }
         /* the last element in the ring */
-        if (num_elements == nextref) {
-            memcpy(drout, drin, np6*sizeof(double));
-            drout += np6; /*  shift the location to write to in the output array */
+        if (seed_elements == nextref) {
+            drout = output_coordinates(drout, drin, num_particles, coords, ncoords, single);
         }
         param.nturn++;
     }
+    release_views(seed_rin, nseeds);
     valid = 1;      /* Tracking successful: the lattice can be reused */
     last_turn = param.nturn;  /* Store turn number in a static variable */
 
@@ -696,6 +813,167 @@ static PyObject *at_elempass(PyObject *self, PyObject *args, PyObject *kwargs)
     return (PyObject *) rin;
 }
 
+/*
+ * Propagate the orbit, the element transfer matrices and the cumulative
+ * radiation diffusion matrix through a line in a single pass.
+ * For each element, the orbit and 12 particles displaced by +/- xystep/2
+ * are tracked together to get the orbit at the exit and the transfer matrix.
+ * The cumulative diffusion matrix is then propagated as
+ * B = M*B*M' + BDIFF, where BDIFF is the diffusion matrix of the element
+ */
+static PyObject *at_diffmatrix(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"line", "orbit", "energy", "particle",
+                             "xystep", NULL};
+    PyObject *lattice;
+    PyObject *energy;
+    PyObject *particle;
+    PyArrayObject *orbit;
+    PyArrayObject *rtrack;
+    PyObject *bcum, *orbs;
+    double xy_step = 3.0e-8;
+    double *drin, *dbcum, *dorbs;
+    double orb[6], cumul[36], bdiff[36], m66[36];
+    double lattice_length = 0.0;
+    npy_intp bdims[3], odims[2];
+    npy_intp rdims[2] = {6, 13};
+    npy_uint32 nelems, elem_index;
+    struct parameters param;
+    int i, j;
+
+    param.common_rng=&common_state;
+    param.thread_rng=&thread_state;
+    param.nturn = 0;
+    param.num_turns = 1;
+    param.energy=0.0;
+    param.rest_energy=0.0;
+    param.charge=-1.0;
+    particle=NULL;
+    energy=NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O!O!|$O!O!d", kwlist,
+        &PyList_Type, &lattice, &PyArray_Type, &orbit,
+        &PyFloat_Type ,&energy, particle_type, &particle, &xy_step)) {
+        return NULL;
+    }
+    if (PyArray_SIZE(orbit) != 6) {
+        return PyErr_Format(PyExc_ValueError, "orbit is not a (6,) array");
+    }
+    if (PyArray_TYPE(orbit) != NPY_DOUBLE) {
+        return PyErr_Format(PyExc_ValueError, "orbit is not a double array");
+    }
+
+    set_energy_particle(lattice, energy, particle, &param);
+    set_current_fillpattern(NULL, NULL, &param);
+
+    nelems = PyList_Size(lattice);
+    for (elem_index = 0; elem_index < nelems; elem_index++) {
+        PyObject *pylength = PyObject_GetAttrString(PyList_GET_ITEM(lattice, elem_index), "Length");
+        double length = PyFloat_AsDouble(pylength);
+        Py_XDECREF(pylength);
+        if (PyErr_Occurred()) {
+            length = 0.0;
+            PyErr_Clear();
+        }
+        lattice_length += length;
+    }
+    param.RingLength = lattice_length;
+    if (param.rest_energy == 0.0) {
+        param.T0 = param.RingLength/C0;
+    }
+    else {
+        double gamma0 = param.energy/param.rest_energy;
+        double betagamma0 = sqrt(gamma0*gamma0 - 1.0);
+        double beta0 = betagamma0/gamma0;
+        param.T0 = param.RingLength/beta0/C0;
+    }
+
+    bdims[0] = nelems+1;
+    bdims[1] = 6;
+    bdims[2] = 6;
+    odims[0] = nelems+1;
+    odims[1] = 6;
+    bcum = PyArray_EMPTY(3, bdims, NPY_DOUBLE, 0);
+    orbs = PyArray_EMPTY(2, odims, NPY_DOUBLE, 0);
+    rtrack = (PyArrayObject *)PyArray_EMPTY(2, rdims, NPY_DOUBLE, 1);
+    dbcum = PyArray_DATA((PyArrayObject *)bcum);
+    dorbs = PyArray_DATA((PyArrayObject *)orbs);
+    drin = PyArray_DATA(rtrack);
+
+    for (i=0; i<6; i++) orb[i] = *(double *)PyArray_GETPTR1(orbit, i);
+    for (i=0; i<36; i++) cumul[i] = 0.0;
+
+    for (elem_index = 0; elem_index <= nelems; elem_index++) {
+        PyObject *el, *PyPassMethod;
+        struct LibraryListElement *LibraryListPtr;
+        const char *pass_method;
+        size_t lpass;
+
+        /* Store the values at the entrance of the element */
+        for (i=0; i<6; i++) {
+            dorbs[6*elem_index+i] = orb[i];
+            for (j=0; j<6; j++) dbcum[36*elem_index+6*i+j] = cumul[i+6*j];
+        }
+        if (elem_index == nelems) break;
+
+        el = PyList_GET_ITEM(lattice, elem_index);
+        PyPassMethod = PyObject_GetAttrString(el, "PassMethod");
+        if (!PyPassMethod) goto error;
+        pass_method = PyUnicode_AsUTF8(PyPassMethod);
+        LibraryListPtr = get_track_function(pass_method);
+        lpass = strlen(pass_method);
+
+        /* Diffusion matrix of the element */
+        for (i=0; i<36; i++) bdiff[i] = 0.0;
+        if ((lpass >= 7) && (strcmp(pass_method+lpass-7, "RadPass") == 0)) {
+            double borb[6];
+            for (i=0; i<6; i++) borb[i] = orb[i];
+            if (!diffmatrix(el, borb, param.energy, bdiff)) {
+                Py_DECREF(PyPassMethod);
+                goto error;
+            }
+        }
+        Py_DECREF(PyPassMethod);
+        if (!LibraryListPtr) goto error;
+
+        /* Track the orbit and the displaced particles */
+        for (j=0; j<6; j++) {
+            for (i=0; i<6; i++) {
+                double delta = (i==j) ? 0.5*xy_step : 0.0;
+                drin[6*j+i] = orb[i] + delta;
+                drin[6*(j+6)+i] = orb[i] - delta;
+            }
+            drin[72+j] = orb[j];
+        }
+        if (LibraryListPtr->PyFunctionHandle) {
+            PyObject *res = PyObject_CallFunctionObjArgs(LibraryListPtr->PyFunctionHandle,
+                                                         rtrack, el, NULL);
+            if (!res) goto error;
+            Py_DECREF(res);
+        }
+        else {
+            struct elem *elem_data = LibraryListPtr->FunctionHandle(el, NULL, drin, 13, &param);
+            if (!elem_data) goto error;
+            free(elem_data);
+        }
+
+        /* Transfer matrix, stored column-by-column */
+        for (j=0; j<6; j++)
+            for (i=0; i<6; i++)
+                m66[i+6*j] = (drin[6*j+i] - drin[6*(j+6)+i])/xy_step;
+        ATsandwichmmt(m66, cumul);
+        ATaddmm(bdiff, cumul);
+        for (i=0; i<6; i++) orb[i] = drin[72+i];
+    }
+    Py_DECREF(rtrack);
+    return Py_BuildValue("NN", bcum, orbs);
+
+error:
+    Py_DECREF(rtrack);
+    Py_DECREF(bcum);
+    Py_DECREF(orbs);
+    return NULL;
+}
+
 static PyObject *reset_rng(PyObject *self, PyObject *args, PyObject *kwargs)
 {
     static char *kwlist[] = {"rank", "seed", NULL};
@@ -729,6 +1007,84 @@ static PyObject *thread_rng(PyObject *self)
     return Py_BuildValue("d", drand);
 }
 
+#define BEAM_BLOCK 4096     /* Number of particles per random stream */
+
+static PyObject *at_genbeam(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"lmat", "orbit", "rout", "seed", "rank",
+                             "truncation", "omp_num_threads", NULL};
+    PyArrayObject *lmat, *orbit, *rout;
+    uint64_t seed = AT_RNG_STATE;
+    uint64_t rank = 0;
+    double truncation = 0.0;
+    int omp_num_threads = 0;
+    npy_intp num_particles, nblocks, block;
+    double *lm, *orb, *drout;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O!O!O!|$KKdi", kwlist,
+        &PyArray_Type, &lmat, &PyArray_Type, &orbit, &PyArray_Type, &rout,
+        &seed, &rank, &truncation, &omp_num_threads)) {
+        return NULL;
+    }
+    if ((PyArray_TYPE(lmat) != NPY_DOUBLE) || (PyArray_NDIM(lmat) != 2) ||
+        (PyArray_DIM(lmat, 0) != 6) || (PyArray_DIM(lmat, 1) != 6) ||
+        !PyArray_IS_C_CONTIGUOUS(lmat))
+        return PyErr_Format(PyExc_ValueError, "lmat is not a 6x6 C-contiguous double array");
+    if ((PyArray_TYPE(orbit) != NPY_DOUBLE) || (PyArray_SIZE(orbit) != 6) ||
+        !PyArray_ISCONTIGUOUS(orbit))
+        return PyErr_Format(PyExc_ValueError, "orbit is not a contiguous double array of 6 elements");
+    if ((PyArray_TYPE(rout) != NPY_DOUBLE) || (PyArray_NDIM(rout) != 2) ||
+        (PyArray_DIM(rout, 0) != 6))
+        return PyErr_Format(PyExc_ValueError, "rout is not a 6 x n_particles double array");
+    if (!PyArray_IS_F_CONTIGUOUS(rout) || !PyArray_ISWRITEABLE(rout))
+        return PyErr_Format(PyExc_ValueError, "rout is not a writeable Fortran-aligned array");
+
+    lm = PyArray_DATA(lmat);
+    orb = PyArray_DATA(orbit);
+    drout = PyArray_DATA(rout);
+    num_particles = PyArray_DIM(rout, 1);
+    nblocks = (num_particles + BEAM_BLOCK - 1) / BEAM_BLOCK;
+#ifdef _OPENMP
+    if (omp_num_threads <= 0) omp_num_threads = omp_get_max_threads();
+#else
+    omp_num_threads = 1;
+#endif /*_OPENMP*/
+
+    Py_BEGIN_ALLOW_THREADS
+    /* Each block of particles has its own stream: the result does not
+       depend on the number of threads */
+    #pragma omp parallel for if (num_particles > OMP_PARTICLE_THRESHOLD) \
+    num_threads(omp_num_threads) schedule(dynamic) default(none) \
+    shared(lm,orb,drout,num_particles,nblocks,seed,rank,truncation) private(block)
+    for (block = 0; block < nblocks; block++) {
+        pcg32_random_t rng = THREAD_PCG32_INITIALIZER;
+        npy_intp c;
+        npy_intp cend = (block+1)*BEAM_BLOCK;
+        if (cend > num_particles) cend = num_particles;
+        pcg32_srandom_r(&rng, seed, (rank << 40) + (uint64_t)block);
+        for (c = block*BEAM_BLOCK; c < cend; c++) {
+            double v[6];
+            double *r6 = drout + 6*c;
+            int i, j;
+            /* Truncation of the amplitude of each pair of variables */
+            for (i = 0; i < 6; i += 2) {
+                do {
+                    v[i] = atrandn_r(&rng, 0.0, 1.0);
+                    v[i+1] = atrandn_r(&rng, 0.0, 1.0);
+                } while ((truncation > 0.0) &&
+                         (v[i]*v[i] + v[i+1]*v[i+1] > truncation*truncation));
+            }
+            for (i = 0; i < 6; i++) {
+                double s = orb[i];
+                for (j = 0; j < 6; j++) s += lm[6*i+j]*v[j];
+                r6[i] = s;
+            }
+        }
+    }
+    Py_END_ALLOW_THREADS
+    Py_RETURN_NONE;
+}
+
 /* Method table */
 
 static PyMethodDef AtMethods[] = {
@@ -749,10 +1105,16 @@ static PyMethodDef AtMethods[] = {
               "    particle (Optional[Particle]):  circulating particle\n"
               "    reuse:   if True, use previously cached description of the lattice.\n"
               "    omp_num_threads: number of OpenMP threads (default 0: automatic)\n"
-              "    losses:  if True, process losses\n\n"
+              "    losses:  if True, process losses\n"
+              "    nseeds:  number of lattices in an ensemble. line is the concatenation\n"
+              "      of nseeds lattices with the same structure, and the particles are\n"
+              "      split in nseeds contiguous groups, each tracked in its own lattice\n"
+              "    coords:  uint32 array of the output coordinates (default: all 6)\n"
+              "    single:  if True, the output is float32. The tracking is done in\n"
+              "      double precision\n\n"
               "Returns:\n"
-              "    rout:    6 x n_particles x n_refpts x n_turns Fortran-ordered numpy array\n"
-              "         of particle coordinates\n\n"
+              "    rout:    n_coords x n_particles x n_refpts x n_turns Fortran-ordered numpy\n"
+              "         array of particle coordinates\n\n"
               ":meta private:"
               )},
     {"elempass",  (PyCFunction)at_elempass, METH_VARARGS | METH_KEYWORDS,
@@ -766,6 +1128,21 @@ static PyMethodDef AtMethods[] = {
               "    particle (Optional[Particle]):  circulating particle\n\n"
               ":meta private:"
             )},
+    {"diffmatrix",  (PyCFunction)at_diffmatrix, METH_VARARGS | METH_KEYWORDS,
+    PyDoc_STR("diffmatrix(line, orbit, energy=None, particle=None, xystep=3.0e-8)\n\n"
+              "Propagate the orbit and the cumulative radiation diffusion matrix\n"
+              "through line.\n\n"
+              "Parameters:\n"
+              "    line:    list of elements\n"
+              "    orbit:   (6,) orbit at the entrance of line\n"
+              "    energy (float):      nominal energy [eV]\n"
+              "    particle (Optional[Particle]):  circulating particle\n"
+              "    xystep (float):      step for the computation of the transfer matrices\n\n"
+              "Returns:\n"
+              "    bbcum:   (len(line)+1, 6, 6) cumulative diffusion matrices\n"
+              "    orbs:    (len(line)+1, 6) orbit at the entrance of each element\n\n"
+              ":meta private:"
+            )},
     {"reset_rng",  (PyCFunction)reset_rng, METH_VARARGS | METH_KEYWORDS,
     PyDoc_STR("reset_rng(*, rank=0, seed=None)\n\n"
               "Reset the *common* and *thread* random generators.\n\n"
@@ -783,6 +1160,24 @@ static PyMethodDef AtMethods[] = {
     PyDoc_STR("thread_rng()\n\n"
               "Return a double from the *thread* generator .\n"
              )},
+    {"genbeam",  (PyCFunction)at_genbeam, METH_VARARGS | METH_KEYWORDS,
+    PyDoc_STR("genbeam(lmat, orbit, rout, *, seed=AT_RNG_STATE, rank=0, truncation=0.0, omp_num_threads=0)\n\n"
+              "Fill rout with random particles: rout = orbit + lmat @ v, with v\n"
+              "normally distributed. The particles are generated by blocks using\n"
+              "the generator of the tracking, each block with its own stream.\n\n"
+              "Parameters:\n"
+              "    lmat:    6 x 6 C-contiguous matrix\n"
+              "    orbit:   (6,) centre of the distribution\n"
+              "    rout:    6 x n_particles Fortran-ordered numpy array, filled in-place\n"
+              "    seed (int):  seed of the random streams (default: the default seed\n"
+              "      of the tracking generators)\n"
+              "    rank (int):  process identifier (for MPI and python multiprocessing)\n"
+              "    truncation (float):  if positive, each pair of normal variables\n"
+              "      (v[0], v[1]), (v[2], v[3]), (v[4], v[5]) is redrawn until its\n"
+              "      amplitude sqrt(v[i]**2 + v[i+1]**2) is below truncation\n"
+              "    omp_num_threads: number of OpenMP threads (default 0: automatic)\n\n"
+              ":meta private:"
+            )},
    {NULL, NULL, 0, NULL}        /* Sentinel */
 };
 
@@ -2,13 +2,13 @@
 import numpy
 from .boundary import GridMode
 # noinspection PyProtectedMember
-from .boundary import boundary_search
+from .boundary import boundary_search, boundary_searches, AcceptanceScan
 from typing import Optional, Sequence
 import multiprocessing
 from ..lattice import Lattice, Refpts, frequency_control, AtError
 
 
-__all__ = ['get_acceptance', 'get_1d_acceptance', 'get_horizontal_acceptance',
+__all__ = ['get_acceptance', 'get_acceptances', 'get_1d_acceptance', 'get_horizontal_acceptance',
            'get_vertical_acceptance', 'get_momentum_acceptance']
 
 
@@ -24,6 +24,7 @@ def get_acceptance(
         use_gpu: Optional[bool] = False,
         verbose: Optional[bool] = True,
         divider: Optional[int] = 2,
+        screen_turns: Optional[int] = None,
         shift_zero: Optional[float] = 1.0e-6,
         start_method: Optional[str] = None,
 ):
@@ -63,6 +64,9 @@ def get_acceptance(
         verbose:        Print out some information
         divider:        Value of the divider used in
           :py:attr:`.GridMode.RECURSIVE` boundary search
+        screen_turns:   Number of turns of the survival screening in
+          :py:attr:`.GridMode.RECURSIVE` boundary search. Default:
+          *nturns*/8
         shift_zero: Epsilon offset applied on all 6 coordinates
         start_method:   Python multiprocessing start method. The default
           ``None`` uses the python default that is considered safe.
@@ -78,7 +82,8 @@ def get_acceptance(
         tracked:    (2,n) array: Coordinates of tracked particles
 
     In case of multiple refpts, return values are lists of arrays, with one
-    array per ref. point.
+    array per ref. point. The ref. points are then processed in a single
+    tracking session, see :py:func:`get_acceptances`.
 
     Examples:
 
@@ -154,12 +159,25 @@ def get_acceptance(
             raise AtError(msg)
     else:
         offset=[None for _ in rp]
+    if len(rp) > 1:
+        # All observation points are processed in one tracking session
+        scans = [AcceptanceScan(planes, npoints, amplitudes, refpt=r,
+                                bounds=bounds, offset=o)
+                 for r, o in zip(rp, offset)]
+        results = boundary_searches(ring, scans, nturns=nturns, dp=dp,
+                                    grid_mode=grid_mode, use_mp=use_mp,
+                                    verbose=verbose, divider=divider,
+                                    screen_turns=screen_turns,
+                                    shift_zero=shift_zero, **kwargs)
+        boundary, survived, grid = (list(r) for r in zip(*results))
+        return boundary, survived, grid
     for r, o in zip(rp, offset):
         b, s, g = boundary_search(ring, planes, npoints, amplitudes,
                                   nturns=nturns, obspt=r, dp=dp,
                                   offset=o, bounds=bounds,
                                   grid_mode=grid_mode, use_mp=use_mp,
                                   verbose=verbose, divider=divider,
+                                  screen_turns=screen_turns,
                                   shift_zero=shift_zero, **kwargs)
         boundary.append(b)
         survived.append(s)
@@ -170,6 +188,78 @@ def get_acceptance(
         return boundary, survived, grid
 
 
+@frequency_control
+def get_acceptances(
+        ring: Lattice, scans: Sequence[AcceptanceScan],
+        nturns: Optional[int] = 1024,
+        dp: Optional[float] = None,
+        grid_mode: Optional[GridMode] = GridMode.RADIAL,
+        use_mp: Optional[bool] = False,
+        use_gpu: Optional[bool] = False,
+        verbose: Optional[bool] = True,
+        divider: Optional[int] = 2,
+        screen_turns: Optional[int] = None,
+        shift_zero: Optional[float] = 1.0e-6,
+        start_method: Optional[str] = None,
+):
+    # noinspection PyUnresolvedReferences
+    r"""Computes several acceptances in a single tracking session
+
+    Each scan is defined by an :py:class:`.AcceptanceScan`, or a tuple with
+    the same fields: planes, npoints, amplitudes, refpt, bounds, offset,
+    grid_mode. The closed orbit is solved once for all the observation
+    points, and the particles of all the scans are tracked together on the
+    unrotated ring, each from the observation point of its scan. With
+    ``use_mp=True``, the whole particle set is distributed over the
+    processes, instead of one scan at a time.
+
+    :py:attr:`.GridMode.RECURSIVE` scans progress in lockstep: the new
+    points of all scans at each step of the search are tracked together.
+
+    Parameters:
+        ring:           Lattice definition
+        scans:          Sequence of scan definitions
+        nturns:         Number of turns for the tracking
+        dp:             static momentum offset
+        grid_mode:      Grid definition of the scans not specifying it
+        use_mp:         Use python multiprocessing (:py:func:`.patpass`,
+          default use :py:func:`.lattice_pass`).
+        use_gpu:        Use GPU
+        verbose:        Print out some information
+        divider:        Value of the divider used in
+          :py:attr:`.GridMode.RECURSIVE` boundary search
+        screen_turns:   Number of turns of the survival screening in
+          :py:attr:`.GridMode.RECURSIVE` boundary search. Default:
+          *nturns*/8
+        shift_zero: Epsilon offset applied on all 6 coordinates
+        start_method:   Python multiprocessing start method. See
+          :py:func:`get_acceptance`
+
+    Returns:
+        acceptances:    List of (boundary, survived, tracked) tuples, one
+          per scan, as returned by :py:func:`get_acceptance`
+
+    Example:
+
+        >>> scans = [AcceptanceScan(['x', 'y'], [10, 10], [10e-3, 10e-3],
+        ...                         refpt=r) for r in range(0, 100, 10)]
+        >>> scans.append(AcceptanceScan('dp', 40, 0.08, refpt=0,
+        ...                             bounds=[-1, 1],
+        ...                             grid_mode=GridMode.CARTESIAN))
+        >>> results = ring.get_acceptances(scans, nturns=500)
+    """
+    kwargs = {}
+    if start_method is not None:
+        kwargs['start_method'] = start_method
+    if use_gpu:
+        kwargs['use_gpu'] = True
+    return boundary_searches(ring, scans, nturns=nturns, dp=dp,
+                             grid_mode=grid_mode, use_mp=use_mp,
+                             verbose=verbose, divider=divider,
+                             screen_turns=screen_turns,
+                             shift_zero=shift_zero, **kwargs)
+
+
 def get_1d_acceptance(
         ring: Lattice, plane: str, resolution: float, amplitude: float,
         nturns: Optional[int] = 1024,
@@ -180,6 +270,7 @@ def get_1d_acceptance(
         use_mp: Optional[bool] = False,
         verbose: Optional[bool] = False,
         divider: Optional[int] = 2,
+        screen_turns: Optional[int] = None,
         shift_zero: Optional[float] = 1.0e-6,
         start_method: Optional[str] = None,
 
@@ -215,6 +306,9 @@ def get_1d_acceptance(
         verbose:        Print out some information
         divider:        Value of the divider used in
           :py:attr:`.GridMode.RECURSIVE` boundary search
+        screen_turns:   Number of turns of the survival screening in
+          :py:attr:`.GridMode.RECURSIVE` boundary search. Default:
+          *nturns*/8
         shift_zero: Epsilon offset applied on all 6 coordinates
         start_method:   Python multiprocessing start method. The default
           ``None`` uses the python default that is considered safe.
@@ -252,8 +346,8 @@ def get_1d_acceptance(
                              nturns=nturns, dp=dp, refpts=refpts,
                              grid_mode=grid_mode, use_mp=use_mp,
                              verbose=verbose, start_method=start_method,
-                             divider=divider, shift_zero=shift_zero,
-                             offset=offset)
+                             divider=divider, screen_turns=screen_turns,
+                             shift_zero=shift_zero, offset=offset)
     return numpy.squeeze(b), s, g
 
 
@@ -290,6 +384,9 @@ def get_horizontal_acceptance(ring: Lattice,
         verbose:        Print out some information
         divider:        Value of the divider used in
           :py:attr:`.GridMode.RECURSIVE` boundary search
+        screen_turns:   Number of turns of the survival screening in
+          :py:attr:`.GridMode.RECURSIVE` boundary search. Default:
+          *nturns*/8
         shift_zero: Epsilon offset applied on all 6 coordinates
         start_method:   Python multiprocessing start method. The default
           ``None`` uses the python default that is considered safe.
@@ -349,6 +446,9 @@ def get_vertical_acceptance(ring: Lattice,
         verbose:        Print out some information
         divider:        Value of the divider used in
           :py:attr:`.GridMode.RECURSIVE` boundary search
+        screen_turns:   Number of turns of the survival screening in
+          :py:attr:`.GridMode.RECURSIVE` boundary search. Default:
+          *nturns*/8
         shift_zero: Epsilon offset applied on all 6 coordinates
         start_method:   Python multiprocessing start method. The default
           ``None`` uses the python default that is considered safe.
@@ -408,6 +508,9 @@ def get_momentum_acceptance(ring: Lattice,
         verbose:        Print out some information
         divider:        Value of the divider used in
           :py:attr:`.GridMode.RECURSIVE` boundary search
+        screen_turns:   Number of turns of the survival screening in
+          :py:attr:`.GridMode.RECURSIVE` boundary search. Default:
+          *nturns*/8
         shift_zero: Epsilon offset applied on all 6 coordinates
         start_method:   Python multiprocessing start method. The default
           ``None`` uses the python default that is considered safe.
@@ -436,6 +539,7 @@ def get_momentum_acceptance(ring: Lattice,
 
 
 Lattice.get_acceptance = get_acceptance
+Lattice.get_acceptances = get_acceptances
 Lattice.get_horizontal_acceptance = get_horizontal_acceptance
 Lattice.get_vertical_acceptance = get_vertical_acceptance
 Lattice.get_momentum_acceptance = get_momentum_acceptance
@@ -5,7 +5,8 @@ grid definitions
 """
 
 from at.lattice import Lattice, AtError, AtWarning
-from typing import Optional, Sequence
+from at.tracking import lattice_track
+from typing import Optional, Sequence, NamedTuple
 from enum import Enum
 import numpy
 from scipy.ndimage import binary_dilation, binary_opening
@@ -13,7 +14,7 @@ from collections import namedtuple
 import time
 import warnings
 
-__all__ = ['GridMode']
+__all__ = ['GridMode', 'AcceptanceScan']
 
 _pdict = {'x': 0, 'xp': 1,
           'y': 2, 'yp': 3,
@@ -29,6 +30,25 @@ class GridMode(Enum):
     RECURSIVE = 2   #: radial recursive search
 
 
+class AcceptanceScan(NamedTuple):
+    """Definition of one acceptance scan for
+    :py:func:`.get_acceptances`"""
+    #: Plane(s) to scan, as in :py:func:`.get_acceptance`
+    planes: Sequence[str]
+    #: (len(planes),) array: number of points in each dimension
+    npoints: Sequence[int]
+    #: (len(planes),) array: maximum amplitude or initial step
+    amplitudes: Sequence[float]
+    #: Observation point
+    refpt: int = 0
+    #: Tracked range: range=bounds*amplitude
+    bounds: Optional[Sequence[Sequence[float]]] = None
+    #: Initial orbit. Default: closed orbit
+    offset: Optional[Sequence[float]] = None
+    #: Grid definition. Default: common grid mode of the scans
+    grid_mode: Optional[GridMode] = None
+
+
 def grid_config(planes, amplitudes, npoints, bounds, grid_mode,
                 shift_zero):
     """"
@@ -161,12 +181,126 @@ def get_parts(config, offset):
     return parts, grid(g, offset[pind])
 
 
+def _track_survival(parts, ring, nturns, use_mp, turn=0, chunk=16,
+                    **kwargs):
+    """
+    Track particles, removing them from the tracked batch as soon as they
+    are lost. The turns are tracked by chunks of increasing length.
+    Returns the survival mask and the final coordinates
+    """
+    kwargs.pop('keep_lattice', None)
+    parts = numpy.array(parts, dtype=float, order='F', copy=True)
+    alive = numpy.all(numpy.isfinite(parts), axis=0)
+    done = 0
+    keep_lattice = False
+    while done < nturns and numpy.any(alive):
+        nt = min(chunk, nturns - done)
+        pa = numpy.asfortranarray(parts[:, alive])
+        ring.track(pa, nturns=nt, refpts=None, in_place=True,
+                   turn=turn+done, keep_lattice=keep_lattice,
+                   use_mp=use_mp, **kwargs)
+        parts[:, alive] = pa
+        alive &= numpy.isfinite(parts[0])
+        done += nt
+        # A pool of processes does not share the cached lattice
+        keep_lattice = not use_mp
+        chunk *= 2
+    return alive, parts
+
+
+def _track_segments(ring, zin, starts, stops, **kwargs):
+    """
+    Track each particle from its own start element to its own stop element,
+    starts <= stops. The lattice is shared: it is tracked segment by segment
+    between consecutive start and stop points, the particles joining the
+    tracked batch at their start element and leaving it at their stop
+    element. Lost particles are marked with NaN.
+    """
+    for key in ('use_mp', 'keep_lattice', 'start_method', 'pool_size'):
+        kwargs.pop(key, None)
+    kwargs.setdefault('energy', ring.energy)
+    kwargs.setdefault('particle', ring.particle)
+    elems = list(ring)
+    zout = numpy.array(zin, dtype=float, order='F', copy=True)
+    edges = numpy.unique(numpy.concatenate((starts, stops)))
+    for begin, end in zip(edges[:-1], edges[1:]):
+        active = (starts <= begin) & (stops >= end)
+        if numpy.any(active):
+            batch = numpy.asfortranarray(zout[:, active])
+            lattice_track(elems[begin:end], batch, nturns=1, refpts=None,
+                          in_place=True, **kwargs)
+            zout[:, active] = batch
+    return zout
+
+
+def _track_survival_from(parts, starts, ring, nturns, use_mp, turn=0,
+                         **kwargs):
+    """
+    Survival over *nturns* turns of particles starting at different
+    elements of the ring. The turns are counted from the start element of
+    each particle: the first partial turn and the final partial turn are
+    tracked by segments, the full turns are tracked together.
+    Returns the survival mask and the final coordinates
+    """
+    starts = numpy.asarray(starts)
+    if not numpy.any(starts):
+        return _track_survival(parts, ring, nturns, use_mp, turn=turn,
+                               **kwargs)
+    nelems = numpy.full(starts.shape, len(ring))
+    parts = _track_segments(ring, parts, starts, nelems, **kwargs)
+    _, parts = _track_survival(parts, ring, nturns-1, use_mp, turn=turn+1,
+                               **kwargs)
+    parts = _track_segments(ring, parts, numpy.zeros_like(starts), starts,
+                            **kwargs)
+    return numpy.all(numpy.isfinite(parts), axis=0), parts
+
+
+def _run_searches(ring, searches, starts, use_mp, **kwargs):
+    """
+    Run boundary searches in lockstep. Each search is a generator yielding
+    tracking requests (particles, nturns, turn), receiving the survival mask
+    and final coordinates and returning its result. The pending requests of
+    all searches are tracked together as a single particle set, the
+    particles of each search starting at its own element of the ring.
+    """
+    results = [None] * len(searches)
+    requests = {}
+
+    def advance(i, reply=None):
+        try:
+            requests[i] = searches[i].send(reply)
+        except StopIteration as stop:
+            results[i] = stop.value
+
+    for i in range(len(searches)):
+        advance(i)
+    while requests:
+        groups = {}
+        for i, (_, nturns, turn) in requests.items():
+            groups.setdefault((nturns, turn), []).append(i)
+        replies = {}
+        for (nturns, turn), ids in groups.items():
+            sizes = [requests[i][0].shape[1] for i in ids]
+            parts = numpy.concatenate([requests[i][0] for i in ids], axis=1)
+            pstarts = numpy.repeat([starts[i] for i in ids], sizes)
+            alive, final = _track_survival_from(parts, pstarts, ring, nturns,
+                                                use_mp, turn=turn, **kwargs)
+            split = numpy.cumsum(sizes)[:-1]
+            for i, a, f in zip(ids, numpy.split(alive, split),
+                               numpy.split(final, split, axis=1)):
+                replies[i] = (a, f)
+        requests = {}
+        for i, reply in replies.items():
+            advance(i, reply)
+    return results
+
+
 def get_survived(parts, ring, nturns, use_mp, **kwargs):
     """
     Track a grid through the ring and extract survived particles
     """
-    _, _, td = ring.track(parts, nturns=nturns, losses=True, use_mp=use_mp, **kwargs)
-    return numpy.invert(td['loss_map'].islost)
+    alive, _ = _track_survival(parts, ring, nturns, use_mp, **kwargs)
+    return alive
 
 
 def get_grid_boundary(mask, grid, config):
@@ -278,6 +412,17 @@ def get_grid_boundary(mask, grid, config):
         raise AtError('GridMode {0} undefined.'.format(grid.mode))
 
 
+def _grid_search(config, offset, nturns):
+    """
+    Generator tracking a grid and returning its boundary
+    """
+    parts, grid = get_parts(config, offset)
+    mask, _ = yield parts, nturns, 0
+    survived = grid.grid[:, mask]
+    boundary = get_grid_boundary(mask, grid, config)
+    return boundary, survived, grid.grid
+
+
 def grid_boundary_search(ring, planes, npoints, amplitudes, nturns=1024,
                          obspt=None, dp=None, offset=None, bounds=None,
                          grid_mode=GridMode.RADIAL, use_mp=False,
@@ -306,84 +451,144 @@ def grid_boundary_search(ring, planes, npoints, amplitudes, nturns=1024,
         print('The initial offset is {0} with dp={1}'.format(offset, dp))
 
     t0 = time.time()
-    parts, grid = get_parts(config, offset)
-    mask = get_survived(parts, newring, nturns, use_mp, **kwargs)
-    survived = grid.grid[:, mask]
-    boundary = get_grid_boundary(mask, grid, config)
+    result, = _run_searches(newring, [_grid_search(config, offset, nturns)],
+                            [0], use_mp, **kwargs)
     if verbose:
         print('Calculation took {0}'.format(time.time()-t0))
-    return boundary, survived, grid.grid
+    return result
 
 
-def recursive_boundary_search(ring, planes, npoints, amplitudes, nturns=1024,
-                              obspt=None, dp=None, offset=None, bounds=None,
-                              use_mp=False, divider=2, verbose=True,
-                              shift_zero=1.0e-9, **kwargs):
+def _recursive_search(config, offset, nturns, divider=2, screen_turns=None):
     """
-    Recursively search for the boundary in a given plane and direction (angle)
+    Generator recursively searching for the boundary in a given plane and
+    direction (angle)
+
+    All directions are searched together. New points are first tracked over
+    *screen_turns* turns (default: *nturns*/8), and the survivors on which
+    the search relies are then confirmed over *nturns* turns.
     """
-    def search_boundary(planesi, angles, rtol, rsteps, nturns,
-                        offset, use_mp, **kwargs):
+    if screen_turns is None:
+        screen_turns = max(nturns // 8, 1)
+    planesi = config.planesi
+    rtol = min(numpy.atleast_1d(config.amplitudes/config.shape))
+    rsteps = config.amplitudes
+    if len(numpy.atleast_1d(config.shape)) == 2:
+        angles = numpy.linspace(*config.bounds[1], config.shape[1])
+    else:
+        angles = numpy.linspace(*config.bounds[1], 2)
+    angles = numpy.atleast_1d(angles)
 
+    # Tracking status of visited points, indexed by quantized coordinates
+    lost, screened, survived = 0, 1, 2
+    quantum = 1.0e-9 * max(rsteps)
+    status = {}
+    points = {}
+    states = {}
+    nscreen = min(nturns, screen_turns) if screen_turns else nturns
+
+    def keys(pts):
+        q = numpy.rint(pts / quantum).astype(numpy.int64)
+        return [tuple(k) for k in q.T]
+
+    def screen(pts, kys):
+        # Short-turn tracking of new points. Survivors keep their state
+        # for a later confirmation over the full number of turns
+        alive, final = yield (pts.T + offset).T, nscreen, 0
+        for k, p, a, f in zip(kys, pts.T, alive, final.T):
+            points[k] = p[planesi]
+            if not a:
+                status[k] = lost
+            elif nscreen < nturns:
+                status[k] = screened
+                states[k] = f
+            else:
+                status[k] = survived
+
+    def confirm(kys):
+        # Resume the screened survivors up to the full number of turns
+        st = numpy.stack([states.pop(k) for k in kys], axis=1)
+        alive, _ = yield st, nturns-nscreen, nscreen
+        for k, a in zip(kys, alive):
+            status[k] = survived if a else lost
+
+    def walk():
         ftol = min(rtol/rsteps)
         cs = numpy.squeeze([numpy.cos(angles), numpy.sin(angles)])
         cs = numpy.around(cs, decimals=9)
         fact = numpy.ones(len(angles))
-        survived = numpy.full(len(angles), True)
+        alive = numpy.full(len(angles), True)
         part = numpy.zeros((6, len(angles)))
-        grid = numpy.array([])
-        mask = numpy.array([])
+        used = set()
 
-        while numpy.any(survived):
+        while numpy.any(alive):
             for i, pi in enumerate(planesi):
-                part[pi, survived] += cs[i, survived]*rsteps[i]*fact[survived]
-            istracked = numpy.array([not numpy.any([numpy.allclose(p, g,
-                                                                   rtol=1.0e-9)
-                                    for g in grid.T])
-                                    for p in part[planesi].T])
-            survived = numpy.array([numpy.any([numpy.allclose(p, m,
-                                                              rtol=1.0e-9)
-                                   for m in mask.T])
-                                   for p in part[planesi].T])
-            pt = part[:, istracked]
-            grid = numpy.hstack([grid,
-                                 pt[planesi]]) if grid.size else pt[planesi]
-            ptmp = (pt.T + offset).T
-            survived[istracked] = get_survived(ptmp, newring, nturns,
-                                               use_mp, **kwargs)
-            pm = part[:, numpy.logical_and(istracked, survived)]
-            mask = numpy.hstack([mask,
-                                 pm[planesi]]) if mask.size else pm[planesi]
+                part[pi, alive] += cs[i, alive]*rsteps[i]*fact[alive]
+            kys = keys(part[planesi])
+            new = {}
+            for i, k in enumerate(kys):
+                if k not in status and k not in new:
+                    new[k] = i
+            if new:
+                yield from screen(part[:, list(new.values())],
+                                  list(new.keys()))
+            used.update(kys)
+            alive = numpy.array([status[k] != lost for k in kys])
             for i in range(len(angles)):
-                if not survived[i] and fact[i] > ftol:
+                if not alive[i] and fact[i] > ftol:
                     deltas = cs[:, i]*rsteps[:]*min(1, 2*fact[i])
                     if numpy.any(abs(deltas) > abs(part[planesi, i])):
                         part[planesi, i] = numpy.zeros(len(planesi))
                     else:
                         for j, pi in enumerate(planesi):
                             part[pi, i] -= deltas[j]
-                    survived[i] = True
+                    alive[i] = True
                     fact[i] *= 1/divider
 
         for i, pi in enumerate(planesi):
             part[pi] -= cs[i]*rsteps[i]*fact
+        return numpy.squeeze(part[planesi]), used
+
+    # The search relies on screened points as if they survived. Once
+    # done, they are confirmed and the search is replayed until it uses
+    # only confirmed points, giving the result of full-turn tracking
+    while True:
+        p, used = yield from walk()
+        pending = [k for k in used if status[k] == screened]
+        if not pending:
+            break
+        yield from confirm(pending)
+
+    grid = numpy.array([points[k] for k in status]).T
+    mask = numpy.array([points[k] for k, v in status.items()
+                        if v == survived]).T
+    if mask.size == 0:
+        mask = numpy.array([])
+    return p, mask, grid
 
-        p = numpy.squeeze(part[planesi])
-        return p, mask, grid
 
+def recursive_boundary_search(ring, planes, npoints, amplitudes, nturns=1024,
+                              obspt=None, dp=None, offset=None, bounds=None,
+                              use_mp=False, divider=2, verbose=True,
+                              shift_zero=1.0e-9, screen_turns=None,
+                              **kwargs):
+    """
+    Recursively search for the boundary in a given plane and direction (angle)
+
+    All directions are searched together. New points are first tracked over
+    *screen_turns* turns (default: *nturns*/8), and the survivors on which
+    the search relies are then confirmed over *nturns* turns.
+    """
     offset, newring = set_ring_orbit(ring, dp, obspt, offset)
     config = grid_configuration(planes, npoints, amplitudes,
                                 GridMode.RECURSIVE, bounds=bounds,
                                 shift_zero=shift_zero)
-    rtol = min(numpy.atleast_1d(config.amplitudes/config.shape))
-    rstep = config.amplitudes
-    if len(numpy.atleast_1d(config.shape)) == 2:
-        angles = numpy.linspace(*config.bounds[1], config.shape[1])
-    else:
-        angles = numpy.linspace(*config.bounds[1], 2)
-    angles = numpy.atleast_1d(angles)
 
     if verbose:
+        rtol = min(numpy.atleast_1d(config.amplitudes/config.shape))
+        if len(numpy.atleast_1d(config.shape)) == 2:
+            nangles = config.shape[1]
+        else:
+            nangles = 2
         print('\nRunning recursive boundary search:')
         if obspt is None:
             print('Element {0}, obspt={1}'.format(ring[0].FamName, 0))
@@ -392,15 +597,16 @@ def recursive_boundary_search(ring, planes, npoints, amplitudes, nturns=1024,
                                                   obspt))
         print('The grid mode is {0}'.format(config.mode))
         print('The planes are {0}'.format(config.planes))
-        print('Number of angles is {0} from {1} to {2} rad'.format(len(angles),
-              angles[0], angles[-1]))
+        print('Number of angles is {0} from {1} to {2} rad'.format(nangles,
+              *config.bounds[1]))
         print('The resolution of the search is {0}'.format(rtol))
-        print('The initial step size is {0}'.format(rstep))
+        print('The initial step size is {0}'.format(config.amplitudes))
         print('The initial offset is {0} with dp={1}'.format(offset, dp))
 
     t0 = time.time()
-    result = search_boundary(config.planesi, angles, rtol, rstep,
-                             nturns, offset, use_mp, **kwargs)
+    search = _recursive_search(config, offset, nturns, divider=divider,
+                               screen_turns=screen_turns)
+    result, = _run_searches(newring, [search], [0], use_mp, **kwargs)
     if verbose:
         print('Calculation took {0}'.format(time.time()-t0))
     return result
@@ -419,12 +625,14 @@ def boundary_search(ring: Lattice, planes, npoints, amplitudes,
     Computes the loss boundary at a single point in the machine
     """
     divider = kwargs.pop('divider', 2)
+    screen_turns = kwargs.pop('screen_turns', None)
     if grid_mode is GridMode.RECURSIVE:
         result = recursive_boundary_search(ring, planes, npoints, amplitudes,
                                            nturns=nturns, obspt=obspt, dp=dp,
                                            offset=offset, bounds=bounds,
                                            use_mp=use_mp, verbose=verbose,
                                            divider=divider,
+                                           screen_turns=screen_turns,
                                            shift_zero=shift_zero,
                                            **kwargs)
     else:
@@ -435,3 +643,55 @@ def boundary_search(ring: Lattice, planes, npoints, amplitudes,
                                       verbose=verbose, shift_zero=shift_zero,
                                       **kwargs)
     return result
+
+
+def boundary_searches(ring: Lattice, scans: Sequence[AcceptanceScan],
+                      nturns: Optional[int] = 1024,
+                      dp: Optional[float] = None,
+                      grid_mode: Optional[GridMode] = GridMode.RADIAL,
+                      use_mp: Optional[bool] = False,
+                      verbose: Optional[bool] = True,
+                      divider: Optional[int] = 2,
+                      screen_turns: Optional[int] = None,
+                      shift_zero: Optional[float] = 1.0e-9,
+                      **kwargs):
+    """
+    Computes the loss boundaries of several scans in a single tracking
+    session. The closed orbit is solved once for all observation points
+    and the particles of all the scans are tracked together on the
+    unrotated ring, each from its own observation point.
+    """
+    scans = [AcceptanceScan(*scan) for scan in scans]
+    refpts = numpy.array([scan.refpt for scan in scans], dtype=numpy.uint32)
+    if numpy.any(refpts >= len(ring)):
+        raise AtError('Observation points must be lower than len(ring)')
+    if all(scan.offset is not None for scan in scans):
+        orbits = {}
+    else:
+        urefs = numpy.unique(refpts)
+        _, orbs = ring.find_orbit(refpts=urefs, dp=dp)
+        orbits = dict(zip(urefs, orbs))
+
+    searches = []
+    for scan in scans:
+        mode = grid_mode if scan.grid_mode is None else scan.grid_mode
+        offset = orbits[scan.refpt] if scan.offset is None else scan.offset
+        config = grid_configuration(scan.planes, scan.npoints,
+                                    scan.amplitudes, mode,
+                                    bounds=scan.bounds,
+                                    shift_zero=shift_zero)
+        if mode is GridMode.RECURSIVE:
+            searches.append(_recursive_search(config, offset, nturns,
+                                              divider=divider,
+                                              screen_turns=screen_turns))
+        else:
+            searches.append(_grid_search(config, offset, nturns))
+
+    if verbose:
+        print('\nRunning {0} boundary searches on {1} observation '
+              'points'.format(len(scans), len(numpy.unique(refpts))))
+    t0 = time.time()
+    results = _run_searches(ring, searches, refpts, use_mp, **kwargs)
+    if verbose:
+        print('Calculation took {0}'.format(time.time()-t0))
+    return results
@@ -3,11 +3,14 @@
 from __future__ import annotations
 
 import time
+import warnings
 from typing import Dict
 
 import numpy
 
+from ..lattice import AtWarning
 from ..lattice.lattice_object import Lattice
+from .boundary import _track_survival, _track_segments
 
 __all__ = ["momaperture_project2start", "projectrefpts"]
 
@@ -199,7 +202,9 @@ def projectrefpts(
 
     Keyword arguments:
       endrefpt: end reference point. Default: end of last ring element
-      use_mp: Default True. See :py:fun:`lattice_track`
+      use_mp: Not supported, a warning is emitted if :py:obj:`True`. The
+        particles of all reference points are tracked together, in less
+        than one turn, in a single process
       group: Default False. The starting point info is removed.
         All tracked particles are grouped together.
       verbose: prints additional info
@@ -210,7 +215,8 @@ def projectrefpts(
                   particles per R references points
                 If the flag 'group' is used the output becomes a
                   (6,N*R,1,1) array with all particles.
-      lostpart: Bool array, True when the particle is lost.
+      lostpart: Bool array, True when the particle is lost before reaching
+                the end reference point.
                 Default (N,R).
                 If the flag 'group' is used the output becomes a
                   (N*R) array
@@ -238,39 +244,32 @@ def projectrefpts(
     verboseprint(f"nparticles={nparticles} per reference point")
     verboseprint(f"Number of reference points {nrps}")
 
-    # default to parallel
-    use_mp = kwargs.pop("use_mp", True)
-    if nparticles == 1:
-        use_mp = False
+    if kwargs.pop("use_mp", False):
+        warnings.warn(AtWarning("use_mp is ignored: the reference points "
+                                "are tracked in a single process"))
+
+    # track all the reference points together on the shared lattice,
+    # wrapping around the ring when the end point is upstream
+    zin = numpy.moveaxis(numpy.reshape(particles, (6, nparticles, nrps)), 2, 1)
+    zin = numpy.reshape(zin, (6, nrps * nparticles))
+    starts = numpy.repeat(numpy.asarray(rps, dtype=int), nparticles)
+    erps = int(erps) % (lenring + 1) if erps >= 0 else int(erps) + lenring
+    wrap = starts > erps
+    if numpy.any(wrap):
+        zin[:, wrap] = _track_segments(ring, zin[:, wrap], starts[wrap],
+                                       numpy.full_like(starts[wrap], lenring))
+        starts[wrap] = 0
+    verboseprint(f"Tracking {nparticles} particles on {nrps} reference points")
+    zflat = _track_segments(ring, zin, starts, numpy.full_like(starts, erps))
+    lostflat = numpy.isnan(zflat[0])
 
     if groupparts:
-        zout = numpy.zeros((6, nparticles * nrps, 1, 1))
-        lostpart = numpy.ones((nparticles * nrps), dtype=bool)
+        zout = numpy.reshape(zflat, (6, nparticles * nrps, 1, 1))
+        lostpart = lostflat
     else:
-        zout = numpy.zeros((6, nparticles, nrps, 1))
-        lostpart = numpy.ones((nparticles, nrps), dtype=bool)
-
-    # first, track the remaining portion of the ring
-    zin = particles.copy()
-    for i in range(nrps):
-        ring_downstream = ring.rotate(rps[i])
-        zaux = numpy.squeeze(zin[:, :, i, 0])
-        verboseprint(
-            f"Tracking {nparticles} particles on reference point {i+1} of {nrps}"
-        )
-        zoaux, _, dout1 = ring_downstream.track(
-            zaux, nturns=1, refpts=erps - rps[i], losses=True, use_mp=use_mp
-        )
-        if groupparts:
-            zout[:, nparticles * i : nparticles * (i + 1), 0, 0] = numpy.reshape(
-                zoaux, (6, nparticles)
-            )
-            lostpart[nparticles * i : nparticles * (i + 1)] = dout1["loss_map"][
-                "islost"
-            ]
-        else:
-            zout[:, :, i, 0] = numpy.reshape(zoaux, (6, nparticles))
-            lostpart[:, i] = dout1["loss_map"]["islost"]
+        zout = numpy.moveaxis(numpy.reshape(zflat, (6, nrps, nparticles)), 1, 2)
+        zout = zout[..., numpy.newaxis]
+        lostpart = numpy.reshape(lostflat, (nrps, nparticles)).T
     return zout, lostpart
 
 
@@ -316,13 +315,9 @@ def multirefpts_track_islost(
 
     rps = refpts
     nrps = len(rps)
-    lostpart = numpy.ones((nparticles * nrps), dtype=bool)
     zin = numpy.zeros((6, nparticles * nrps))
-    zout = numpy.zeros((6, nparticles * nrps))
     tinyoffset = epsilon6d
-
-    # project to the end of the ring
-    erps = len(ring)
+    use_mp = kwargs.pop("use_mp", False)
 
     # first, track the remaining portion of the ring
     zin[:, 0::2] = orbit.T.copy()
@@ -333,21 +328,11 @@ def multirefpts_track_islost(
     zin[2, 1::2] = zin[2, 1::2] + initcoord[1, :]
     zin[4, 0::2] = zin[4, 0::2] + esetptpos
     zin[4, 1::2] = zin[4, 1::2] + esetptneg
-    for i in range(nrps):
-        ring_downstream = ring.rotate(rps[i])
-        zaux = zin[:, (nparticles * i) : (nparticles * (i + 1))]
-        # verboseprint(
-        #    f"Tracking {nparticles} particles on reference point {i+1} of {nrps}"
-        # )
-        zoaux, _, doutaux = ring_downstream.track(
-            zaux, nturns=1, refpts=erps - rps[i], losses=True, **kwargs
-        )
-        zout[:, (nparticles * i) : (nparticles * (i + 1))] = numpy.reshape(
-            zoaux, (6, nparticles)
-        )
-        lostpart[(nparticles * i) : (nparticles * (i + 1))] = doutaux["loss_map"][
-            "islost"
-        ]
+    # all reference points are launched on the same lattice
+    starts = numpy.repeat(numpy.asarray(rps, dtype=int), nparticles)
+    zout = _track_segments(ring, zin, starts,
+                           numpy.full_like(starts, len(ring)), **kwargs)
+    lostpart = numpy.isnan(zout[0])
 
     cntalive = len(lostpart) - sum(lostpart)
     zinaliveaux = zout[:, ~lostpart]
@@ -382,18 +367,12 @@ def multirefpts_track_islost(
             f"{100*len(trackonly_mask)/cntalive:.3f}%",
         )
         verboseprint("".join(outmsg))
-    # track
-    # dummy track to later reuse the ring
-    zaux2 = numpy.array([initcoord[0, 0], 0, initcoord[1, 0], 0, 1e-6, 0]).T
-    ring.track(zaux2, nturns=1)
-    # track non-numerically similar particles
-    _, _, dout_multiturn = ring.track(
-        zinalive_at_ring_end[:, trackonly_mask],
-        nturns=nturns,
-        keep_lattice=True,
-        losses=True,
-        **kwargs,
+    # track non-numerically similar particles, dropping them from the
+    # tracked batch as soon as they are lost
+    alive, _ = _track_survival(
+        zinalive_at_ring_end[:, trackonly_mask], ring, nturns, use_mp, **kwargs
     )
+    dout_multiturn = {"loss_map": {"islost": ~alive}}
     if particles_were_filtered:
         lostpaux = dout_multiturn["loss_map"]["islost"][similarparticles_index]
     else:
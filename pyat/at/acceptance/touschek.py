@@ -6,8 +6,7 @@ import at
 import numpy
 from ..lattice import Lattice, AtError, AtWarning
 import warnings
-from scipy.special import iv
-from scipy import integrate
+from scipy.special import i0e
 from scipy.optimize import fsolve
 from ..constants import qe, clight, _e_radius
 
@@ -79,21 +78,64 @@ def get_beam_sizes(ring, bunch_curr, zn=None, emitx=None,
 def int_piwinski(k, km, B1, B2):
     r"""
     Integrand of the piwinski formula
-    In case the Bessel function has too large value
-    (more than :math:`10^251`) it
-    is substituted by its exponential approximation:
-    :math:`I_0(x)~\frac{\exp(x)}{\sqrt{2 \pi x}}`
+
+    The product :math:`\exp(-B_1 t) I_0(B_2 t)` is evaluated as
+    :math:`\exp(-(B_1-B_2) t) I_{0e}(B_2 t)` with the exponentially scaled
+    Bessel function, which cannot overflow. All arguments may be arrays
+    broadcasting against each other.
     """
     t = numpy.tan(k)**2
     tm = numpy.tan(km)**2
+    return _piwinski_t(t, tm, B1, B2)
+
+
+def _piwinski_t(t, tm, B1, B2):
+    r"""Piwinski integrand expressed with :math:`t=\tan^2(k)`"""
     fact = ((2*t+1)**2*(t/tm/(1+t)-1)/t + t - numpy.sqrt(t*tm*(1+t)) -
             (2+1/(2*t))*numpy.log(t/tm/(1+t)))
-    if B2*t < 500:
-        intp = fact * numpy.exp(-B1*t)*iv(0, B2*t)*numpy.sqrt(1+t)
-    else:
-        intp = fact * numpy.exp(B2*t-B1*t) / \
-             numpy.sqrt(2*numpy.pi*B2*t)*numpy.sqrt(1+t)
-    return intp
+    return fact * numpy.exp(-(B1-B2)*t) * i0e(B2*t) * numpy.sqrt(1+t)
+
+
+def _int_piwinski_quad(km, B1, B2, epsabs=1.0e-16, epsrel=1.0e-12,
+                       npanels=8, order=16, maxpanels=1024):
+    r"""Integral of the Piwinski integrand from ``km`` to :math:`\pi/2`
+
+    Evaluated simultaneously for all reference points with a composite
+    Gauss-Legendre rule in the variable :math:`u=\ln(t/t_m)`. The
+    integrand decays as :math:`\exp(-(B_1-B_2)t)`, so the range is cut
+    where this factor drops below :math:`e^{-200}`. The number of panels
+    is doubled until the estimate is stable within the tolerances. A
+    warning is emitted if *maxpanels* is reached first.
+    """
+    tm = numpy.tan(km)**2
+    decay = B1 - B2
+    umax = numpy.log(numpy.maximum(200.0/(decay*tm), numpy.e))
+    x, w = numpy.polynomial.legendre.leggauss(order)
+
+    def integral(npan):
+        edges = numpy.linspace(0.0, 1.0, npan+1)
+        half = 0.5/npan
+        xs = ((edges[:-1, None] + half) + half*x).ravel()
+        ws = numpy.tile(half*w, npan)
+        u = umax[:, None] * xs
+        t = tm[:, None] * numpy.exp(u)
+        # dk = sqrt(t) / (2*(1+t)) du
+        f = (_piwinski_t(t, tm[:, None], B1[:, None], B2[:, None]) *
+             numpy.sqrt(t) / (2*(1+t)))
+        return umax * (f @ ws)
+
+    val = integral(npanels)
+    converged = False
+    while npanels < maxpanels and not converged:
+        npanels *= 2
+        newval = integral(npanels)
+        converged = numpy.all(numpy.abs(newval-val) <=
+                              numpy.maximum(epsabs, epsrel*numpy.abs(newval)))
+        val = newval
+    if not converged:
+        warnings.warn(AtWarning('Touschek integral not converged with '
+                                '{0} panels'.format(npanels)))
+    return val
 
 
 def _get_vals(ring, rp, ma, emity, bunch_curr, emitx=None,
@@ -138,13 +180,8 @@ def _get_vals(ring, rp, ma, emity, bunch_curr, emitx=None,
         dpp = ma[:, i]
         um = beta2*dpp*dpp
         km = numpy.arctan(numpy.sqrt(um))
-
-        for ii in range(len(rp)):
-            args = (km[ii], B1[ii], B2[ii])
-            val[i, ii], *_ = integrate.quad(int_piwinski, args[0], numpy.pi/2,
-                                            args=args, epsabs=epsabs,
-                                            epsrel=epsrel)
-
+        val[i] = _int_piwinski_quad(km, B1, B2, epsabs=epsabs,
+                                    epsrel=epsrel)
         val[i] *= (_e_radius**2*clight*nc /
                    (8*numpy.pi*gamma2*sigs *
                     numpy.sqrt(numpy.prod(sig2, axis=1) -
@@ -5,3 +5,4 @@ from .wake_elements import *
 from .wake_functions import *
 from .wake_object import *
 from .beam_loading import *
+from .ibs import *
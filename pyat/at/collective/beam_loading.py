@@ -1,12 +1,13 @@
 import numpy
 from enum import IntEnum
-from ..lattice import Lattice, AtWarning
+from ..lattice import Lattice, AtWarning, AtError
 from at.lattice import RFCavity, Collective
 from at.lattice.elements import _array
 from at.lattice.utils import Refpts, uint32_refpts, make_copy
 from at.physics import get_timelag_fromU0
 from at.constants import clight
 from typing import Sequence, Optional, Union
+from collections import namedtuple
 import warnings
 
 class BLMode(IntEnum):
@@ -19,6 +20,11 @@ class CavityMode(IntEnum):
     PASSIVE = 2
 
 
+BLEquilibrium = namedtuple('BLEquilibrium', ['zpos', 'sigma_z', 'z',
+                                             'profile', 'vbeam', 'vgen',
+                                             'vbunch', 'converged', 'niter'])
+
+
 def add_beamloading(ring: Lattice, qfactor: Union[float, Sequence[float]],
                     rshunt: Union[float, Sequence[float]],
                     cavpts: Refpts = None, copy: Optional[bool] = False,
@@ -377,3 +383,231 @@ class BeamLoadingElement(RFCavity, Collective):
         attrs = dict((k, v) for (k, v) in self.items()
                      if not k.startswith('_'))
         return '{0}({1})'.format(self.__class__.__name__, attrs)
+
+
+def _shift_profiles(profile, shift):
+    """Shift each row of profile by an integer number of points,
+    filling with zeros"""
+    npts = profile.shape[1]
+    idx = numpy.arange(npts)[numpy.newaxis, :] + shift[:, numpy.newaxis]
+    rows = numpy.arange(profile.shape[0])[:, numpy.newaxis]
+    inside = (idx >= 0) & (idx < npts)
+    return numpy.where(inside, profile[rows, numpy.clip(idx, 0, npts-1)], 0)
+
+
+def beamloading_equilibrium(ring: Lattice, cavpts: Refpts = None,
+                            npoints: Optional[int] = 201,
+                            nsigma: Optional[float] = 10.0,
+                            maxiter: Optional[int] = 1000,
+                            tol: Optional[float] = 1.0e-10,
+                            relax: Optional[float] = 0.5,
+                            apply: Optional[bool] = True) -> BLEquilibrium:
+    r"""Self-consistent beam loading equilibrium for an arbitrary fill
+    pattern
+
+    The bunch profiles, the beam induced phasors of all beam loading
+    cavities and, for active cavities, the generator voltage are iterated
+    to the fixed point reached by :py:class:`BeamLoadingElement` during
+    tracking. Each bunch profile is the Haissinski solution in the total
+    voltage (generator, beam loading from all bunches and previous turns,
+    other RF cavities) it sees. Main and harmonic, active and passive
+    cavities can be combined.
+
+    The lattice is taken as one turn, as in collective tracking: use
+    ``ring.periodicity = 1`` for a single cell.
+
+    Parameters:
+        ring:       Lattice object with :py:class:`BeamLoadingElement`
+          elements, its fill pattern and beam current
+        cavpts:     refpts of the beam loading elements. If None (default)
+          use all of them. The other RF cavities contribute only their
+          voltage.
+
+    Keyword Arguments:
+        npoints:    Number of points of the profile of each bunch
+        nsigma:     Half-width of the profile grid in units of the natural
+          bunch length
+        maxiter:    Maximum number of iterations
+        tol:        Convergence tolerance on the profiles and voltages
+        relax:      Initial relaxation factor of the fixed point iteration.
+          It is halved each time the residual increases, down to 1/16 of
+          its initial value, and slowly restored while it decreases
+        apply:      If True (default), the equilibrium generator and beam
+          phasors are stored in the beam loading elements so that tracking
+          starts at equilibrium
+
+    Returns:
+        equilibrium (BLEquilibrium): named tuple with fields
+
+          * **zpos** (nbunch,): centroid of each bunch [m]
+          * **sigma_z** (nbunch,): r.m.s. length of each bunch [m]
+          * **z** (nbunch, npoints): profile grid of each bunch [m]
+          * **profile** (nbunch, npoints): normalised line density [1/m]
+          * **vbeam** (ncav, 2): beam voltage (amplitude, phase)
+          * **vgen** (ncav, 2): generator voltage (amplitude, phase)
+          * **vbunch** (ncav, nbunch, 2): voltage seen by each bunch
+            (amplitude, phase)
+          * **converged** (bool): True if the tolerance was reached
+          * **niter** (int): number of iterations
+
+    Example:
+        Start tracking from equilibrium by offsetting the particles of
+        each bunch:
+
+        >>> eq = beamloading_equilibrium(ring)
+        >>> for ib in range(ring.nbunch):
+        ...     rin[5, ib::ring.nbunch] += eq.zpos[ib]
+    """
+    if cavpts is None:
+        cavpts = ring.get_refpts(BeamLoadingElement)
+    else:
+        cavpts = uint32_refpts(cavpts, len(ring))
+    cavs = [ring[ref] for ref in cavpts]
+    if len(cavs) == 0:
+        raise AtError('No BeamLoadingElement found')
+    for cav in cavs:
+        if not isinstance(cav, BeamLoadingElement):
+            raise TypeError('Not a BeamLoadingElement')
+    others = [e for e in ring.select(ring.get_refpts(RFCavity))
+              if not isinstance(e, BeamLoadingElement)]
+
+    energy = ring.energy
+    bc = ring.beta*clight
+    t0 = ring.cell_length/bc
+    u0 = ring.energy_loss/ring.periodicity
+    etac = -ring.radiation_off(copy=True).slip_factor*ring.cell_length
+    # Natural bunch parameters, without the current dependent kicks
+    rp = remove_beamloading(ring, copy=True).radiation_parameters()
+    sigdp2 = etac*rp.sigma_e**2
+    current = ring.bunch_currents
+    nbunch = len(current)
+    taub = ring.bunch_spos/bc
+
+    active = numpy.array([cav._cavitymode == 1 for cav in cavs])
+    frf = numpy.array([cav.Frequency for cav in cavs])
+    lag = numpy.array([getattr(cav, 'TimeLag', 0.0) for cav in cavs])
+    qfactor = numpy.array([cav.Qfactor for cav in cavs])
+    rshunt = numpy.array([cav.Rshunt for cav in cavs])
+    qeff = numpy.array([cav.NormFact*ring.circumference /
+                        (clight*ring.beta**3) for cav in cavs])
+    phicav = numpy.array([cav.Vcav[1] for cav in cavs])
+    vcav = numpy.array([cav.Vcav[0] for cav in cavs])*numpy.exp(1j*phicav)
+    vgen = numpy.array([cav.Vgen[0] if a else 0.0
+                        for cav, a in zip(cavs, active)])
+    psi = numpy.array([cav.Vgen[1] if a else 0.0
+                       for cav, a in zip(cavs, active)])
+
+    def v_others(z):
+        v = numpy.zeros(z.shape)
+        for e in others:
+            v -= e.Voltage*numpy.sin(2*numpy.pi*e.Frequency *
+                                     (z-getattr(e, 'TimeLag', 0.0))/clight -
+                                     getattr(e, 'PhaseLag', 0.0))
+        return v
+
+    def beam_voltage(z, p):
+        # Resonator parameters, detuning follows the generator phase
+        fres = numpy.where(active, frf/(1-numpy.tan(psi)/(2*qfactor)), frf)
+        alpha = numpy.pi*fres/qfactor
+        sres = 2j*numpy.pi*fres - alpha
+        kloss = rshunt*alpha
+        sc = sres[:, None, None]
+        # Charge of each point of each bunch, as in the tracking slices
+        a = -2*(kloss*qeff)[:, None, None]*current[None, :, None]*p[None]
+        ez = numpy.exp(-sc*z[None]/bc)
+        ae = a*ez
+        gb = numpy.sum(ae, axis=-1)
+        # Propagation between bunches, including all previous turns
+        dtau = taub[:, None] - taub[None, :]
+        later = dtau > 0
+        mat = numpy.where(later, numpy.exp(sc*numpy.where(later, dtau, 0)),
+                          0) + numpy.exp(sc*(dtau+t0)) / \
+            (1-numpy.exp(sc*t0))
+        vhead = numpy.einsum('cij,cj->ci', mat, gb)
+        inner = numpy.cumsum(ae, axis=-1) - ae
+        vseen = (vhead[..., None] + inner)/ez + 0.5*a
+        phasor = numpy.sum(gb*numpy.exp(sres[:, None]*(taub[-1]-taub)),
+                           axis=-1)/(1-numpy.exp(sres*t0))
+        return vseen, phasor
+
+    rad = numpy.linspace(-nsigma*rp.sigma_l, nsigma*rp.sigma_l, npoints)
+    du = rad[1] - rad[0]
+    zc = numpy.zeros(nbunch)
+    z = zc[:, None] + rad[None, :]
+    p = numpy.broadcast_to(numpy.exp(-rad**2/2/rp.sigma_l**2),
+                           (nbunch, npoints))
+    p = p/numpy.sum(p, axis=1, keepdims=True)
+    vnorm = max(numpy.amax(numpy.abs(vcav)), u0)
+    converged = False
+    it = 0
+    errprev = numpy.inf
+    relax_min = relax/16
+    relax_max = relax
+    for it in range(1, maxiter+1):
+        vseen, phasor = beam_voltage(z, p)
+        vbunch = numpy.sum(p*vseen, axis=-1)
+        vbeam = vbunch.dot(current)/numpy.sum(current)
+        vg = vcav - vbeam
+        dvgen = numpy.where(active, numpy.abs(vg) - vgen, 0.0)
+        dpsi = numpy.where(active, numpy.angle(numpy.exp(
+            1j*(numpy.angle(vg) - phicav - psi))), 0.0)
+        vgen += relax*dvgen
+        psi += relax*dpsi
+        vtot = numpy.sum(vseen.real, axis=0) + v_others(z)
+        vtot -= numpy.sum((vgen*active)[:, None, None] *
+                          numpy.sin(2*numpy.pi*frf[:, None, None] *
+                                    (z[None]-lag[:, None, None])/clight +
+                                    psi[:, None, None]), axis=0)
+        dv = (vtot-u0)/energy
+        pot = -numpy.concatenate((numpy.zeros((nbunch, 1)),
+                                  numpy.cumsum(0.5*(dv[:, 1:]+dv[:, :-1]),
+                                               axis=1)), axis=1)*du
+        pot /= sigdp2
+        pnew = numpy.exp(-(pot - numpy.amin(pot, axis=1, keepdims=True)))
+        pnew /= numpy.sum(pnew, axis=1, keepdims=True)
+        dp = numpy.amax(numpy.sum(numpy.abs(pnew-p), axis=1))
+        p = (1.0-relax)*p + relax*pnew
+        # Follow the bunch centroids with the profile grids
+        shift = numpy.rint((numpy.sum(p*z, axis=1)-zc)/du).astype(int)
+        if numpy.any(shift != 0):
+            p = _shift_profiles(p, shift)
+            p /= numpy.sum(p, axis=1, keepdims=True)
+            zc = zc + shift*du
+            z = zc[:, None] + rad[None, :]
+        err = max(dp, numpy.amax(numpy.abs(dvgen))/vnorm,
+                  numpy.amax(numpy.abs(dpsi)))
+        if err < tol:
+            converged = True
+            break
+        if err > errprev:
+            relax = max(0.5*relax, relax_min)
+        else:
+            relax = min(1.1*relax, relax_max)
+        errprev = err
+
+    if not converged:
+        warnings.warn(AtWarning('Beam loading equilibrium not converged '
+                                'after {0} iterations'.format(maxiter)))
+
+    vseen, phasor = beam_voltage(z, p)
+    vbunch = numpy.sum(p*vseen, axis=-1)
+    vbeam = vbunch.dot(current)/numpy.sum(current)
+    zpos = numpy.sum(p*z, axis=1)
+    sigma_z = numpy.sqrt(numpy.sum(p*(z-zpos[:, None])**2, axis=1))
+
+    def polar(v):
+        return numpy.stack((numpy.abs(v), numpy.angle(v)), axis=-1)
+
+    vgen_out = numpy.stack((vgen, psi), axis=-1)
+    if apply:
+        for cav, vb, vbb, vph, vgn, a in zip(cavs, polar(vbeam),
+                                             polar(vbunch), polar(phasor),
+                                             vgen_out, active):
+            cav._vbeam = vb.copy()
+            cav._vbeam_phasor = vph.copy()
+            cav._vbunch = numpy.asfortranarray(vbb)
+            if a:
+                cav._vgen = vgn.copy()
+
+    return BLEquilibrium(zpos, sigma_z, z, p/du, polar(vbeam), vgen_out,
+                         polar(vbunch), converged, it)
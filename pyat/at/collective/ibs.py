@@ -0,0 +1,278 @@
+"""
+Intrabeam scattering growth rates and equilibrium emittances
+"""
+import numpy
+from enum import Enum
+from collections import namedtuple
+from typing import Optional
+from warnings import warn
+from scipy.special import ellipk
+from ..lattice import Lattice, AtError, AtWarning, Refpts, All
+from ..constants import qe, clight, _e_radius
+
+__all__ = ['IBSMethod', 'ibs_rates', 'ibs_equilibrium']
+
+IBSEquilibrium = namedtuple('IBSEquilibrium', ['emitx', 'emity', 'sigma_e',
+                                               'sigma_l', 'rates',
+                                               'converged', 'niter'])
+
+
+class IBSMethod(Enum):
+    """Methods for the computation of IBS growth rates"""
+    #: Bjorken-Mtingwa, integral evaluated numerically
+    BM = 'BM'
+    #: Bane high energy approximation
+    BANE = 'BANE'
+
+
+class _IBSOptics(object):
+    """Lattice functions needed for IBS, computed once"""
+    def __init__(self, ring: Lattice, refpts: Refpts = All):
+        refpts = ring.get_uint32_index(refpts)
+        _, _, ld = ring.get_optics(refpts=refpts)
+        self.gamma = ring.gamma
+        self.beta = ring.beta
+        self.frev = ring.revolution_frequency
+        self.spos = ld.s_pos
+        self.bxy = ld.beta
+        axy = ld.alpha
+        dxy = ld.dispersion[:, [0, 2]]
+        dpxy = ld.dispersion[:, [1, 3]]
+        gxy = (1.0 + axy*axy)/self.bxy
+        self.dxy = dxy
+        self.hxy = gxy*dxy*dxy + 2.0*axy*dxy*dpxy + self.bxy*dpxy*dpxy
+        self.phixy = dpxy + axy*dxy/self.bxy
+        # Weights for the average along the lattice
+        if len(self.spos) > 1 and self.spos[-1] > self.spos[0]:
+            ds = numpy.diff(self.spos)
+            w = numpy.zeros(len(self.spos))
+            w[:-1] += 0.5*ds
+            w[1:] += 0.5*ds
+            self.weights = w/numpy.sum(w)
+        else:
+            self.weights = numpy.full(len(self.spos), 1.0/len(self.spos))
+
+
+def _coulog(opt, emit, sigma_e):
+    # b_max: vertical beam size, b_min: r0 beta_x / (gamma^2 emit_x)
+    sigy = numpy.sqrt(opt.bxy[:, 1]*emit[1] +
+                      (opt.dxy[:, 1]*sigma_e)**2)
+    return numpy.log(opt.gamma**2*sigy*emit[0] /
+                     (_e_radius*opt.bxy[:, 0]))
+
+
+def _g_bane(alpha):
+    """g(alpha) = 4 sqrt(alpha)/pi int_0^inf du/sqrt((1+u^2)(alpha^2+u^2))
+    expressed with the complete elliptic integral of the first kind"""
+    a = numpy.minimum(alpha, 1.0/alpha)
+    return 4.0*numpy.sqrt(alpha)/numpy.pi*ellipk(1.0-a*a) * \
+        numpy.where(alpha > 1.0, 1.0/alpha, 1.0)
+
+
+def _bm_integrals(opt, emit, sigma_e, npts):
+    """Bjorken-Mtingwa integrals for the 3 planes at all points"""
+    g = opt.gamma
+    nref = len(opt.spos)
+    bx, by = opt.bxy.T
+    hx, hy = opt.hxy.T
+    phx, phy = opt.phixy.T
+    lp = numpy.zeros((nref, 3, 3))
+    lp[:, 1, 1] = g*g/sigma_e**2
+    lx = numpy.zeros((nref, 3, 3))
+    lx[:, 0, 0] = bx/emit[0]
+    lx[:, 0, 1] = lx[:, 1, 0] = -g*phx*bx/emit[0]
+    lx[:, 1, 1] = g*g*hx/emit[0]
+    ly = numpy.zeros((nref, 3, 3))
+    ly[:, 2, 2] = by/emit[1]
+    ly[:, 1, 2] = ly[:, 2, 1] = -g*phy*by/emit[1]
+    ly[:, 1, 1] = g*g*hy/emit[1]
+    lmat = lp + lx + ly
+    lam, vec = numpy.linalg.eigh(lmat)
+    # Projections of each partial matrix on the eigenvectors of L
+    li = numpy.stack((lx, ly, lp), axis=1)
+    proj = numpy.einsum('nka,nikl,nla->nia', vec, li, vec)
+    tr = numpy.trace(li, axis1=2, axis2=3)
+    # Integration in log(lambda) with the trapezoidal rule: the
+    # integrand is smooth and decays exponentially at both ends
+    t0 = numpy.log(lam[:, 0]) - 25.0
+    t1 = numpy.log(lam[:, 2]) + 35.0
+    h = (t1-t0)/(npts-1)
+    t = t0[:, None] + h[:, None]*numpy.arange(npts)[None, :]
+    x = numpy.exp(t)
+    den = 1.0/(lam[:, None, :] + x[:, :, None])
+    fact = x*numpy.sqrt(x*numpy.prod(den, axis=2))
+    sden = numpy.sum(den, axis=2)
+    integ = fact[:, None, :] * (tr[:, :, None]*sden[:, None, :] -
+                                3.0*numpy.einsum('nia,nta->nit', proj, den))
+    w = numpy.ones(npts)
+    w[[0, -1]] = 0.5
+    return integ.dot(w)*h[:, None]
+
+
+def _local_rates(opt, emit, sigma_e, sigma_l, npart, method, coulog,
+                 npts=400):
+    g = opt.gamma
+    b = opt.beta
+    if coulog is None:
+        coulog = _coulog(opt, emit, sigma_e)
+    # Rates of the emittances: 1/eps deps/dt for x and y,
+    # 1/sigma_e^2 dsigma_e^2/dt for the longitudinal plane
+    if method == IBSMethod.BM:
+        cst = _e_radius**2*clight*npart / \
+            (64.0*numpy.pi**2*b**3*g**4*emit[0]*emit[1]*sigma_l*sigma_e)
+        integ = _bm_integrals(opt, emit, sigma_e, npts)
+        return 8.0*numpy.pi*cst*(coulog*(integ*[1.0, 1.0, 2.0]).T).T
+    elif method == IBSMethod.BANE:
+        bx, by = opt.bxy.T
+        hx, hy = opt.hxy.T
+        sigh = 1.0/numpy.sqrt(1.0/sigma_e**2 + hx/emit[0] + hy/emit[1])
+        a = sigh/g*numpy.sqrt(bx/emit[0])
+        bb = sigh/g*numpy.sqrt(by/emit[1])
+        tp = _e_radius**2*clight*npart*coulog*sigh*_g_bane(a/bb) / \
+            (16.0*g**3*(emit[0]*emit[1])**0.75*sigma_l*sigma_e**3 *
+             (bx*by)**0.25)
+        return numpy.stack((sigma_e**2*hx/emit[0]*tp,
+                            sigma_e**2*hy/emit[1]*tp, 2.0*tp), axis=1)
+    else:
+        raise AtError('Unknown IBS method: {0}'.format(method))
+
+
+def ibs_rates(ring: Lattice, emitx: float, emity: float, sigma_e: float,
+              sigma_l: float, bunch_current: float,
+              method: Optional[IBSMethod] = IBSMethod.BM,
+              coulog: Optional[float] = None,
+              refpts: Optional[Refpts] = All, **kwargs):
+    r"""Intrabeam scattering growth rates
+
+    The rates are evaluated at all points in one vectorised pass over the
+    lattice functions and averaged along the lattice.
+
+    Parameters:
+        ring:           Lattice description
+        emitx:          Horizontal emittance [m]
+        emity:          Vertical emittance [m]
+        sigma_e:        Relative energy spread
+        sigma_l:        Bunch length [m]
+        bunch_current:  Bunch current [A]
+
+    Keyword Args:
+        method:         :py:class:`IBSMethod`. Default: BM
+        coulog:         Coulomb logarithm. Default: computed at each point
+          as :math:`\ln(\gamma^2\sigma_y\epsilon_x/r_e\beta_x)`
+        refpts:         Points where the rates are evaluated. Default: all
+        npts (int):     Number of points for the Bjorken-Mtingwa integral.
+          Default: 400
+
+    Returns:
+        rates:          (3,) average emittance growth rates
+          :math:`\epsilon_x^{-1}d\epsilon_x/dt`,
+          :math:`\epsilon_y^{-1}d\epsilon_y/dt` and
+          :math:`\sigma_\delta^{-2}d\sigma_\delta^2/dt`
+          [:math:`s^{-1}`]
+        local_rates:    (nrefs, 3) growth rates at each refpts
+    """
+    opt = _IBSOptics(ring, refpts)
+    npart = bunch_current/opt.frev/qe
+    local = _local_rates(opt, numpy.array([emitx, emity]), sigma_e, sigma_l,
+                         npart, method, coulog, **kwargs)
+    return opt.weights.dot(local), local
+
+
+def ibs_equilibrium(ring: Lattice, bunch_current: float,
+                    emity: Optional[float] = None,
+                    coupling: Optional[float] = None,
+                    method: Optional[IBSMethod] = IBSMethod.BM,
+                    coulog: Optional[float] = None,
+                    emitx0: Optional[float] = None,
+                    sigma_e0: Optional[float] = None,
+                    sigma_l0: Optional[float] = None,
+                    tol: Optional[float] = 1.0e-6,
+                    maxiter: Optional[int] = 100, **kwargs) -> IBSEquilibrium:
+    r"""Equilibrium emittances in presence of intrabeam scattering
+
+    Iterates
+    :math:`\epsilon=\epsilon_0/(1-\tau/2T_{IBS})` in the 3 planes, where
+    :math:`\tau` are the radiation damping times and :math:`1/T_{IBS}`
+    the emittance growth rates. The bunch length scales with the energy
+    spread. The lattice functions are computed once.
+
+    Parameters:
+        ring:           Lattice description
+        bunch_current:  Bunch current [A]
+
+    Keyword Args:
+        emity:          Zero-current vertical emittance, growing with its
+          own IBS rate
+        coupling:       If given, the vertical emittance is kept equal to
+          coupling * emitx. One of ``emity`` and ``coupling`` is required
+        method:         :py:class:`IBSMethod`. Default: BM
+        coulog:         Coulomb logarithm. Default: computed at each point
+        emitx0:         Zero-current horizontal emittance. Default: from
+          :py:func:`.radiation_parameters`
+        sigma_e0:       Zero-current energy spread. Default: from
+          :py:func:`.radiation_parameters`
+        sigma_l0:       Zero-current bunch length. Default: from
+          :py:func:`.radiation_parameters`
+        tol:            Relative tolerance on the emittances
+        maxiter:        Maximum number of iterations
+        npts (int):     Number of points for the Bjorken-Mtingwa integral.
+          Default: 400
+
+    Returns:
+        equilibrium (IBSEquilibrium): named tuple with fields
+
+          * **emitx**, **emity**: equilibrium emittances [m]
+          * **sigma_e**: equilibrium energy spread
+          * **sigma_l**: equilibrium bunch length [m]
+          * **rates** (3,): growth rates at equilibrium [:math:`s^{-1}`]
+          * **converged** (bool): True if the tolerance was reached
+          * **niter** (int): number of iterations
+    """
+    if emity is None and coupling is None:
+        raise AtError('Either emity or coupling must be given')
+    rp = ring.radiation_parameters()
+    if emitx0 is None:
+        emitx0 = rp.emittances[0]
+    if sigma_e0 is None:
+        sigma_e0 = rp.sigma_e
+    if sigma_l0 is None:
+        sigma_l0 = rp.sigma_l
+    taux, tauy, taup = rp.Tau
+    opt = _IBSOptics(ring.radiation_off(copy=True))
+    npart = bunch_current/opt.frev/qe
+
+    emit0 = numpy.array([emitx0, emity if coupling is None
+                         else coupling*emitx0])
+    emit = emit0.copy()
+    sigma_e = sigma_e0
+    rates = numpy.zeros(3)
+    converged = False
+    it = 0
+    for it in range(1, maxiter+1):
+        sigma_l = sigma_l0*sigma_e/sigma_e0
+        rates = opt.weights.dot(_local_rates(opt, emit, sigma_e, sigma_l,
+                                             npart, method, coulog, **kwargs))
+        fact = 1.0 - 0.5*numpy.array([taux, tauy, taup])*rates
+        if numpy.any(fact <= 0.0):
+            raise AtError('IBS growth rates exceed radiation damping')
+        newemit = emit0/fact[:2]
+        if coupling is not None:
+            newemit[1] = coupling*newemit[0]
+        newsig = sigma_e0/numpy.sqrt(fact[2])
+        err = max(numpy.amax(numpy.abs(newemit/emit - 1.0)),
+                  abs(newsig/sigma_e - 1.0))
+        emit = newemit
+        sigma_e = newsig
+        if err < tol:
+            converged = True
+            break
+    else:
+        warn(AtWarning('IBS equilibrium not converged after {0} '
+                       'iterations'.format(maxiter)))
+
+    return IBSEquilibrium(emit[0], emit[1], sigma_e, sigma_l0*sigma_e/sigma_e0,
+                          rates, converged, it)
+
+
+Lattice.ibs_rates = ibs_rates
+Lattice.ibs_equilibrium = ibs_equilibrium
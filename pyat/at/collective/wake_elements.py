@@ -261,6 +261,100 @@ class LongResonatorElement(ResonatorElement):
                                                    qfactor, rshunt, **kwargs)
 
 
+class PhasorResonatorElement(Collective, Element):
+    """Class to generate a set of longitudinal resonators using the passmethod
+    PhasorResonatorPass
+
+    The voltage induced by the beam in each resonator mode is computed with
+    the phasor method: all modes share the same slicing of the beam and are
+    propagated together from slice to slice, which is adapted to high-Q
+    resonators (HOMs) acting over many bunches and turns.
+    """
+    _BUILD_ATTRIBUTES = Element._BUILD_ATTRIBUTES
+    default_pass = {False: 'IdentityPass', True: 'PhasorResonatorPass'}
+    _conversions = dict(Element._conversions, _nslice=int, _nturns=int,
+                        _nmodes=int, _wakefact=float, _beta=float,
+                        NormFact=float,
+                        ResFrequency=lambda v: _array(v),
+                        Qfactor=lambda v: _array(v),
+                        Rshunt=lambda v: _array(v),
+                        ZCuts=lambda v: _array(v))
+
+    def __init__(self, family_name: str, ring: Lattice, frequency, qfactor,
+                 rshunt, **kwargs):
+        r"""
+        Parameters:
+            family name:    Element name
+            ring:           Lattice in which the element will be inserted
+            frequency:      Resonator frequencies [Hz]
+            qfactor:        Q factors
+            rshunt:         Shunt impedances [:math:`\Omega`]
+
+        *frequency*, *qfactor* and *rshunt* may be scalars or arrays with
+        one value per resonator mode.
+
+        Keyword Arguments:
+            Nslice (int):       Number of slices per bunch. Default: 101
+            ZCuts:              Limits for fixed slicing, default is adaptive
+            NormFact (float):   Normalization factor. Default: 1
+"""
+        kwargs.setdefault('PassMethod', self.default_pass[True])
+        zcuts = kwargs.pop('ZCuts', None)
+        frequency, qfactor, rshunt = numpy.broadcast_arrays(
+            numpy.atleast_1d(frequency), qfactor, rshunt)
+        self.ResFrequency = frequency
+        self.Qfactor = qfactor
+        self.Rshunt = rshunt
+        self.NormFact = kwargs.pop('NormFact', 1.0)
+        self._nmodes = len(self.ResFrequency)
+        self._beta = ring.beta
+        self._wakefact = - ring.circumference/(clight *
+                                               ring.energy*ring.beta**3)
+        self._nslice = kwargs.pop('Nslice', 101)
+        self._nturns = 1
+        self._turnhistory = None    # Defined here to avoid warning
+        self.clear_history(ring=ring)
+        if zcuts is not None:
+            self.ZCuts = zcuts
+        super(PhasorResonatorElement, self).__init__(family_name, **kwargs)
+
+    def clear_history(self, ring=None):
+        if ring is not None:
+            self._nbunch = ring.nbunch
+        tl = self._nturns*self._nslice*self._nbunch
+        self._turnhistory = numpy.zeros((tl, 4), order='F')
+        self._vbeam_phasor = numpy.zeros((self._nmodes, 2), order='F')
+        self._vbeam = numpy.zeros((self._nmodes, 2), order='F')
+
+    @property
+    def Nslice(self):
+        """Number of slices per bunch"""
+        return self._nslice
+
+    @Nslice.setter
+    def Nslice(self, nslice):
+        self._nslice = nslice
+        self.clear_history()
+
+    @property
+    def TurnHistory(self):
+        """Turn history of the slices center of mass"""
+        return self._turnhistory
+
+    @property
+    def Vbeam(self):
+        """Beam-averaged induced voltage of each mode (amplitude, phase)"""
+        return self._vbeam
+
+    def __repr__(self):
+        """Simplified __repr__ to avoid errors due to arguments
+        not defined as attributes
+        """
+        attrs = dict((k, v) for (k, v) in self.items()
+                     if not k.startswith('_'))
+        return '{0}({1})'.format(self.__class__.__name__, attrs)
+
+
 class ResWallElement(WakeElement):
     """Class to generate a resistive wall element, inherits from WakeElement
        additional argument are yokoya_factor, length, pipe radius, conductivity
@@ -12,6 +12,21 @@ __all__ = ['frequency_control',
            'get_rf_timelag', 'set_rf_timelag', 'set_cavity', 'Frf']
 
 
+def _stack_results(results):
+    """Stack the results of successive calls"""
+    first = results[0]
+    if isinstance(first, tuple):
+        return tuple(_stack_results(list(r)) for r in zip(*results))
+    try:
+        stacked = numpy.stack(results)
+    except ValueError as exc:
+        raise AtError('The results for an array of dp, dct or df cannot be '
+                      'combined: call the function for each value') from exc
+    if isinstance(first, numpy.recarray):
+        stacked = stacked.view(numpy.recarray)
+    return stacked
+
+
 def frequency_control(func):
     r""" Function to be used as decorator for
     :pycode:`func(ring, *args, **kwargs)`
@@ -19,10 +34,12 @@ def frequency_control(func):
     If :pycode:`ring.is_6d` is :py:obj:`True` **and** *dp*, *dct* or *df*
     is specified in *kwargs*, make a copy of *ring* with a modified
     RF frequency, remove *dp*, *dct* or *df* from *kwargs* and call
-    *func* with the modified *ring*.
+    *func* with the modified *ring*. For arrays of *dp*, *dct* or *df*,
+    *func* is called for each value and the results are stacked.
 
     If :pycode:`ring.is_6d` is :py:obj:`False` **or** no *dp*, *dct* or
-    *df* is specified in *kwargs*, *func* is called unchanged.
+    *df* is specified in *kwargs*, *func* is called unchanged. Arrays of
+    *dp*, *dct* or *df* are then passed unchanged: *func* must process them.
 
     Examples:
 
@@ -41,6 +58,12 @@ def frequency_control(func):
                 v = kwargs.pop(key, None)
                 if v is not None:
                     momargs[key] = v
+            if any(numpy.ndim(v) > 0 for v in momargs.values()):
+                # Each value needs its own RF frequency
+                keys = list(momargs)
+                return _stack_results(
+                    [wrapper(ring, *args, **dict(zip(keys, vals)), **kwargs)
+                     for vals in numpy.broadcast(*momargs.values())])
             if len(momargs) > 0:
                 frequency = ring.get_revolution_frequency(**momargs) \
                             * ring.harmonic_number
@@ -640,6 +640,60 @@ class SliceMoments(Element):
         self._endturn = value
 
 
+class TuneMonitor(Element):
+    """Element estimating the transverse tunes of each particle
+
+    The tunes are computed during tracking from the phase advance per turn
+    in normalised coordinates, averaged with smooth weights (weighted
+    Birkhoff average) over *NWindows* consecutive windows of turns. The
+    turn-by-turn coordinates are not stored.
+    """
+
+    _BUILD_ATTRIBUTES = Element._BUILD_ATTRIBUTES + ['Beta', 'Alpha']
+    _conversions = dict(Element._conversions, NWindows=int,
+                        Beta=lambda v: _array(v, (2,)),
+                        Alpha=lambda v: _array(v, (2,)),
+                        ClosedOrbit=lambda v: _array(v, (4,)))
+
+    def __init__(self, family_name: str, beta, alpha, **kwargs):
+        """
+        Args:
+            family_name:    Name of the element
+            beta:           (2,) horizontal and vertical beta functions at
+              the monitor
+            alpha:          (2,) horizontal and vertical alpha functions at
+              the monitor
+
+        Keyword arguments:
+            ClosedOrbit:    (4,) transverse closed orbit at the monitor.
+              Default: zero
+            NWindows:       Number of windows in which the tracked turns
+              are divided. Default: 2
+
+        Default PassMethod: ``TuneMonitorPass``
+        """
+        kwargs.setdefault('PassMethod', 'TuneMonitorPass')
+        kwargs.setdefault('ClosedOrbit', numpy.zeros(4))
+        kwargs.setdefault('NWindows', 2)
+        super(TuneMonitor, self).__init__(family_name, Beta=beta,
+                                          Alpha=alpha, **kwargs)
+        self.set_buffers(self.NWindows, 1)
+
+    def set_buffers(self, nturns, npart):
+        self._phase = numpy.zeros((2, npart), order='F')
+        self._sums = numpy.zeros((2, npart, self.NWindows), order='F')
+        wlength = nturns // self.NWindows
+        t = numpy.arange(1, wlength) / wlength
+        self._wsum = numpy.sum(numpy.exp(-1.0 / (t * (1.0 - t))))
+
+    @property
+    def tunes(self):
+        """(2, npart, NWindows) fractional tunes of each particle in each
+        window. Lost particles give NaN"""
+        with numpy.errstate(invalid='ignore', divide='ignore'):
+            return self._sums / (2.0 * numpy.pi * self._wsum)
+
+
 class Aperture(Element):
     """Aperture element"""
 
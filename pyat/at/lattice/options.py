@@ -30,6 +30,7 @@ class _Dst(object):
     omp_num_threads = int(os.environ.get('OMP_NUM_THREADS', '0'))
     patpass_poolsize = multiprocessing.cpu_count()
     patpass_startmethod = None
+    patpass_chunks = 4      # Work units per process in patpass
     _rank = _MPI_rk         # MPI rank
 
     def __setattr__(self, name, value):
@@ -80,6 +81,8 @@ Attributes:
     omp_num_threads:     Default number of OpenMP threads
     patpass_poolsize:    Default size of multiprocessing pool
     patpass_startmethod: Default start method for the multiprocessing
+    patpass_chunks:      Number of work units per process in each turn
+      segment of multiprocessing tracking
     mpi:                 :py:obj:`True` if MPI is active
     openmp:              :py:obj:`True` if OpenMP is active
     cuda:                :py:obj:`True` if CUDA is active
@@ -55,18 +55,6 @@ def _fit_tune_chrom(ring: Lattice, index: int, func,
         data = numpy.subtract(datap, datan)/(2*delta)
         return data
 
-    def _fit(ring, index, func, refpts1, refpts2, newval, J,
-             dp: Optional[float] = 0, regex=False, **kwargs):
-        val = func(ring, dp, **kwargs)
-        dk = numpy.linalg.solve(J, numpy.subtract(newval, val))
-        _set_magnets(ring, refpts1, 'PolynomB', dk[0], index=index,
-                     increment=True, regex=regex, scaling=scaling)
-        _set_magnets(ring, refpts2, 'PolynomB', dk[1], index=index,
-                     increment=True, regex=regex, scaling=scaling)
-        val = func(ring, dp, **kwargs)
-        sumsq = numpy.sum(numpy.square(numpy.subtract(val, newval)))
-        return sumsq
-
     if delta is None:
         delta = 1.e-6 * 10 ** index
         
@@ -74,17 +62,28 @@ def _fit_tune_chrom(ring: Lattice, index: int, func,
                     delta, dp, regex=regex, **kwargs)
     dq2 = _get_resp(ring, index, func, refpts2, 'PolynomB',
                     delta, dp, regex=regex, **kwargs)
-    J = [[dq1[0], dq2[0]], [dq1[1], dq2[1]]]
+    J = numpy.array([[dq1[0], dq2[0]], [dq1[1], dq2[1]]])
 
     n = 0
-    sumsq = tol+1
-    print('Initial value', func(ring, dp, **kwargs))
+    val = numpy.array(func(ring, dp, **kwargs))
+    sumsq = numpy.sum(numpy.square(numpy.subtract(val, newval)))
+    print('Initial value', val)
     while sumsq > tol and n < niter:
-        sumsq = _fit(ring, index, func, refpts1, refpts2, newval,
-                     J, dp=dp, regex=regex, **kwargs)
+        dk = numpy.linalg.solve(J, numpy.subtract(newval, val))
+        _set_magnets(ring, refpts1, 'PolynomB', dk[0], index=index,
+                     increment=True, regex=regex, scaling=scaling)
+        _set_magnets(ring, refpts2, 'PolynomB', dk[1], index=index,
+                     increment=True, regex=regex, scaling=scaling)
+        newv = numpy.array(func(ring, dp, **kwargs))
+        # Broyden update of the response matrix: no new derivatives needed
+        dk2 = numpy.dot(dk, dk)
+        if dk2 > 0.0:
+            J += numpy.outer(newv - val - J @ dk, dk) / dk2
+        val = newv
+        sumsq = numpy.sum(numpy.square(numpy.subtract(val, newval)))
         print('iter#', n, 'Res.', sumsq)
         n += 1
-    print('Final value', func(ring, dp, **kwargs), '\n')
+    print('Final value', val, '\n')
     return
 
 
@@ -3,12 +3,14 @@ Classes for matching variables and constraints
 """
 from __future__ import annotations
 from itertools import chain
+import multiprocessing
 import numpy as np
 from collections.abc import Sequence, Callable
 from typing import Optional, Union
 from scipy.optimize import least_squares
 from itertools import repeat
-from at.lattice import Lattice, Refpts, bool_refpts
+from warnings import warn
+from at.lattice import Lattice, Refpts, bool_refpts, AtWarning
 from at.physics import get_optics, ohmi_envelope, find_orbit
 
 
@@ -644,11 +646,115 @@ class EnvelopeConstraints(ElementConstraints):
         return (em[ref[self.refpts]] for ref in self.refs), (beamdata,)
 
 
+_globfun: Optional[Callable] = None
+
+
+def _fun_fork(vals):
+    """Single forked evaluation of the residuals"""
+    return _globfun(vals)
+
+
+class _Jacobian(object):
+    """Forward-difference Jacobian of the residuals for :py:func:`.match`
+
+    The columns are optionally distributed over a pool of forked processes.
+    """
+    def __init__(self, fun, diff_step, pool=None):
+        self.fun = fun
+        self.diff_step = diff_step
+        self.pool = pool
+        self.nfull = 0
+        self._lastf = (None, None)  # last evaluated point and residuals
+
+    def residuals(self, x):
+        f = self.fun(x)
+        self._lastf = (x.copy(), f)
+        return f
+
+    def full(self, x, f0):
+        h = self.diff_step * np.where(x >= 0, 1.0, -1.0) * \
+            np.maximum(1.0, np.abs(x))
+        xs = [x + hj * ej for hj, ej in zip(h, np.identity(len(x)))]
+        if self.pool is None:
+            fs = [self.fun(xj) for xj in xs]
+        else:
+            fs = self.pool.map(_fun_fork, xs)
+        self.nfull += 1
+        return np.stack([(fj - f0) / hj for fj, hj in zip(fs, h)], axis=1)
+
+    def __call__(self, x):
+        xf, f = self._lastf
+        if xf is None or not np.array_equal(xf, x):
+            f = self.residuals(x)
+        return self.full(x, f)
+
+
+def _broyden_solve(jac: _Jacobian, x, bounds, max_nfev: int,
+                   xtol: float = 1.0e-10, ftol: float = 1.0e-12,
+                   stall_ratio: float = 0.25):
+    """Damped Gauss-Newton iterations with Broyden updates of the Jacobian
+
+    The Jacobian is updated by rank-one corrections after each successful
+    step. It is fully rebuilt when the cost reduction stalls (ratio of
+    successive costs above *stall_ratio*), when a step computed with an
+    updated Jacobian fails, and before accepting convergence.
+
+    Returns the solution, the number of Broyden updates and a flag telling
+    if the iterations converged before *max_nfev* evaluations.
+    """
+    def converged(dx):
+        return np.linalg.norm(dx) < xtol * (xtol + np.linalg.norm(x))
+
+    x = np.clip(x, *bounds)
+    f = jac.residuals(x)
+    nfev = 1
+    jc = jac.full(x, f)
+    fresh = True
+    nupdate = 0
+    lam = 0.0
+    success = False
+    while nfev < max_nfev:
+        cost = np.dot(f, f)
+        # Levenberg-Marquardt damping, scaled by the column norms
+        damp = np.sqrt(lam) * np.diag(np.linalg.norm(jc, axis=0))
+        a = np.vstack((jc, damp))
+        b = np.concatenate((-f, np.zeros(len(x))))
+        dx = np.linalg.lstsq(a, b, rcond=None)[0]
+        x1 = np.clip(x + dx, *bounds)
+        dx = x1 - x
+        f1 = jac.residuals(x1)
+        nfev += 1
+        cost1 = np.dot(f1, f1)
+        if cost1 < cost:
+            dx2 = np.dot(dx, dx)
+            jc = jc + np.outer(f1 - f - jc @ dx, dx) / dx2
+            nupdate += 1
+            x, f = x1, f1
+            lam = 0.1 * lam if lam > 1.0e-6 else 0.0
+            if converged(dx) or cost - cost1 < ftol * cost:
+                if fresh:
+                    success = True
+                    break
+            elif cost1 < stall_ratio * cost:
+                fresh = False
+                continue
+        elif fresh:
+            if converged(dx):
+                success = True
+                break
+            lam = max(1.0e-3, 10.0 * lam)
+            continue
+        jc = jac.full(x, f)
+        fresh = True
+    return x, nupdate, success
+
+
 def match(ring: Lattice, variables: Sequence[Variable],
           constraints: Sequence[Constraints], verbose: int = 2,
           max_nfev: int = 1000,
           diff_step: float = 1.0e-10,
-          method=None, copy: bool = True):
+          method=None, copy: bool = True,
+          workers: int = 1, broyden: bool = False):
     """Perform matching of constraints by varying variables
 
     Parameters:
@@ -657,9 +763,22 @@ def match(ring: Lattice, variables: Sequence[Variable],
         constraints:        sequence of Constraints objects
         verbose:            Print additional information
         max_nfev:           Maximum number of evaluations
-        diff_step:          Convergence threshold
-        method:
-        copy:
+        diff_step:          Relative step for the finite-difference
+          Jacobian
+        method:             Minimisation method of
+          :py:func:`~scipy.optimize.least_squares`. Default: ``'lm'`` if
+          possible, ``'trf'`` otherwise
+        copy:               If :py:obj:`True`, the variable elements are
+          copied and the input lattice is not modified
+        workers:            Number of processes evaluating the columns of
+          the Jacobian in parallel. Requires the ``fork`` start method: if
+          it is not available (Windows), a warning is emitted and the
+          Jacobian is computed in a single process. Default: 1
+        broyden:            If :py:obj:`True`, replace
+          :py:func:`~scipy.optimize.least_squares` by damped Gauss-Newton
+          iterations where the Jacobian is updated by Broyden rank-one
+          corrections, and fully rebuilt only when convergence stalls.
+          *method* is then ignored. Default: :py:obj:`False`
     """
     def fun(vals):
         for value, variable in zip(vals, variables):
@@ -698,8 +817,45 @@ def match(ring: Lattice, variables: Sequence[Variable],
         print('\n{} constraints, {} variables, using method {}\n'.
               format(ntargets, len(variables), method))
 
-    least_squares(fun, vini, bounds=bounds, verbose=verbose, max_nfev=max_nfev,
-                  method=method, diff_step=diff_step)
+    if workers > 1 and 'fork' not in multiprocessing.get_all_start_methods():
+        warn(AtWarning('Parallel Jacobian needs the fork start method: '
+                       'using a single process'))
+        workers = 1
+
+    if workers > 1 or broyden:
+        global _globfun
+        pool = None
+        try:
+            if workers > 1:
+                _globfun = fun
+                pool = multiprocessing.get_context('fork').Pool(workers)
+            jac = _Jacobian(fun, diff_step, pool=pool)
+            if broyden:
+                x, nupdate, success = _broyden_solve(jac, np.array(vini),
+                                                     bounds, max_nfev)
+                if not success:
+                    warn(AtWarning('Broyden iterations not converged after '
+                                   '{0} evaluations'.format(max_nfev)))
+                if verbose >= 1:
+                    print('{} full Jacobians, {} Broyden updates'.format(
+                        jac.nfull, nupdate))
+            else:
+                x = least_squares(jac.residuals, vini, jac=jac, bounds=bounds,
+                                  verbose=verbose, max_nfev=max_nfev,
+                                  method=method).x
+        finally:
+            if pool is not None:
+                pool.close()
+                pool.join()
+            _globfun = None
+    else:
+        x = least_squares(fun, vini, bounds=bounds, verbose=verbose,
+                          max_nfev=max_nfev, method=method,
+                          diff_step=diff_step).x
+
+    # Leave the lattice at the solution, whatever the last evaluation was
+    for value, variable in zip(x, variables):
+        variable.set(ring1, value)
 
     if verbose >= 1:
         print(Constraints.header())
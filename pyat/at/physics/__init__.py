@@ -16,4 +16,6 @@ from .radiation import *
 from .ring_parameters import *
 from .nonlinear import *
 from .fastring import *
+from .response_matrix import *
+from .rdt import *
 from .frequency_maps import fmap_parallel_track
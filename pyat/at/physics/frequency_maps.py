@@ -8,11 +8,11 @@ and pyat parallel tracking (patpass)
 # 2023jan16 tracking is parallel (patpass), frequency analysis is serial
 # 2022jun07 serial version
 
-from at.tracking import patpass
-from at.physics import find_orbit
+from at.tracking import patpass, lattice_track
+from at.physics import find_orbit, get_optics
 import numpy
 from warnings import warn
-from at.lattice import AtWarning
+from at.lattice import AtWarning, TuneMonitor
 
 
 # Jaime Coello de Portugal (JCdP) frequency analysis implementation
@@ -21,6 +21,22 @@ from .harmonic_analysis import get_tunes_harmonic
 __all__ = ['fmap_parallel_track']
 
 
+def _diffusion_rows(xcoord, ycoord, xfreqfirst, xfreqlast,
+                    yfreqfirst, yfreqlast, tns):
+    """Output rows of the particles with defined frequencies"""
+    # metric
+    xdiff = xfreqlast - xfreqfirst
+    ydiff = yfreqlast - yfreqfirst
+    with numpy.errstate(divide='ignore', invalid='ignore'):
+        nudiff = 0.5*numpy.log10((xdiff*xdiff + ydiff*ydiff)/tns)
+    # min max diff
+    nudiff = numpy.clip(nudiff, -10, -2)
+    found = numpy.isfinite(xdiff) & numpy.isfinite(ydiff)
+    rows = numpy.stack((xcoord, ycoord, xfreqfirst, yfreqfirst,
+                        xdiff, ydiff, nudiff), axis=1)
+    return rows[found], numpy.count_nonzero(~found)
+
+
 def fmap_parallel_track(ring,
                         coords=[-10, 10, -10, 10],
                         steps=[100, 100],
@@ -30,6 +46,7 @@ def fmap_parallel_track(ring,
                         add_offset6D=numpy.zeros(6),
                         verbose=False,
                         lossmap=False,
+                        method='interp_fft',
                         **kwargs
                         ):
     r"""Computes frequency maps
@@ -56,7 +73,9 @@ def fmap_parallel_track(ring,
     For each yoffset, particle tracking over the whole set of xoffsets is done
     in parallel.
 
-    The frequency analysis uses a library that is not parallelized.
+    The frequency analysis of all the particles of a vertical offset is
+    done in a single call, see :py:func:`.get_tunes_harmonic`. With the
+    ``'naff'`` method, it runs in parallel in the C NAFF library.
 
     The closed orbit is calculated and added to the
     initial particle offset of every particle. Otherwise, one could set
@@ -78,6 +97,16 @@ def fmap_parallel_track(ring,
         add_offset6D: default numpy.zeros((6,1))
         verbose:  prints additional info
         lossmap:  default false
+        method:   frequency analysis method, ``'interp_fft'`` (default),
+          ``'naff'``, ``'fft'`` or ``'phase_advance'``.
+          See :py:func:`.get_tunes_harmonic`. NAFF uses a Hann window and
+          is more accurate than the interpolated FFT, but it gives
+          slightly different tunes.
+          ``'phase_advance'`` tracks the whole grid in a single call and
+          computes the tunes during tracking with a
+          :py:class:`.TuneMonitor`: no turn-by-turn data is stored. The
+          tunes are then given in [0, 1[ instead of being folded in
+          [0, 0.5]
     Optional:
         pool_size:number of processes. See :py:func:`.patpass`
 
@@ -95,7 +124,9 @@ def fmap_parallel_track(ring,
        points with NaN tracking results or non-defined frequency in x,y
        are ignored.
 
-    .. warning:: loss map format is experimental
+    .. warning:: loss map format is experimental. With
+       ``method='phase_advance'``, a single dictionary for the whole grid is
+       returned.
     """
 
     # https://github.com/atcollab/at/pull/608
@@ -169,6 +200,34 @@ def fmap_parallel_track(ring,
 
     print("Start tracking and frequency analysis")
 
+    if method == 'phase_advance':
+        # the whole grid in a single tracking call, the tunes being
+        # accumulated during tracking by a TuneMonitor
+        gx, gy = numpy.meshgrid(ixarray, iyarray)
+        gx = gx.ravel()
+        gy = gy.ravel()
+        z0 = numpy.zeros((gx.size, 6)) + add_offset6D + orbit
+        # add 1 nm to tracking to avoid zeros in array for the ideal lattice
+        z0[:, 0] = z0[:, 0] + xscale*gx + 1e-9
+        z0[:, 2] = z0[:, 2] + yscale*gy + 1e-9
+        _, _, ld = get_optics(ring, refpts=0)
+        mon = TuneMonitor('TuneMonitor', ld.beta[0], ld.alpha[0],
+                          ClosedOrbit=orbit[:4], NWindows=2)
+        kwargs.pop('pool_size', None)
+        _, _, trackdata = lattice_track(list(ring) + [mon], z0.T, nturns,
+                                        refpts=None, losses=lossmap,
+                                        **kwargs)
+        if lossmap:
+            lmap = trackdata['loss_map']
+            loss_map_array = numpy.append(loss_map_array, {
+                name: lmap[name] for name in lmap.dtype.names})
+        (xfreqfirst, xfreqlast), (yfreqfirst, yfreqlast) = \
+            numpy.moveaxis(mon.tunes, 2, 1)
+        rows, nfail = _diffusion_rows(gx, gy, xfreqfirst, xfreqlast,
+                                      yfreqfirst, yfreqlast, tns)
+        verboseprint(nfail, "particles lost or without frequency")
+        return rows, loss_map_array
+
     # tracking in parallel multiple x coordinates with the same y coordinate
     for iy, iy_index in zip(iyarray, range(leniyarray)):
         print(f'Tracked particles {abs(-100.0*iy_index/leniyarray):.1f} %')
@@ -189,92 +248,28 @@ def fmap_parallel_track(ring,
         else:
             zOUT = patpass(ring, z0.T, nturns, **kwargs)
 
-        # start of serial frequency analysis
-        for ix_index in range(lenixarray):  # cycle over the track results
-            # check if nan in arrays
-            array_sum = numpy.sum(zOUT[:, ix_index, 0])
-            array_has_nan = numpy.isnan(array_sum)
-            if array_has_nan:
-                verboseprint("array has nan")
-                continue
-
-            # get one valid particle
-            z1 = zOUT[:, ix_index, 0]
-
-            # remove mean values
-            # get the first turn in x
-            xfirst = z1[0, 0:tns]
-            xfirst = xfirst - numpy.mean(xfirst)
-            # pxfirst = z1[1, 0:tns]
-            # pxfirst = pxfirst - numpy.mean(pxfirst)
-            # xfirstpart = xfirst + 1j*pxfirst
-            # get the last turns in x
-            xlast = z1[0, tns:2*tns]
-            xlast = xlast - numpy.mean(xlast)
-            # pxlast = z1[1, tns:2*tns]
-            # pxlast = pxlast - numpy.mean(pxlast)
-            # xlastpart = xlast + 1j*pxlast
-
-            # get the first turn in y
-            yfirst = z1[2, 0:tns]
-            yfirst = yfirst - numpy.mean(yfirst)
-            # pyfirst = z1[3, 0:tns]
-            # pyfirst = pyfirst - numpy.mean(pyfirst)
-            # yfirstpart = yfirst + 1j*pyfirst
-            # get the last turns in y
-            ylast = z1[2, tns:2*tns]
-            ylast = ylast - numpy.mean(ylast)
-            # pylast = z1[3, tns:2*tns]
-            # pylast = pylast - numpy.mean(pylast)
-            # ylastpart = ylast + 1j*pylast
-
-            # calc frequency from array,
-            # jump the cycle is no frequency is found
-            xfreqfirst = get_tunes_harmonic(xfirst)
-            if len(xfreqfirst) == 0:
-                verboseprint("  No frequency")
-                continue
-            # xfreqlast  = PyNAFF.naff(xlastpart,tns,1,0,False)
-            xfreqlast = get_tunes_harmonic(xlast)
-            if len(xfreqlast) == 0:
-                verboseprint("  No frequency")
-                continue
-            # yfreqfirst = PyNAFF.naff(yfirstpart,tns,1,0,False)
-            yfreqfirst = get_tunes_harmonic(yfirst)
-            if len(yfreqfirst) == 0:
-                verboseprint("  No frequency")
-                continue
-            # yfreqlast  = PyNAFF.naff(ylastpart,tns,1,0,False)
-            yfreqlast = get_tunes_harmonic(ylast)
-            if len(yfreqlast) == 0:
-                verboseprint("  No frequency")
-                continue
-            verboseprint("NAFF results, (x,y)=",
-                         ixarray[ix_index],
-                         iy,
-                         "\nH freq. first part =\t", xfreqfirst[0],
-                         "\nH freq. last part =\t", xfreqlast[0],
-                         "\nV freq. first part =\t", yfreqfirst[0],
-                         "\nV freq. last part =\t", yfreqlast[0])
-
-            # metric
-            xdiff = xfreqlast[0] - xfreqfirst[0]
-            ydiff = yfreqlast[0] - yfreqfirst[0]
-            nudiff = 0.5*numpy.log10((xdiff*xdiff + ydiff*ydiff)/tns)
-            # min max diff
-            if nudiff > -2:
-                nudiff = -2
-            if nudiff < -10:
-                nudiff = -10
-            # save diff
-            xy_nuxy_lognudiff_array = numpy.append(xy_nuxy_lognudiff_array,
-                                                   [ixarray[ix_index],
-                                                    iy,
-                                                    xfreqfirst[0],
-                                                    yfreqfirst[0],
-                                                    xdiff,
-                                                    ydiff,
-                                                    nudiff])
+        # frequency analysis of all the surviving particles at once
+        valid = ~numpy.any(numpy.isnan(zOUT[:, :, 0, :]), axis=(0, 2))
+        if verbose and not numpy.all(valid):
+            verboseprint(numpy.count_nonzero(~valid), "arrays have nan")
+        z1 = zOUT[:, valid, 0, :]
+        nvalid = z1.shape[1]
+        if nvalid == 0:
+            continue
+        # x first, x last, y first, y last
+        cents = numpy.concatenate((z1[0, :, 0:tns], z1[0, :, tns:2*tns],
+                                   z1[2, :, 0:tns], z1[2, :, tns:2*tns]))
+        freqs = get_tunes_harmonic(cents, method=method,
+                                   hann=(method == 'naff'))
+        xfreqfirst, xfreqlast, yfreqfirst, yfreqlast = \
+            numpy.reshape(freqs, (4, nvalid))
+
+        # save diff
+        row, nfail = _diffusion_rows(ixarray[valid], numpy.full(nvalid, iy),
+                                     xfreqfirst, xfreqlast,
+                                     yfreqfirst, yfreqlast, tns)
+        verboseprint(nfail, "particles without frequency")
+        xy_nuxy_lognudiff_array = numpy.append(xy_nuxy_lognudiff_array, row)
 
     # first element is garbage
     xy_nuxy_lognudiff_array = numpy.delete(xy_nuxy_lognudiff_array, 0)
@@ -8,10 +8,12 @@ from __future__ import annotations
 import numpy
 from warnings import warn
 from scipy.fft import fft, fftfreq
+from scipy.signal import hilbert
 from at.lattice import AtWarning
 from at.lattice import AtError
 import multiprocessing
 from functools import partial
+from .nafflib import naff
 
 
 __all__ = ['get_spectrum_harmonic', 'get_main_harmonic',
@@ -92,6 +94,50 @@ def _interpolated_fft(samples, num_harmonics, fmin, fmax,
     return frequencies, coefficients
 
 
+def _naff(cents, num_harmonics, hann):
+    """NAFF of the rows of ``cents``, analysed in parallel in C"""
+    cents = numpy.atleast_2d(cents)
+    if not numpy.iscomplexobj(cents):
+        # The analytic signal has a single line per frequency instead of
+        # a symmetric pair, which NAFF resolves much more accurately
+        cents = hilbert(cents, axis=-1)
+    cents = numpy.ascontiguousarray(cents, dtype=complex)
+    freq, amp, phase = naff(cents, nfreq=num_harmonics, window=int(hann))
+    return numpy.mod(freq, 1.0), amp, phase
+
+
+def _get_main_naff(cents, num_harmonics=1, hann=False, fmin=0, fmax=1,
+                   remove_mean=True, **kwargs):
+    """Main harmonic of all the rows of ``cents`` in a single NAFF call"""
+    cents = numpy.atleast_2d(cents)
+    if remove_mean:
+        cents = cents - numpy.mean(cents, axis=1, keepdims=True)
+    freq, amp, phase = _naff(cents, num_harmonics, hann)
+    inrange = (freq >= fmin) & (freq <= fmax)
+    imax = numpy.argmax(numpy.where(inrange, amp, -1.0), axis=1)
+    rows = numpy.arange(freq.shape[0])
+    found = inrange[rows, imax]
+    # Signals containing NaN (lost particles) are reported separately
+    lost = ~numpy.all(numpy.isfinite(cents), axis=1)
+    if numpy.any(lost):
+        msg = ('{0}/{1} signals contain NaN values, '
+               'no harmonic returned'.format(numpy.count_nonzero(lost),
+                                             len(lost)))
+        warn(AtWarning(msg))
+    missing = ~(found | lost)
+    found &= ~lost
+    if numpy.any(missing):
+        msg = ('No harmonic found within range for {0}/{1} signals, '
+               'consider extending it or increase num_harmonics'.format(
+                   numpy.count_nonzero(missing), len(found)))
+        warn(AtWarning(msg))
+
+    def select(v):
+        return numpy.where(found, v[rows, imax], numpy.nan)
+
+    return select(freq), select(amp), select(phase)
+
+
 def get_spectrum_harmonic(cent: numpy.ndarray, method: str = 'interp_fft',
                           num_harmonics: int = 20,
                           hann: bool = False,
@@ -105,18 +151,21 @@ def get_spectrum_harmonic(cent: numpy.ndarray, method: str = 'interp_fft',
 
     Parameters:
         cent:           Centroid motions of the particle
-        method:         ``'interp_fft'`` or ``'interp_fft'``.
+        method:         ``'interp_fft'``, ``'fft'`` or ``'naff'``.
                         Default: ``'interp_fft'``
         num_harmonics:  Number of harmonics to search for with interp_fft
+                        or naff
         fmin:           Lower bound for spectrum search with interp_fft
+                        or naff
         fmax:           Upper bound for spectrum search with interp_fft
+                        or naff
         maxiter:        Multiplies ``num_harmonics`` to define the max.
                         number of iteration for the search
         hann:           Turn on Hanning window. Default: :py:obj:`False`.
                         Ignored for interpolated FFT
         pad_length      Zero pad the input signal.
                         Rounded to the higher power of 2
-                        Ignored for interpolated FFT
+                        Ignored for interpolated FFT and NAFF
         remove_mean:    Remove the mean of the input signal.
                         Default: :py:obj:`True`.
 
@@ -138,6 +187,15 @@ def get_spectrum_harmonic(cent: numpy.ndarray, method: str = 'interp_fft',
                            'interpolated FFT: ignored'))
         ha_tune, ha_amp = _interpolated_fft(cent, num_harmonics,
                                             fmin, fmax, maxiter)
+    elif method == 'naff':
+        if pad_length is not None:
+            warn(AtWarning('Padding not efficient for NAFF: ignored'))
+        freq, amp, phase = (v[0] for v in _naff(cent, num_harmonics, hann))
+        msk = (freq >= fmin) & (freq <= fmax)
+        if not numpy.any(msk):
+            raise AtError('No harmonic found within range, '
+                          'consider extending it or increase num_harmonics')
+        return freq[msk], amp[msk], phase[msk]
     elif method == 'fft':
         if hann:
             cent *= numpy.hanning(lc)
@@ -231,7 +289,7 @@ def get_main_harmonic(cents: numpy.ndarray, method: str = 'interp_fft',
 
     Parameters:
         cents:          Centroid motions of the particle
-        method:         ``'interp_fft'`` or ``'fft'``.
+        method:         ``'interp_fft'``, ``'fft'`` or ``'naff'``.
                         Default: ``'interp_fft'``
         fmin:           Lower bound for tune search
         fmax:           Upper bound for tune search
@@ -274,7 +332,14 @@ def get_main_harmonic(cents: numpy.ndarray, method: str = 'interp_fft',
          However, it is possible that the maximum of the interpolated
          FFT does not correspond to the maximum of the raw FFT, in which case
          ``num_harmonics`` has to be increased to get the correct peak.
+       * For the method ``'naff'``, all signals are analysed in a single
+         call to the C NAFF library, in parallel if OpenMP is enabled.
+         *use_mp* is ignored. Real signals are converted to their analytic
+         signal. The Hann window is recommended.
     """
+    if method == 'naff':
+        return _get_main_naff(cents, num_harmonics=num_harmonics, hann=hann,
+                              fmin=fmin, fmax=fmax, remove_mean=remove_mean)
     if use_mp:
         tunes, amps, phases = _get_main_multi(cents,
                                               num_harmonics=num_harmonics,
@@ -311,7 +376,7 @@ def get_tunes_harmonic(cents: numpy.ndarray, method: str = 'interp_fft',
 
     Parameters:
         cents:          Centroid motions of the particle
-        method:         ``'interp_fft'`` or ``'fft'``.
+        method:         ``'interp_fft'``, ``'fft'`` or ``'naff'``.
                         Default: ``'interp_fft'``
         fmin:           Lower bound for tune search
         fmax:           Upper bound for tune search
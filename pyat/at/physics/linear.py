@@ -115,20 +115,23 @@ def _closure(m22):
 # noinspection PyShadowingNames,PyPep8Naming
 def _tunes(ring, **kwargs):
     """"""
+    def tunes_of(mt):
+        try:
+            _, vps = a_matrix(mt)
+            return numpy.mod(numpy.angle(vps) / 2.0 / pi, 1.0)
+        except AtError:
+            warnings.warn(AtWarning('Unstable ring'))
+            return numpy.full(nd, numpy.nan)
+
     if ring.is_6d:
         nd = 3
         mt, _ = find_m66(ring, **kwargs)
     else:
         nd = 2
         mt, _ = find_m44(ring, **kwargs)
-    try:
-        _, vps = a_matrix(mt)
-        tunes = numpy.mod(numpy.angle(vps) / 2.0 / pi, 1.0)
-    except AtError:
-        warnings.warn(AtWarning('Unstable ring'))
-        tunes = numpy.empty(nd)
-        tunes[:] = numpy.nan
-    return tunes
+    if mt.ndim > 2:         # Stacked 1-turn matrices
+        return numpy.array([tunes_of(m) for m in mt])
+    return tunes_of(mt)
 
 
 def _analyze2(mt, ms):
@@ -426,12 +429,12 @@ def _linopt(ring: Lattice, analyze, refpts=None, dp=None, dct=None, df=None,
         datas = datas + (dds,)
         return chrom, data0, datas
 
-    def unwrap(mu):
-        """Remove the phase jumps"""
-        dmu = numpy.diff(numpy.concatenate((numpy.zeros((1, dms)),
-                                            mu)), axis=0)
-        jumps = dmu < -1.e-3
-        mu += numpy.cumsum(jumps, axis=0) * 2.0 * numpy.pi
+    if any(numpy.ndim(v) > 0 for v in (dp, dct, df)):
+        return _linopt_multi(ring, analyze, refpts=refpts, dp=dp, dct=dct,
+                             df=df, orbit=orbit, twiss_in=twiss_in,
+                             get_chrom=get_chrom, get_w=get_w,
+                             keep_lattice=keep_lattice, mname=mname,
+                             add0=add0, adds=adds, cavpts=cavpts, **kwargs)
 
     dp_step = kwargs.get('DPStep', DConstant.DPStep)
     addtype = kwargs.pop('addtype', [])
@@ -525,22 +528,117 @@ def _linopt(ring: Lattice, analyze, refpts=None, dp=None, dct=None, df=None,
     else:
         chrom = numpy.nan
 
+    return _linopt_output(dms, nrefs, tunes, chrom, damping_times,
+                          dtype + addtype, el0+data0+add0, els+datas+adds)
+
+
+def _linopt_output(dms, nrefs, tunes, chrom, damping_times, dtype,
+                   data0, datas):
+    """Build the output record arrays of _linopt"""
+    def unwrap(mu):
+        """Remove the phase jumps"""
+        dmu = numpy.diff(numpy.concatenate((numpy.zeros((1, dms)),
+                                            mu)), axis=0)
+        jumps = dmu < -1.e-3
+        mu += numpy.cumsum(jumps, axis=0) * 2.0 * numpy.pi
+
     beamdata = numpy.array((tunes, chrom, damping_times),
                            dtype=[('tune', numpy.float64, (dms,)),
                                   ('chromaticity', numpy.float64, (dms,)),
                                   ('damping_time', numpy.float64, (dms,))
                                   ]).view(numpy.recarray)
 
-    dtype = dtype + addtype
-    elemdata0 = numpy.array(el0+data0+add0, dtype=dtype).view(numpy.recarray)
+    elemdata0 = numpy.array(data0, dtype=dtype).view(numpy.recarray)
     elemdata = numpy.recarray((nrefs,), dtype=dtype)
     if nrefs > 0:
-        for name, value in zip(numpy.dtype(dtype).names, els+datas+adds):
+        for name, value in zip(numpy.dtype(dtype).names, datas):
             elemdata[name] = value
         unwrap(elemdata.mu)
     return elemdata0, beamdata, elemdata
 
 
+def _stack_optics(results):
+    """Stack the outputs of _linopt for several momentum deviations"""
+    return tuple(numpy.stack(r).view(numpy.recarray) for r in zip(*results))
+
+
+def _linopt_multi(ring: Lattice, analyze, refpts=None, dp=None, dct=None,
+                  df=None, orbit=None, twiss_in=None, get_chrom=False,
+                  get_w=False, keep_lattice=False, mname='M', add0=(),
+                  adds=(), **kwargs):
+    """Linear optics for an array of dp, dct or df
+
+    For a 4D ring, all orbits and transfer matrices are computed together.
+    Other cases are processed sequentially.
+    """
+    def tunes_of(mt):
+        try:
+            _, vps = a_matrix(mt)
+            return numpy.mod(numpy.angle(vps) / 2.0 / pi, 1.0)
+        except AtError:
+            warnings.warn(AtWarning('Unstable ring'))
+            return numpy.full(mt.shape[0] // 2, numpy.nan)
+
+    if (ring.is_6d or twiss_in is not None or orbit is not None or get_w or
+            len(add0) > 0):
+        values = numpy.broadcast(*(v for v in (dp, dct, df) if v is not None))
+        key = 'dp' if dp is not None else 'dct' if dct is not None else 'df'
+        # Each momentum deviation needs its own RF frequency in 6D
+        fc_linopt = frequency_control(_linopt)
+        return _stack_optics(
+            fc_linopt(ring, analyze, refpts=refpts, orbit=orbit,
+                      twiss_in=twiss_in, get_chrom=get_chrom, get_w=get_w,
+                      keep_lattice=keep_lattice, mname=mname, add0=add0,
+                      adds=adds, **{key: v[0]}, **kwargs) for v in values)
+
+    kwargs.pop('cavpts', None)
+    dp_step = kwargs.get('DPStep', DConstant.DPStep)
+    addtype = kwargs.pop('addtype', [])
+    orbit, _ = find_orbit4(ring, dp=dp, dct=dct, df=df,
+                           keep_lattice=keep_lattice, **kwargs)
+    kwargs['keep_lattice'] = True
+    nv = orbit.shape[0]
+    # Off-momentum orbits for the dispersion
+    dpc = orbit[:, 4]
+    dpud = numpy.concatenate((dpc + 0.5 * dp_step, dpc - 0.5 * dp_step))
+    o0ud, _ = find_orbit4(ring, dp=dpud,
+                          guess=numpy.concatenate((orbit, orbit)), **kwargs)
+    # Propagate all the orbits and matrices
+    mt, ms = find_m44(ring, refpts=refpts, orbit=orbit, **kwargs)
+    o0all, oall = find_orbit4(ring, refpts=refpts,
+                              orbit=numpy.concatenate((orbit, o0ud)),
+                              keep_lattice=True)
+    if get_chrom:
+        mud, _ = find_m44(ring, orbit=o0ud, keep_lattice=True)
+    spos = ring.get_s_pos(refpts)
+    length = get_s_pos(ring, len(ring))[0]
+    orb0, o0up, o0dn = numpy.split(o0all, 3)
+    orbs, oup, odn = numpy.split(oall, 3)
+
+    results = []
+    for i in range(nv):
+        vps, dtype, el0, els, wtype = analyze(mt[i], ms[i])
+        dms = vps.size
+        tunes = tunes_of(mt[i])
+        d0 = (o0up[i] - o0dn[i])[:4] / dp_step
+        ds = (oup[i] - odn[i])[:, :4] / dp_step
+        dtype = dtype + [('dispersion', numpy.float64, (4,)),
+                         ('closed_orbit', numpy.float64, (6,)),
+                         (mname, numpy.float64, (2*dms, 2*dms)),
+                         ('s_pos', numpy.float64)]
+        data0 = (d0, orb0[i], mt[i], length)
+        datas = (ds, orbs[i], ms[i], spos)
+        if get_chrom:
+            deltap = o0up[i, 4] - o0dn[i, 4]
+            chrom = (tunes_of(mud[i]) - tunes_of(mud[nv+i])) / deltap
+        else:
+            chrom = numpy.nan
+        results.append(_linopt_output(dms, orbs.shape[1], tunes, chrom,
+                                      numpy.nan, dtype + addtype,
+                                      el0 + data0, els + datas))
+    return _stack_optics(results)
+
+
 @check_6d(False)
 def linopt2(ring: Lattice, *args, **kwargs):
     r"""Linear analysis of an uncoupled lattice
@@ -928,7 +1026,11 @@ def get_optics(ring: Lattice, refpts: Refpts = None,
           2. an ordered list of such integers without duplicates,
           3. a numpy array of booleans of maximum length len(ring)+1,
              where selected elements are :py:obj:`True`.
-        dp:                     Momentum deviation.
+        dp:                     Momentum deviation. May be an array: for
+          a 4D lattice, the orbits and transfer matrices for all values are
+          then computed in the same tracking calls, for a 6D lattice the
+          values are processed sequentially. The output record arrays get an
+          additional leading dimension.
         method (Callable):      Method for linear optics:
 
           :py:obj:`~.linear.linopt2`: no longitudinal motion, no H/V coupling,
@@ -940,9 +1042,10 @@ def get_optics(ring: Lattice, refpts: Refpts = None,
           motion, normal mode analysis
 
     Keyword Args:
-        dct (float):            Path lengthening. Defaults to :py:obj:`None`
+        dct (float):            Path lengthening. Defaults to :py:obj:`None`.
+          May be an array
         df (float):             Deviation of RF frequency. Defaults to
-          :py:obj:`None`
+          :py:obj:`None`. May be an array
         orbit (Orbit):          Avoids looking for the closed orbit if it is
           already known ((6,) array)
         get_chrom (bool):       Compute chromaticities. Needs computing
@@ -1091,9 +1194,10 @@ def avlinopt(ring, dp, refpts, **kwargs):
              where selected elements are :py:obj:`True`.
 
     Keyword Args:
-        dct (float):            Path lengthening. Defaults to :py:obj:`None`
+        dct (float):            Path lengthening. Defaults to :py:obj:`None`.
+          May be an array
         df (float):             Deviation of RF frequency. Defaults to
-          :py:obj:`None`
+          :py:obj:`None`. May be an array
         orbit (Orbit):          Avoids looking for the closed orbit if it is
           already known ((6,) array)
         get_chrom (bool):       Compute chromaticities. Needs computing
@@ -1141,7 +1245,7 @@ def avlinopt(ring, dp, refpts, **kwargs):
     def get_strength(elem):
         try:
             k = elem.PolynomB[1]
-            if k < 1.e-7:
+            if abs(k) < 1.e-7:
                 k = 0.0
         except (AttributeError, IndexError):
             k = 0.0
@@ -1316,7 +1420,9 @@ def get_tune(ring: Lattice, *, method: str = 'linopt',
 
           ``'interp_fft'`` tracks a single particle and computes the tunes with
           interpolated FFT.
-        dp (float):             Momentum deviation.
+        dp (float):             Momentum deviation. It may be an array.
+          With the ``'linopt'`` method on a 4D lattice, the tunes for all
+          values are computed in the same tracking calls
         dct (float):            Path lengthening.
         df (float):             Deviation of RF frequency.
         orbit (Orbit):          Avoids looking for the closed orbit if it is
@@ -1339,7 +1445,8 @@ def get_tune(ring: Lattice, *, method: str = 'linopt',
         get_integer(bool):   Turn on integer tune (slower)
 
     Returns:
-        tunes (ndarray):        array([:math:`\nu_x,\nu_y`])
+        tunes (ndarray):        array([:math:`\nu_x,\nu_y`]). For an array
+          of dp, (n, 2) array
     """
     # noinspection PyShadowingNames
     def gen_centroid(ring, ampl, nturns, remove_dc, ld):
@@ -8,7 +8,7 @@ from ..lattice import Lattice, Element, DConstant, Refpts, Orbit
 from ..lattice import frequency_control, get_uint32_index
 from ..lattice.elements import Dipole, M66
 from ..tracking import internal_lpass, internal_epass
-from .orbit import find_orbit4, find_orbit6
+from .orbit import find_orbit4, find_orbit6, _stack, _unstack
 from .amat import jmat, symplectify
 
 __all__ = ['find_m44', 'find_m66', 'find_elem_m66', 'gen_m66_elem']
@@ -16,6 +16,14 @@ __all__ = ['find_m44', 'find_m66', 'find_elem_m66', 'gen_m66_elem']
 _jmt = jmat(2)
 
 
+def _unstack_refs(out_mat, nparts):
+    """(6, n*nparts, nrefs, 1) tracking output to (n, nrefs, 6, nparts)"""
+    out_mat = out_mat[:, :, :, 0]
+    out_mat = out_mat.reshape(6, out_mat.shape[1] // nparts, nparts,
+                              out_mat.shape[-1])
+    return numpy.moveaxis(out_mat, (0, 3), (2, 1))
+
+
 def find_m44(ring: Lattice, dp: float = None, refpts: Refpts = None,
              dct: float = None, df: float = None,
              orbit: Orbit = None, keep_lattice: bool = False, **kwargs):
@@ -37,12 +45,13 @@ def find_m44(ring: Lattice, dp: float = None, refpts: Refpts = None,
 
     Parameters:
         ring:           Lattice description (radiation must be OFF)
-        dp:             Momentum deviation.
+        dp:             Momentum deviation. May be an array: the matrices
+          for all values are then computed in the same tracking calls
         refpts:         Observation points
-        dct:            Path lengthening.
-        df:             Deviation of RF frequency.
+        dct:            Path lengthening. May be an array
+        df:             Deviation of RF frequency. May be an array
         orbit:          Avoids looking for initial the closed orbit if it is
-          already known ((6,) array).
+          already known ((6,) or (n, 6) array).
         keep_lattice:   Assume no lattice change since the previous tracking.
           Default: :py:obj:`False`
 
@@ -59,11 +68,14 @@ def find_m44(ring: Lattice, dp: float = None, refpts: Refpts = None,
         ms:     4x4 transfer matrices between the entrance of the first
           element and each element indexed by refpts: (Nrefs, 4, 4) array
 
+        For n orbits or off-momentum values, *m44* is a (n, 4, 4) array and
+        *ms* a (n, Nrefs, 4, 4) array.
+
     See also:
          :py:func:`find_m66`, :py:func:`.find_orbit4`
     """
 
-    def mrotate(m):
+    def mrotate(m, m44):
         m = numpy.squeeze(m)
         return m.dot(m44.dot(_jmt.T.dot(m.T.dot(_jmt))))
 
@@ -80,25 +92,29 @@ def find_m44(ring: Lattice, dp: float = None, refpts: Refpts = None,
         numpy.concatenate((0.5 * numpy.diag(scaling), numpy.zeros((2, 4)))))
     dmat = numpy.concatenate((dg, -dg), axis=1)
     # Add the deltas to multiple copies of the closed orbit
-    in_mat = orbit.reshape(6, 1) + dmat
+    orbits = numpy.reshape(orbit, (-1, 6))
+    in_mat = _stack(orbits, dmat)
 
     refs = get_uint32_index(ring, refpts)
-    out_mat = numpy.rollaxis(
-        numpy.squeeze(internal_lpass(ring, in_mat, refpts=refs,
-                                     keep_lattice=keep_lattice), axis=3), -1
-    )
-    # out_mat: 8 particles at n refpts for one turn
+    out_mat = _unstack_refs(internal_lpass(ring, in_mat, refpts=refs,
+                                           keep_lattice=keep_lattice), 8)
+    # out_mat: 8 particles per orbit at n refpts for one turn
     # (x + d) - (x - d) / d
-    m44 = (in_mat[:4, :4] - in_mat[:4, 4:]) / scaling
+    in_mat = _unstack(in_mat, 8)
+    m44 = (in_mat[:, :4, :4] - in_mat[:, :4, 4:]) / scaling
 
     if len(refs) > 0:
-        mstack = (out_mat[:, :4, :4] - out_mat[:, :4, 4:]) / scaling
+        mstack = (out_mat[..., :4, :4] - out_mat[..., :4, 4:]) / scaling
         if full:
-            mstack = numpy.stack([mrotate(mat) for mat in mstack], axis=0)
+            mstack = numpy.stack([numpy.stack([mrotate(m, mt) for m in ms])
+                                  for mt, ms in zip(m44, mstack)], axis=0)
     else:
-        mstack = numpy.empty((0, 4, 4), dtype=float)
+        mstack = numpy.empty((len(orbits), 0, 4, 4), dtype=float)
 
-    return m44, mstack
+    if numpy.ndim(orbit) == 1:
+        return m44[0], mstack[0]
+    else:
+        return m44, mstack
 
 
 @frequency_control
@@ -117,7 +133,7 @@ def find_m66(ring: Lattice, refpts: Refpts = None,
         ring:           Lattice description
         refpts:         Observation points
         orbit:          Avoids looking for initial the closed orbit if it is
-          already known ((6,) array).
+          already known ((6,) or (n, 6) array).
         keep_lattice:   Assume no lattice change since the previous tracking.
           Default: :py:obj:`False`
 
@@ -132,6 +148,10 @@ def find_m66(ring: Lattice, refpts: Refpts = None,
         ms:     6x6 transfer matrices between the entrance of the first
           element and each element indexed by refpts: (Nrefs, 6, 6) array
 
+        For n orbits, *m66* is a (n, 6, 6) array and *ms* a (n, Nrefs, 6, 6)
+        array. *dp*, *dct* or *df* may also be arrays. For a 6D lattice,
+        the values are processed sequentially.
+
     See also:
          :py:func:`find_m44`, :py:func:`.find_orbit6`
     """
@@ -153,23 +173,26 @@ def find_m66(ring: Lattice, refpts: Refpts = None,
     dg = numpy.asfortranarray(0.5 * numpy.diag(scaling))
     dmat = numpy.concatenate((dg, -dg), axis=1)
 
-    in_mat = orbit.reshape(6, 1) + dmat
+    orbits = numpy.reshape(orbit, (-1, 6))
+    in_mat = _stack(orbits, dmat)
 
     refs = get_uint32_index(ring, refpts)
-    out_mat = numpy.rollaxis(
-        numpy.squeeze(internal_lpass(ring, in_mat, refpts=refs,
-                                     keep_lattice=keep_lattice), axis=3), -1
-    )
-    # out_mat: 12 particles at n refpts for one turn
+    out_mat = _unstack_refs(internal_lpass(ring, in_mat, refpts=refs,
+                                           keep_lattice=keep_lattice), 12)
+    # out_mat: 12 particles per orbit at n refpts for one turn
     # (x + d) - (x - d) / d
-    m66 = (in_mat[:, :6] - in_mat[:, 6:]) / scaling
+    in_mat = _unstack(in_mat, 12)
+    m66 = (in_mat[:, :, :6] - in_mat[:, :, 6:]) / scaling
 
     if len(refs) > 0:
-        mstack = (out_mat[:, :, :6] - out_mat[:, :, 6:]) / scaling
+        mstack = (out_mat[..., :6] - out_mat[..., 6:]) / scaling
     else:
-        mstack = numpy.empty((0, 6, 6), dtype=float)
+        mstack = numpy.empty((len(orbits), 0, 6, 6), dtype=float)
 
-    return m66, mstack
+    if numpy.ndim(orbit) == 1:
+        return m66[0], mstack[0]
+    else:
+        return m66, mstack
 
 
 def find_elem_m66(elem: Element, orbit: Orbit = None, **kwargs):
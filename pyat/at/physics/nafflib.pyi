@@ -0,0 +1,6 @@
+"""Stub file for the 'nafflib' extension"""
+
+import numpy as np
+
+def naff(data: np.ndarray, nfreq: int = 1,
+         window: int = 1) -> tuple[np.ndarray, np.ndarray, np.ndarray]: ...
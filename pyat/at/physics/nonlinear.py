@@ -4,11 +4,12 @@ Non-linear optics
 import numpy
 from typing import Optional, Sequence
 from scipy.special import factorial
-from ..lattice import Element, Lattice
+from ..lattice import Element, Lattice, Sextupole, Octupole
 from ..tracking import internal_lpass
 from .orbit import Orbit, find_orbit
 from .linear import get_tune, get_chrom, linopt6
 from .harmonic_analysis import get_tunes_harmonic
+from .rdt import RDTType, get_rdts
 
 __all__ = ['detuning', 'chromaticity', 'gen_detuning_elem', 'tunes_vs_amp']
 
@@ -74,7 +75,8 @@ def tunes_vs_amp(ring: Lattice, amp: Optional[Sequence[float]] = None,
 def detuning(ring: Lattice,
              xm: Optional[float] = 0.3e-4, ym: Optional[float] = 0.3e-4,
              npoints: Optional[int] = 3,
-             nturns: Optional[int] = 512, **kwargs):
+             nturns: Optional[int] = 512, analytic: bool = False,
+             nslices: int = 8, **kwargs):
     """Computes the tunes for a sequence of amplitudes
 
     This function uses :py:func:`tunes_vs_amp` to compute the tunes for
@@ -82,12 +84,23 @@ def detuning(ring: Lattice,
     the detuning coefficiant dQx/dx, dQy/dx, dQx/dy, dQy/dy and the
     qx, qy arrays versus x, y arrays
 
+    With *analytic*, the detuning coefficients are instead computed by
+    perturbation theory from the sextupole and octupole strengths (see
+    :py:func:`.get_rdts`), without tracking. They are first-order in the
+    octupole strengths and second-order in the sextupole strengths, and the
+    tunes are linear functions of the squared amplitudes. This is cheap
+    enough for matching constraints, with an accuracy of a few percent.
+
     Parameters:
         ring:       Lattice description
         xm:         Maximum x amplitude
         ym:         Maximum y amplitude
         npoints:    Number of points in each plane
         nturns:     Number of turns for tracking
+        analytic:   Compute the detuning coefficients by perturbation
+          theory instead of tracking
+        nslices:    For *analytic* only: number of slices of thick
+          sextupoles and octupoles
         method:     ``'laskar'`` or ``'fft'``. Default: ``'laskar'``
         num_harmonics:  Number of harmonic components to compute
                        (before mask applied)
@@ -105,7 +118,7 @@ def detuning(ring: Lattice,
         y (ndarray): y amplitudes (npoints, )
         q_dy (ndarray): qx, qy tunes as a function of y amplitude (npoints, 2)
     """
-    lindata0, _, _ = linopt6(ring)
+    lindata0, bd, _ = linopt6(ring)
     gamma = (1 + lindata0.alpha * lindata0.alpha) / lindata0.beta
 
     x = numpy.linspace(-xm, xm, npoints)
@@ -113,6 +126,19 @@ def detuning(ring: Lattice,
     x2 = x * x
     y2 = y * y
 
+    if analytic:
+        nonlin = ring.get_bool_index(Sextupole) | ring.get_bool_index(Octupole)
+        sliced = ring.slice_elements(nonlin, slices=nslices)
+        rdts = get_rdts(sliced, refpts=0, rdt_type=RDTType.TUNESHIFTS,
+                        orbit=lindata0.closed_orbit)[0]
+        q0 = numpy.array([bd.tune[:2], bd.tune[:2]])
+        q1 = numpy.array([[rdts.dnux_dJx, rdts.dnux_dJy],
+                          [rdts.dnux_dJy, rdts.dnuy_dJy]])
+        # Action of the particles: J = gamma*x**2/2
+        q_dx = q0[0] + numpy.outer(0.5 * gamma[0] * x2, q1[0])
+        q_dy = q0[1] + numpy.outer(0.5 * gamma[1] * y2, q1[1])
+        return q0, q1, x, q_dx, y, q_dy
+
     q_dx = tunes_vs_amp(ring, amp=x, dim=0, nturns=nturns, **kwargs)
     q_dy = tunes_vs_amp(ring, amp=y, dim=2, nturns=nturns, **kwargs)
 
@@ -144,7 +170,8 @@ def chromaticity(ring: Lattice, method: Optional[str] = 'linopt',
     Parameters:
         ring:       Lattice description
         method:     ``'linopt'`` (dfault) returns the tunes from the
-          :py:func:`linopt6` function,
+          1-turn transfer matrices. For a 4D lattice, the matrices for all
+          momentum deviations are computed in the same tracking calls,
 
           ``'fft'`` tracks a single particle and computes the tunes with fft,
 
@@ -167,10 +194,14 @@ def chromaticity(ring: Lattice, method: Optional[str] = 'linopt',
         raise ValueError('order should be smaller than npoints-1')
     else:
         dpa = numpy.linspace(-dpm, dpm, npoints)
-        qz = []
-        for dpi in dpa:
-            qz.append(get_tune(ring, method=method, dp=dp+dpi, remove_dc=True,
-                      **kwargs))
+        if method == 'linopt' and not ring.is_6d:
+            # All the 1-turn maps are computed in the same tracking calls
+            qz = get_tune(ring, method=method, dp=dp+dpa, **kwargs)
+        else:
+            qz = []
+            for dpi in dpa:
+                qz.append(get_tune(ring, method=method, dp=dp+dpi,
+                                   remove_dc=True, **kwargs))
         fit = numpy.polyfit(dpa, qz, order)[::-1]
         fitx = fit[:, 0]/factorial(numpy.arange(order + 1))
         fity = fit[:, 1]/factorial(numpy.arange(order + 1))
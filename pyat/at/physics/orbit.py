@@ -12,6 +12,17 @@ import warnings
 __all__ = ['find_orbit4', 'find_sync_orbit', 'find_orbit6', 'find_orbit']
 
 
+def _stack(orbits, delta_matrix):
+    """Add the deltas to multiple copies of (n, 6) orbits"""
+    in_mat = orbits[:, :, numpy.newaxis] + delta_matrix
+    return numpy.asfortranarray(numpy.moveaxis(in_mat, 0, 1).reshape(6, -1))
+
+
+def _unstack(in_mat, nparts):
+    """(6, n*nparts) tracked particles to (n, 6, nparts)"""
+    return numpy.moveaxis(in_mat.reshape(6, -1, nparts), 1, 0)
+
+
 @check_6d(False)
 def _orbit_dp(ring: Lattice, dp: float = None, guess: Orbit = None, **kwargs):
     """Solver for fixed energy deviation"""
@@ -27,6 +38,9 @@ def _orbit_dp(ring: Lattice, dp: float = None, guess: Orbit = None, **kwargs):
     #     squares fitting to determine x when ax = b
     # f(r_n) - r_n is denoted b
     # f'(r_n) is the 4x4 jacobian, denoted j4
+    #
+    # For an array of dp, all the orbits are tracked together and each one
+    # is iterated until its own convergence
     keep_lattice = kwargs.pop('keep_lattice', False)
     convergence = kwargs.pop('convergence', DConstant.OrbConvergence)
     max_iterations = kwargs.pop('max_iterations', DConstant.OrbMaxIter)
@@ -36,38 +50,45 @@ def _orbit_dp(ring: Lattice, dp: float = None, guess: Orbit = None, **kwargs):
     if len(rem) > 0:
         raise AtError(f'Unexpected keywords for orbit_dp: {", ".join(rem)}')
 
-    ref_in = numpy.zeros((6,)) if guess is None else numpy.copy(guess)
-    ref_in[4] = 0.0 if dp is None else dp
+    dps = numpy.atleast_1d(0.0 if dp is None else dp)
+    ref_in = numpy.zeros((dps.size, 6))
+    if guess is not None:
+        ref_in[:] = guess
+    ref_in[:, 4] = dps
 
     scaling = xy_step * numpy.array([1.0, 1.0, 1.0, 1.0])
     delta_matrix = numpy.zeros((6, 5), order='F')
     for i in range(4):
         delta_matrix[i, i] = scaling[i]
     id4 = numpy.asfortranarray(numpy.identity(4))
-    change = 1
+    active = numpy.arange(dps.size)
     itercount = 0
-    while (change > convergence) and itercount < max_iterations:
-        in_mat = ref_in.reshape((6, 1)) + delta_matrix
+    while active.size > 0 and itercount < max_iterations:
+        r_in = ref_in[active]
+        in_mat = _stack(r_in, delta_matrix)
         _ = internal_lpass(ring, in_mat, refpts=[], keep_lattice=keep_lattice)
+        out_mat = _unstack(in_mat, 5)
         # the reference particle after one turn
-        ref_out = in_mat[:, 4]
+        ref_out = out_mat[:, :, 4]
         # 4x4 jacobian matrix from numerical differentiation:
         # f(x+d) - f(x) / d
-        j4 = (in_mat[:4, :4] - in_mat[:4, 4:]) / scaling
+        j4 = (out_mat[:, :4, :4] - out_mat[:, :4, 4:]) / scaling
         a = j4 - id4  # f'(r_n) - 1
-        b = ref_out[:4] - ref_in[:4]
-        b_over_a = numpy.linalg.solve(a, b)
-        r_next = ref_in - numpy.append(b_over_a, numpy.zeros((2,)))
+        b = ref_out[:, :4] - r_in[:, :4]
+        b_over_a = numpy.linalg.solve(a, b[:, :, numpy.newaxis])
+        r_next = r_in.copy()
+        r_next[:, :4] -= b_over_a[:, :, 0]
         # determine if we are close enough
-        change = numpy.linalg.norm(r_next - ref_in)
+        change = numpy.linalg.norm(r_next - r_in, axis=1)
         itercount += 1
-        ref_in = r_next
+        ref_in[active] = r_next
+        active = active[change > convergence]
         keep_lattice = True
 
     if itercount == max_iterations:
         warnings.warn(AtWarning('Maximum number of iterations reached. '
                                 'Possible non-convergence'))
-    return ref_in
+    return ref_in[0] if numpy.ndim(dp) == 0 else ref_in
 
 
 @check_6d(False)
@@ -82,42 +103,72 @@ def _orbit_dct(ring: Lattice, dct: float = None, guess: Orbit = None, **kwargs):
     if len(rem) > 0:
         raise AtError(f'Unexpected keywords for orbit_dct: {", ".join(rem)}')
 
-    ref_in = numpy.zeros((6,)) if guess is None else numpy.copy(guess)
+    dcts = numpy.atleast_1d(0.0 if dct is None else dct)
+    ref_in = numpy.zeros((dcts.size, 6))
+    if guess is not None:
+        ref_in[:] = guess
 
     scaling = xy_step * numpy.array([1.0, 1.0, 1.0, 1.0, 1.0])
     delta_matrix = numpy.zeros((6, 6), order='F')
     for i in range(5):
         delta_matrix[i, i] = scaling[i]
-    theta5 = numpy.zeros((5,), order='F')
-    theta5[4] = 0.0 if dct is None else dct
+    theta5 = numpy.zeros((dcts.size, 5))
+    theta5[:, 4] = dcts
     id5 = numpy.zeros((5, 5), order='F')
     for i in range(4):
         id5[i, i] = 1.0
     idx = numpy.array([0, 1, 2, 3, 5])
-    change = 1
+    active = numpy.arange(dcts.size)
     itercount = 0
-    while (change > convergence) and itercount < max_iterations:
-        in_mat = ref_in.reshape((6, 1)) + delta_matrix
+    while active.size > 0 and itercount < max_iterations:
+        r_in = ref_in[active]
+        in_mat = _stack(r_in, delta_matrix)
         _ = internal_lpass(ring, in_mat, refpts=[], keep_lattice=keep_lattice)
+        out_mat = _unstack(in_mat, 6)
         # the reference particle after one turn
-        ref_out = in_mat[:, -1]
+        ref_out = out_mat[:, :, -1]
         # 5x5 jacobian matrix from numerical differentiation:
         # f(x+d) - f(x) / d
-        j5 = (in_mat[idx, :5] - in_mat[idx, 5:]) / scaling
+        j5 = (out_mat[:, idx, :5] - out_mat[:, idx, 5:]) / scaling
         a = j5 - id5  # f'(r_n) - 1
-        b = ref_out[idx] - numpy.append(ref_in[:4], 0.0) - theta5
-        b_over_a = numpy.linalg.solve(a, b)
-        r_next = ref_in - numpy.append(b_over_a, 0.0)
+        b = ref_out[:, idx] - theta5[active]
+        b[:, :4] -= r_in[:, :4]
+        b_over_a = numpy.linalg.solve(a, b[:, :, numpy.newaxis])
+        r_next = r_in.copy()
+        r_next[:, :5] -= b_over_a[:, :, 0]
         # determine if we are close enough
-        change = numpy.linalg.norm(r_next - ref_in)
+        change = numpy.linalg.norm(r_next - r_in, axis=1)
         itercount += 1
-        ref_in = r_next
+        ref_in[active] = r_next
+        active = active[change > convergence]
         keep_lattice = True
 
     if itercount == max_iterations:
         warnings.warn(AtWarning('Maximum number of iterations reached. '
                                 'Possible non-convergence'))
-    return ref_in
+    return ref_in[0] if numpy.ndim(dct) == 0 else ref_in
+
+
+def _propagate(ring: Lattice, orbit, refpts, keep_lattice):
+    """Propagate one (6,) or several (n, 6) orbits to refpts"""
+    if orbit.ndim == 1:
+        # bug in numpy < 1.13
+        if ring.refcount(refpts) == 0:
+            all_points = numpy.empty((0, 6), dtype=float)
+        else:
+            all_points = internal_lpass(ring, orbit.copy(order='K'),
+                                        refpts=refpts,
+                                        keep_lattice=keep_lattice)
+            all_points = numpy.squeeze(all_points, axis=(1, 3)).T
+    else:
+        if ring.refcount(refpts) == 0:
+            all_points = numpy.empty((orbit.shape[0], 0, 6), dtype=float)
+        else:
+            in_mat = numpy.array(orbit.T, order='F')
+            all_points = internal_lpass(ring, in_mat, refpts=refpts,
+                                        keep_lattice=keep_lattice)
+            all_points = numpy.moveaxis(all_points[:, :, :, 0], 0, -1)
+    return all_points
 
 
 def find_orbit4(ring: Lattice, dp: float = None, refpts: Refpts = None, *,
@@ -155,17 +206,20 @@ def find_orbit4(ring: Lattice, dp: float = None, refpts: Refpts = None, *,
     Parameters:
         ring:           Lattice description (:py:attr:`~.Lattice.is_6d` must be
           :py:obj:`False`)
-        dp:             Momentum deviation. Defaults to 0
+        dp:             Momentum deviation. Defaults to 0. May be an array:
+          the orbits for all values are then computed in the same tracking
+          calls
         refpts:         Observation points.
           See ":ref:`Selecting elements in a lattice <refpts>`"
         dct:            Path lengthening. If specified, *dp* is ignored and
-          the off-momentum is deduced from the path lengthening.
+          the off-momentum is deduced from the path lengthening. May be an
+          array
         df:             Deviation from the nominal RF frequency. If specified,
           *dp* is ignored and the off-momentum is deduced from the frequency
-          deviation.
+          deviation. May be an array
         orbit:          Avoids looking for initial the closed orbit if it is
-          already known ((6,) array). :py:func:`find_orbit4` propagates it to
-          the specified *refpts*.
+          already known ((6,) or (n, 6) array). :py:func:`find_orbit4`
+          propagates it to the specified *refpts*.
         keep_lattice:   Assume no lattice change since the previous tracking.
           Default: False
 
@@ -185,6 +239,9 @@ def find_orbit4(ring: Lattice, dp: float = None, refpts: Refpts = None, *,
         orbit:          (Nrefs, 6) closed orbit vector at each location
                         specified in *refpts*
 
+        If the off-momentum is given as an array of n values, *orbit0* is a
+        (n, 6) array and *orbit* a (n, Nrefs, 6) array.
+
     See also:
         :py:func:`find_sync_orbit`, :py:func:`find_orbit6`
     """
@@ -194,6 +251,7 @@ def find_orbit4(ring: Lattice, dp: float = None, refpts: Refpts = None, *,
     if orbit is None:
         if df is not None:
             frf = ring.cell_revolution_frequency * ring.cell_harmnumber
+            df = numpy.asarray(df)
             dct = -ring.cell_length * df / (frf+df)
             orbit = _orbit_dct(ring, dct, keep_lattice=keep_lattice, **kwargs)
         elif dct is not None:
@@ -202,14 +260,7 @@ def find_orbit4(ring: Lattice, dp: float = None, refpts: Refpts = None, *,
             orbit = _orbit_dp(ring, dp, keep_lattice=keep_lattice, **kwargs)
         keep_lattice = True
 
-    # bug in numpy < 1.13
-    if ring.refcount(refpts) == 0:
-        all_points = numpy.empty((0, 6), dtype=float)
-    else:
-        all_points = internal_lpass(ring, orbit.copy(order='K'), refpts=refpts,
-                                    keep_lattice=keep_lattice)
-        all_points = numpy.squeeze(all_points, axis=(1, 3)).T
-    return orbit, all_points
+    return orbit, _propagate(ring, orbit, refpts, keep_lattice)
 
 
 def find_sync_orbit(ring: Lattice, dct: float = None, refpts: Refpts = None, *,
@@ -248,16 +299,18 @@ def find_sync_orbit(ring: Lattice, dct: float = None, refpts: Refpts = None, *,
     Parameters:
         ring:           Lattice description (:py:attr:`~.Lattice.is_6d` must be
           :py:obj:`False`)
-        dct:            Path lengthening.
+        dct:            Path lengthening. May be an array: the orbits for
+          all values are then computed in the same tracking calls
         refpts:         Observation points.
           See ":ref:`Selecting elements in a lattice <refpts>`"
-        dp:             Momentum deviation. Defaults to :py:obj:`None`
+        dp:             Momentum deviation. Defaults to :py:obj:`None`. May
+          be an array
         df:             Deviation from the nominal RF frequency. If specified,
           *dct* is ignored and the off-momentum is deduced from the frequency
-          deviation.
+          deviation. May be an array
         orbit:          Avoids looking for initial the closed orbit if it is
-          already known ((6,) array). :py:func:`find_sync_orbit` propagates it
-          to the specified *refpts*.
+          already known ((6,) or (n, 6) array). :py:func:`find_sync_orbit`
+          propagates it to the specified *refpts*.
         keep_lattice:   Assume no lattice change since the previous tracking.
           Default: False
 
@@ -277,6 +330,9 @@ def find_sync_orbit(ring: Lattice, dct: float = None, refpts: Refpts = None, *,
         orbit:          (Nrefs, 6) closed orbit vector at each location
                         specified in *refpts*
 
+        If the off-momentum is given as an array of n values, *orbit0* is a
+        (n, 6) array and *orbit* a (n, Nrefs, 6) array.
+
     See also:
         :py:func:`find_orbit4`, :py:func:`find_orbit6`
     """
@@ -286,6 +342,7 @@ def find_sync_orbit(ring: Lattice, dct: float = None, refpts: Refpts = None, *,
     if orbit is None:
         if df is not None:
             frf = ring.cell_revolution_frequency * ring.cell_harmnumber
+            df = numpy.asarray(df)
             dct = -ring.cell_length * df / (frf+df)
             orbit = _orbit_dct(ring, dct, keep_lattice=keep_lattice, **kwargs)
         elif dp is not None:
@@ -294,14 +351,7 @@ def find_sync_orbit(ring: Lattice, dct: float = None, refpts: Refpts = None, *,
             orbit = _orbit_dct(ring, dct,  keep_lattice=keep_lattice, **kwargs)
         keep_lattice = True
 
-    # bug in numpy < 1.13
-    if ring.refcount(refpts) == 0:
-        all_points = numpy.empty((0, 6), dtype=float)
-    else:
-        all_points = internal_lpass(ring, orbit.copy(order='K'), refpts=refpts,
-                                    keep_lattice=keep_lattice)
-        all_points = numpy.squeeze(all_points, axis=(1, 3)).T
-    return orbit, all_points
+    return orbit, _propagate(ring, orbit, refpts, keep_lattice)
 
 
 def _orbit6(ring: Lattice, cavpts=None, guess=None, keep_lattice=False,
@@ -407,8 +457,9 @@ def find_orbit6(ring: Lattice, refpts: Refpts = None, *,
             the equilibrium RF phase. If there is no radiation it is 0.
         6.  ``dp``, ``dct`` and ``df`` arguments are applied with respect
             to the **NOMINAL** on-momentum frequency. They overwrite
-            exisiting frequency offsets
-            
+            exisiting frequency offsets. For arrays of ``dp``, ``dct`` or
+            ``df``, the orbits are computed sequentially and stacked
+
 
     Parameters:
         ring:           Lattice description
@@ -449,14 +500,7 @@ def find_orbit6(ring: Lattice, refpts: Refpts = None, *,
         orbit = _orbit6(ring, keep_lattice=keep_lattice, **kwargs)
         keep_lattice = True
 
-    # bug in numpy < 1.13
-    if ring.refcount(refpts) == 0:
-        all_points = numpy.empty((0, 6), dtype=float)
-    else:
-        all_points = internal_lpass(ring, orbit.copy(order='K'), refpts=refpts,
-                                    keep_lattice=keep_lattice)
-        all_points = numpy.squeeze(all_points, axis=(1, 3)).T
-    return orbit, all_points
+    return orbit, _propagate(ring, orbit, refpts, keep_lattice)
 
 
 def find_orbit(ring, refpts: Refpts = None, **kwargs):
@@ -6,13 +6,13 @@ from math import sin, cos, tan, sqrt, sinh, cosh, pi
 import numpy
 from typing import Union
 from scipy.linalg import inv, det, solve_sylvester
-from at.lattice import Lattice, check_radiation, Refpts, All
+from at.lattice import Lattice, check_radiation, Refpts
 from at.lattice import Dipole, Wiggler, DConstant
 from at.lattice import Quadrupole, Multipole, QuantumDiffusion
 from at.lattice import frequency_control, set_value_refpts
-from at.tracking import internal_lpass
-from at.physics import find_orbit6, find_m66, find_elem_m66, Orbit
-from at.physics import find_mpole_raddiff_matrix, get_tunes_damp
+from at.tracking.atpass import diffmatrix
+from at.physics import find_orbit6, find_m66, Orbit
+from at.physics import get_tunes_damp
 from at.physics import ELossMethod
 
 __all__ = ['ohmi_envelope', 'get_radiation_integrals', 'quantdiffmat',
@@ -36,31 +36,12 @@ def _dmatr(ring: Lattice, orbit: Orbit = None, keep_lattice: bool = False):
     compute the cumulative diffusion and orbit
     matrices over the ring
     """
-
-    def _cumulb(it):
-        """accumulate diffusion matrices"""
-        cumul = numpy.zeros((6, 6))
-        yield cumul
-        for el, orbin, b in it:
-            m = find_elem_m66(el, orbin, energy=energy, particle=ring.particle)
-            cumul = m.dot(cumul).dot(m.T) + b
-            yield cumul
-
-    energy = ring.energy
-
     if orbit is None:
         orbit, _ = find_orbit6(ring, keep_lattice=keep_lattice)
-        keep_lattice = True
 
-    orbs = numpy.squeeze(
-        internal_lpass(ring, orbit.copy(order='K'), refpts=All,
-                       keep_lattice=keep_lattice), axis=(1, 3)).T
-    b0 = numpy.zeros((6, 6))
-    bb = [find_mpole_raddiff_matrix(elem, elemorb, energy)
-          if elem.PassMethod.endswith('RadPass') else b0
-          for elem, elemorb in zip(ring, orbs)]
-    bbcum = numpy.stack(list(_cumulb(zip(ring, orbs, bb))), axis=0)
-    return bbcum, orbs
+    return diffmatrix(ring, numpy.asarray(orbit, dtype=float),
+                      energy=ring.energy, particle=ring.particle,
+                      xystep=DConstant.XYStep)
 
 
 def _lmat(dmat):
@@ -162,7 +143,9 @@ def ohmi_envelope(ring: Lattice, refpts: Refpts = None, orbit: Orbit = None,
 
     uint32refs = ring.get_uint32_index(refpts)
     bbcum, orbs = _dmatr(ring, orbit=orbit, keep_lattice=keep_lattice)
-    mring, ms = find_m66(ring, uint32refs, orbit=orbs[0], keep_lattice=True)
+    # The lattice is cached only if the closed orbit was computed
+    mring, ms = find_m66(ring, uint32refs, orbit=orbs[0],
+                         keep_lattice=keep_lattice or orbit is None)
     # ------------------------------------------------------------------------
     # Equation for the moment matrix R is
     #         R = MRING*R*MRING' + BCUM;
@@ -0,0 +1,241 @@
+"""
+Hamiltonian resonance driving terms
+"""
+from enum import IntFlag
+from typing import Optional
+import numpy
+from ..lattice import Lattice, Refpts, ThinMultipole, All
+from .linear import get_optics, avlinopt
+from .rdtlib import drivingterms, update
+
+__all__ = ['RDTType', 'RDTCalculator', 'get_rdts']
+
+_RDT_NAMES = ('h21000', 'h30000', 'h10110', 'h10020', 'h10200',
+              'h11001', 'h00111', 'h20001', 'h00201', 'h10002',
+              'h10010', 'h10100',
+              'h22000', 'h11110', 'h00220', 'h31000', 'h40000',
+              'h20110', 'h11200', 'h20020', 'h20200', 'h00310', 'h00400')
+_SHIFT_NAMES = ('dnux_dJx', 'dnux_dJy', 'dnuy_dJy')
+
+
+class RDTType(IntFlag):
+    """Selection of resonance driving terms"""
+    #: First order chromatic terms
+    CHROMATIC = 1
+    #: First order coupling terms
+    COUPLING = 2
+    #: First order geometric terms from sextupoles
+    GEOMETRIC1 = 4
+    #: Second order geometric terms from sextupoles and octupoles
+    GEOMETRIC2 = 8
+    #: Amplitude-dependent tune shifts
+    TUNESHIFTS = 16
+    #: All terms
+    ALL = 31
+
+
+# Driving terms computed for each type
+_RDT_SELECT = {RDTType.GEOMETRIC1: range(0, 5),
+               RDTType.CHROMATIC: range(5, 10),
+               RDTType.COUPLING: range(10, 12),
+               RDTType.GEOMETRIC2: range(12, 23)}
+
+
+def _magnet_strengths(ring: Lattice, magnets) -> numpy.ndarray:
+    """Integrated [a2L, b2L, b3L, b4L] of the selected magnets"""
+    strengths = numpy.zeros((len(magnets), 4))
+    for st, i in zip(strengths, magnets):
+        elem = ring[i]
+        length = elem.Length
+        if length == 0.0:       # Thin multipole: integrated strengths
+            length = 1.0
+        pola = elem.PolynomA[1:2]
+        polb = elem.PolynomB[1:4]
+        st[:len(pola)] = pola
+        st[1:1+len(polb)] = polb
+        st *= length
+    return strengths
+
+
+class RDTCalculator(object):
+    """Resonance driving terms with incremental updates
+
+    The linear optics of the lattice is computed once at initialisation.
+    The driving terms can then be updated after modifying the strengths of
+    sextupoles and octupoles: the update time is proportional to the
+    number of modified magnets, which is well suited to optimisations
+    evaluating the driving terms many times.
+
+    The driving terms are computed with the formulas of elegant
+    [#]_ [#]_, using the average optical functions in each magnet. The
+    first-order terms are linear in the magnet strengths, the second-order
+    terms are quadratic in the sextupole strengths.
+
+    Example:
+        >>> calc = RDTCalculator(ring, refpts=0, rdt_type=RDTType.GEOMETRIC1)
+        >>> sf = ring.get_uint32_index('SF*')
+        >>> for i in sf:
+        ...     ring[i].PolynomB[2] *= 1.05
+        >>> rdts = calc.update(sf)
+
+    References:
+        .. [#] J. Bengtsson, SLS Note 9/97, March 7, 1997
+        .. [#] C. X. Wang, AOP-TN-2009-020
+    """
+
+    def __init__(self, ring: Lattice, refpts: Refpts = 0,
+                 rdt_type: RDTType = RDTType.ALL,
+                 dp: Optional[float] = None, **kwargs):
+        # noinspection PyUnresolvedReferences
+        r"""
+        Parameters:
+            ring:       Lattice description
+            refpts:     Observation points of the driving terms
+            rdt_type:   Selection of driving terms, as a combination of
+              :py:class:`RDTType` values
+            dp:         Momentum deviation.
+
+        Keyword Args:
+            **kwargs:   Other keyword arguments are forwarded to
+              :py:func:`.avlinopt`
+        """
+        self.ring = ring
+        self.rdt_type = RDTType(rdt_type)
+        self.refpts = ring.get_uint32_index(refpts)
+        self._magnets = ring.get_uint32_index(ThinMultipole)
+        self._first = numpy.searchsorted(self._magnets,
+                                         self.refpts).astype(numpy.intp)
+        self._dp = dp
+        self._kwargs = kwargs
+        self._set_optics()
+        self.compute()
+
+    def _set_optics(self):
+        """Linear optics at magnets and observation points"""
+        ring = self.ring
+        nrefs = len(self.refpts)
+        _, avebeta, avemu, avedisp, *_ = avlinopt(ring, self._dp,
+                                                  self._magnets,
+                                                  **self._kwargs)
+        pts = numpy.unique(numpy.append(self.refpts, len(ring)))
+        _, _, lindata = get_optics(ring, refpts=pts, dp=self._dp,
+                                   **self._kwargs)
+        self._elemdata = numpy.column_stack(
+            (ring.get_s_pos(self._magnets), avebeta, avedisp[:, 0], avemu))
+        self._refdata = numpy.column_stack(
+            (lindata.s_pos[:nrefs], lindata.mu[:nrefs, :2]))
+        self._tune = lindata.mu[-1, :2] / 2.0 / numpy.pi
+        self._circumference = lindata.s_pos[-1]
+        self._strengths = _magnet_strengths(ring, self._magnets)
+
+    def _refresh(self, refpts: Refpts):
+        """Read the strengths of the modified magnets"""
+        if refpts is All:
+            idx = numpy.arange(len(self._magnets))
+        else:
+            modified = self.ring.get_bool_index(refpts)
+            idx = numpy.flatnonzero(modified[self._magnets])
+        strengths = self._strengths.copy()
+        strengths[idx] = _magnet_strengths(self.ring, self._magnets[idx])
+        return strengths
+
+    def compute(self) -> numpy.recarray:
+        """Full computation of the driving terms from the present magnet
+        strengths. The linear optics is not recomputed.
+
+        Returns:
+            rdts:   Driving terms, see :py:attr:`rdts`
+        """
+        self._strengths = _magnet_strengths(self.ring, self._magnets)
+        self._h, self._dnu = drivingterms(self._elemdata, self._strengths,
+                                          self._first, self._refdata,
+                                          self._tune, self._circumference,
+                                          int(self.rdt_type))
+        return self.rdts
+
+    def update(self, refpts: Refpts = All) -> numpy.recarray:
+        """Update the driving terms after modifying magnet strengths
+
+        If quadrupole or skew quadrupole strengths were modified, the linear
+        optics is recomputed and so are all the driving terms. Otherwise, only
+        the contributions of the modified magnets are recomputed.
+
+        Parameters:
+            refpts:     Modified magnets. The default, :py:obj:`All`, checks
+              all the magnets for modifications.
+
+        Returns:
+            rdts:   Driving terms, see :py:attr:`rdts`
+        """
+        strengths = self._refresh(refpts)
+        changed = numpy.flatnonzero(numpy.any(strengths != self._strengths,
+                                              axis=1))
+        if len(changed) == 0:
+            pass
+        elif numpy.any(strengths[changed, :2] != self._strengths[changed, :2]):
+            self._set_optics()
+            self.compute()
+        else:
+            update(self._elemdata, self._strengths, strengths,
+                   changed.astype(numpy.intp), self._first, self._refdata,
+                   self._tune, self._circumference, int(self.rdt_type),
+                   self._h, self._dnu)
+            self._strengths = strengths
+        return self.rdts
+
+    @property
+    def rdts(self) -> numpy.recarray:
+        """Record array of the driving terms, one record per observation
+        point. The selected terms are complex, the tune shifts with
+        amplitude ``dnux_dJx``, ``dnux_dJy``, ``dnuy_dJy`` are real and
+        identical for all observation points"""
+        names = [_RDT_NAMES[i] for rtype, rng in _RDT_SELECT.items()
+                 if rtype in self.rdt_type for i in rng]
+        dtype = [(name, numpy.complex128) for name in names]
+        if RDTType.TUNESHIFTS in self.rdt_type:
+            dtype += [(name, numpy.float64) for name in _SHIFT_NAMES]
+        rdts = numpy.recarray((len(self.refpts),), dtype=dtype)
+        for i, name in enumerate(_RDT_NAMES):
+            if name in names:
+                rdts[name] = self._h[:, i]
+        if RDTType.TUNESHIFTS in self.rdt_type:
+            for name, dnu in zip(_SHIFT_NAMES, self._dnu):
+                rdts[name] = dnu
+        return rdts
+
+
+def get_rdts(ring: Lattice, refpts: Refpts = 0,
+             rdt_type: RDTType = RDTType.ALL, **kwargs) -> numpy.recarray:
+    r"""Hamiltonian resonance driving terms
+
+    The observation points are processed in parallel if pyat is compiled
+    with OpenMP. For repeated evaluations with varying sextupole and
+    octupole strengths, use :py:class:`RDTCalculator`.
+
+    Parameters:
+        ring:       Lattice description
+        refpts:     Observation points of the driving terms
+        rdt_type:   Selection of driving terms, as a combination of
+          :py:class:`RDTType` values
+
+    Keyword Args:
+        dp (float):     Momentum deviation.
+        **kwargs:       Other keyword arguments are forwarded to
+          :py:func:`.avlinopt`
+
+    Returns:
+        rdts:   Record array of the driving terms, one record per
+          observation point. The selected terms are complex, the tune shifts
+          with amplitude ``dnux_dJx``, ``dnux_dJy``, ``dnuy_dJy`` are real
+
+    Example:
+        >>> rdts = get_rdts(ring, refpts=0,
+        ...                 rdt_type=RDTType.GEOMETRIC1 | RDTType.TUNESHIFTS)
+        >>> rdts.h21000
+        array([-0.47152747-1.20820637j])
+    """
+    return RDTCalculator(ring, refpts=refpts, rdt_type=rdt_type,
+                         **kwargs).rdts
+
+
+Lattice.get_rdts = get_rdts
@@ -0,0 +1,13 @@
+"""Stub file for the 'rdtlib' extension"""
+
+import numpy as np
+
+def drivingterms(elemdata: np.ndarray, strengths: np.ndarray,
+                 first: np.ndarray, refdata: np.ndarray, tune: np.ndarray,
+                 circumference: float,
+                 flags: int) -> tuple[np.ndarray, np.ndarray]: ...
+
+def update(elemdata: np.ndarray, old_strengths: np.ndarray,
+           new_strengths: np.ndarray, changed: np.ndarray, first: np.ndarray,
+           refdata: np.ndarray, tune: np.ndarray, circumference: float,
+           flags: int, h: np.ndarray, tuneshifts: np.ndarray) -> None: ...
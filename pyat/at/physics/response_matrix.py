@@ -0,0 +1,371 @@
+"""
+Orbit, frequency, tune and chromaticity response matrices
+"""
+from __future__ import annotations
+import numpy
+from math import pi
+from warnings import warn
+from collections.abc import Sequence
+from ..lattice import Lattice, Refpts, Orbit, AtError, AtWarning, DConstant
+from ..lattice import get_uint32_index
+from ..tracking import internal_lpass
+from .orbit import find_orbit, _stack, _unstack
+from .matrix import find_m44, find_m66
+from .linear import avlinopt, get_optics, get_tune, get_chrom
+
+__all__ = ['orbit_response_matrix', 'frequency_response',
+           'tune_response', 'chromaticity_response']
+
+
+def _kick_vectors(nh: int, nv: int):
+    """(nh+nv, 6) unit kicks: horizontal correctors then vertical ones"""
+    kicks = numpy.zeros((nh + nv, 6))
+    kicks[:nh, 1] = 1.0
+    kicks[nh:, 3] = 1.0
+    return kicks
+
+
+def _orm_linear(ring, bidx, cidx, kicks, orbit, xy_step, dp_step):
+    """Coupled orbit response from the transfer matrices of a single pass
+
+    For a kick *k* at the entrance of element *j*, the closed orbit after the
+    kick is :math:`(I-M_j)^{-1}k` with :math:`M_j=T_jMT_j^{-1}`, so that the
+    kick brought back to the lattice entrance is
+    :math:`v_j=(I-M)^{-1}T_j^{-1}k`. It reaches a downstream monitor *i* as
+    :math:`T_iv_j` and an upstream one, after one turn, as :math:`T_iMv_j`.
+    """
+    refs = numpy.union1d(bidx, cidx)
+    if ring.is_6d:
+        mt, ms = find_m66(ring, refpts=refs, orbit=orbit,
+                          XYStep=xy_step, DPStep=dp_step)
+        dim = 6
+    else:
+        mt, ms = find_m44(ring, refpts=refs, orbit=orbit, XYStep=xy_step)
+        dim = 4
+    tb = ms[numpy.searchsorted(refs, bidx)]
+    tc = ms[numpy.searchsorted(refs, cidx)]
+    u = numpy.linalg.solve(tc, kicks[:, :dim, numpy.newaxis])[:, :, 0]
+    v = numpy.linalg.solve(numpy.identity(dim) - mt, u.T)
+    z_down = tb @ v
+    z_up = tb @ (mt @ v)
+    down = bidx[:, numpy.newaxis] > cidx[numpy.newaxis, :]
+    z = numpy.where(down[:, numpy.newaxis, :], z_down, z_up)
+    return numpy.concatenate((z[:, 0, :], z[:, 2, :]), axis=0)
+
+
+def _segment_track(segments, edges, kick_cols, kick_vals, r_in, bidx):
+    """Track through the lattice segments, kicking selected columns
+
+    The kicks are applied at the entrance of the segments, monitors located
+    at a segment boundary are observed before the kick.
+    """
+    if bidx is not None:
+        obs = numpy.empty((6, r_in.shape[1], len(bidx)))
+        iseg = numpy.searchsorted(edges[1:], bidx, side='left')
+    for iref, seg in enumerate(segments):
+        cols = kick_cols[iref]
+        if cols is not None:
+            r_in[:, cols] += kick_vals[iref]
+        if bidx is not None:
+            mask = (iseg == iref)
+        if len(seg) > 0:
+            if bidx is not None and numpy.any(mask):
+                local = bidx[mask] - edges[iref]
+                rout = internal_lpass(seg, r_in, refpts=local)
+                obs[:, :, mask] = rout[:, :, :, 0]
+            else:
+                internal_lpass(seg, r_in, refpts=[])
+        elif bidx is not None and numpy.any(mask):
+            obs[:, :, mask] = r_in[:, :, numpy.newaxis]
+    return obs if bidx is not None else None
+
+
+def _orm_tracking(ring, bidx, cidx, kicks, orbit, kick, xy_step, dp_step,
+                  convergence, max_iterations):
+    """Closed orbits of all the ±kick lanes found together by tracking"""
+    nlanes = 2 * len(cidx)
+    lane_corr = numpy.concatenate((cidx, cidx))
+    lane_kick = kick * numpy.concatenate((kicks, -kicks))
+
+    # Path lengthening of the unperturbed closed orbit (6D synchronism)
+    rout = numpy.asfortranarray(orbit.reshape((6, 1)).copy())
+    internal_lpass(ring, rout, refpts=[])
+    theta = rout[:, 0] - orbit
+
+    edges = numpy.unique(numpy.concatenate(([0], cidx, [len(ring)])))
+    segments = [ring[int(b):int(e)] for b, e in zip(edges[:-1], edges[1:])]
+
+    dim = 6 if ring.is_6d else 4
+    npart = dim + 1
+    scaling = numpy.array([xy_step]*4 + [dp_step]*2)[:dim]
+    delta_matrix = numpy.zeros((6, npart))
+    delta_matrix[:dim, :dim] = numpy.diag(scaling)
+
+    def lane_kicks(nparts):
+        cols, vals = [], []
+        for edge in edges[:-1]:
+            lanes = numpy.flatnonzero(lane_corr == edge)
+            if lanes.size == 0:
+                cols.append(None)
+                vals.append(None)
+            else:
+                c = (nparts*lanes[:, numpy.newaxis] + numpy.arange(nparts))
+                cols.append(c.ravel())
+                vals.append(numpy.repeat(lane_kick[lanes].T, nparts, axis=1))
+        return cols, vals
+
+    cols, vals = lane_kicks(npart)
+    ref_in = numpy.tile(orbit, (nlanes, 1))
+    id_d = numpy.identity(dim)
+    for _ in range(max_iterations):
+        in_mat = _stack(ref_in, delta_matrix)
+        _segment_track(segments, edges, cols, vals, in_mat, None)
+        out_mat = _unstack(in_mat, npart)
+        jac = (out_mat[:, :dim, :dim] - out_mat[:, :dim, dim:]) / scaling
+        b = out_mat[:, :dim, dim] - ref_in[:, :dim] - theta[:dim]
+        corr = numpy.linalg.solve(jac - id_d, b[:, :, numpy.newaxis])
+        ref_in[:, :dim] -= corr[:, :, 0]
+        if not numpy.all(numpy.isfinite(ref_in)):
+            raise AtError('Closed orbit search diverged: '
+                          'non-finite coordinates')
+        if numpy.max(numpy.linalg.norm(corr[:, :, 0], axis=1)) < convergence:
+            break
+    else:
+        warn(AtWarning('Maximum number of iterations reached. '
+                       'Possible non-convergence'))
+
+    cols, vals = lane_kicks(1)
+    in_mat = numpy.asfortranarray(ref_in.T)
+    obs = _segment_track(segments, edges, cols, vals, in_mat, bidx)
+    nc = len(cidx)
+    z = (obs[:, :nc, :] - obs[:, nc:, :]) / (2.0 * kick)
+    return numpy.concatenate((z[0].T, z[2].T), axis=0)
+
+
+def orbit_response_matrix(ring: Lattice, bpms: Refpts, hcorrectors: Refpts,
+                          vcorrectors: Refpts, *, method: str = 'linear',
+                          orbit: Orbit = None, kick: float = 1.0e-5,
+                          **kwargs) -> numpy.ndarray:
+    r"""Orbit response matrix to corrector kicks
+
+    All columns are derived from a single closed orbit search. The kicks are
+    applied at the entrance of the corrector elements and the orbit is
+    observed at the entrance of the monitors. A monitor located on a
+    corrector sees the orbit before the kick.
+
+    For a 4D lattice, the response is computed at constant momentum. For a 6D
+    lattice, the RF frequency is constant, which adds the dispersive term due
+    to path lengthening.
+
+    Parameters:
+        ring:           Lattice description
+        bpms:           Monitor locations
+        hcorrectors:    Horizontal corrector locations
+        vcorrectors:    Vertical corrector locations
+        method:         Computation method:
+
+          'linear'
+            The coupled linear response is built from the transfer matrices
+            at monitors and correctors, obtained in one tracking pass.
+          'tracking'
+            The closed orbits for all positive and negative kicks are found
+            together: each corrector is a separate set of particles in a
+            single batch, kicked when reaching the corrector. Includes
+            non-linear effects at the level of *kick*.
+        orbit:          Avoids looking for the closed orbit if it is
+          already known ((6,) array)
+        kick:           Kick amplitude for the 'tracking' method
+
+    Keyword Args:
+        dp (float):             Momentum deviation. Defaults to :py:obj:`None`
+        dct (float):            Path lengthening. Defaults to :py:obj:`None`
+        df (float):             Deviation of RF frequency. Defaults to
+          :py:obj:`None`
+        XYStep (float):         Step size.
+          Default: :py:data:`DConstant.XYStep <.DConstant>`
+        DPStep (float):         Momentum step size.
+          Default: :py:data:`DConstant.DPStep <.DConstant>`
+        convergence (float):    Convergence criterion for the 'tracking'
+          method. Default: :py:data:`DConstant.OrbConvergence <.DConstant>`
+        max_iterations (int):   Maximum number of iterations for the
+          'tracking' method.
+          Default: :py:data:`DConstant.OrbMaxIter <.DConstant>`
+
+    Returns:
+        orm:            (2*nbpms, nhcor+nvcor) response matrix [m/rad]. The
+          rows are the horizontal then vertical positions at the monitors,
+          the columns are the horizontal then vertical correctors.
+
+    See also:
+        :py:func:`frequency_response`
+    """
+    xy_step = kwargs.pop('XYStep', DConstant.XYStep)
+    dp_step = kwargs.pop('DPStep', DConstant.DPStep)
+    convergence = kwargs.pop('convergence', DConstant.OrbConvergence)
+    max_iterations = kwargs.pop('max_iterations', DConstant.OrbMaxIter)
+    bidx = get_uint32_index(ring, bpms).astype(numpy.int64)
+    hidx = get_uint32_index(ring, hcorrectors).astype(numpy.int64)
+    vidx = get_uint32_index(ring, vcorrectors).astype(numpy.int64)
+    cidx = numpy.concatenate((hidx, vidx))
+    kicks = _kick_vectors(len(hidx), len(vidx))
+    if orbit is None:
+        orbit, _ = find_orbit(ring, XYStep=xy_step, DPStep=dp_step, **kwargs)
+    if method == 'linear':
+        return _orm_linear(ring, bidx, cidx, kicks, orbit, xy_step, dp_step)
+    elif method == 'tracking':
+        return _orm_tracking(ring, bidx, cidx, kicks, orbit, kick,
+                             xy_step, dp_step, convergence, max_iterations)
+    else:
+        raise AtError(f'Unknown response matrix method: {method!r}')
+
+
+def frequency_response(ring: Lattice, bpms: Refpts, *,
+                       method: str = 'linear', df: float = None,
+                       **kwargs) -> numpy.ndarray:
+    r"""Orbit response to the RF frequency
+
+    This is the dispersion column usually appended to the
+    orbit response matrix.
+
+    Parameters:
+        ring:           Lattice description
+        bpms:           Monitor locations
+        method:         Computation method:
+
+          'linear'
+            :math:`\eta/(\eta_c f_{RF})` from the linear optics, where
+            :math:`\eta_c` is the slip factor
+          'tracking'
+            Central difference of the closed orbits found at
+            :math:`f_{RF}\pm df/2`
+        df:             Frequency step for the 'tracking' method. Default:
+          corresponding to :py:data:`DConstant.DPStep <.DConstant>`
+
+    Keyword Args:
+        cavpts (Refpts):        Cavity location. Default: all cavities
+        DPStep (float):         Momentum step size.
+          Default: :py:data:`DConstant.DPStep <.DConstant>`
+
+    Returns:
+        resp:           (2*nbpms,) horizontal then vertical orbit response
+          [m/Hz]
+    """
+    cavpts = kwargs.pop('cavpts', None)
+    dp_step = kwargs.pop('DPStep', DConstant.DPStep)
+    f0 = ring.get_rf_frequency(cavpts=cavpts)
+    ring4 = ring.disable_6d(copy=True) if ring.is_6d else ring
+    if method == 'linear':
+        _, _, ld = get_optics(ring4, refpts=bpms, **kwargs)
+        disp = ld.dispersion
+        resp = numpy.concatenate((disp[:, 0], disp[:, 2]))
+        return resp / ring4.slip_factor / f0
+    elif method == 'tracking':
+        if df is None:
+            df = dp_step * ring4.slip_factor * f0
+        _, oup = find_orbit(ring, bpms, df=0.5*df, **kwargs)
+        _, odn = find_orbit(ring, bpms, df=-0.5*df, **kwargs)
+        dorb = (oup - odn) / df
+        return numpy.concatenate((dorb[:, 0], dorb[:, 2]))
+    else:
+        raise AtError(f'Unknown response matrix method: {method!r}')
+
+
+def _family_response(ring, families, order, step, evaluate, **kwargs):
+    """Central difference of *evaluate* vs PolynomB[order] of families"""
+    resp = []
+    for fam in families:
+        refs = get_uint32_index(ring, fam)
+        vals = numpy.array([ring[i].PolynomB[order] for i in refs])
+        rg = ring.replace(refs)
+        res = []
+        for sgn in (0.5, -0.5):
+            for i, v in zip(refs, vals):
+                rg[i].PolynomB[order] = v + sgn * step
+            res.append(numpy.asarray(evaluate(rg, **kwargs))[:2])
+        resp.append((res[0] - res[1]) / step)
+    return numpy.stack(resp, axis=1)
+
+
+def _integrated(ring, families, weight):
+    """Sum of weight * length over each family"""
+    resp = []
+    for fam in families:
+        refs = get_uint32_index(ring, fam)
+        lengths = numpy.array([ring[i].Length for i in refs])
+        lengths[lengths == 0.0] = 1.0
+        _, avebeta, _, avedisp, _, _, _ = avlinopt(ring, 0.0, refs)
+        resp.append(numpy.sum(weight(avebeta, avedisp) * lengths[:, None],
+                              axis=0))
+    return numpy.stack(resp, axis=1) / (4.0 * pi)
+
+
+def tune_response(ring: Lattice, families: Sequence[Refpts], *,
+                  method: str = 'linear', step: float = 1.0e-4,
+                  **kwargs) -> numpy.ndarray:
+    r"""Tune response to the quadrupole strength of magnet families
+
+    Parameters:
+        ring:           Lattice description
+        families:       Sequence of element selections. The strength
+          *PolynomB[1]* of all the elements of a family is varied together.
+        method:         Computation method:
+
+          'linear'
+            :math:`\pm\frac{1}{4\pi}\int\beta_{x,y}ds` over each family,
+            using average beta functions.
+          'tracking'
+            Central difference of the tunes from :py:func:`.get_tune`
+        step:           Strength step for the 'tracking' method
+
+    Keyword Args:
+        **kwargs:       Keywords forwarded to :py:func:`.get_tune` for the
+          'tracking' method
+
+    Returns:
+        resp:           (2, nfamilies) tune response matrix
+    """
+    if method == 'linear':
+        ring4 = ring.disable_6d(copy=True) if ring.is_6d else ring
+        return _integrated(ring4, families,
+                           lambda beta, disp: beta * [1.0, -1.0])
+    elif method == 'tracking':
+        return _family_response(ring, families, 1, step, get_tune, **kwargs)
+    else:
+        raise AtError(f'Unknown response matrix method: {method!r}')
+
+
+def chromaticity_response(ring: Lattice, families: Sequence[Refpts], *,
+                          method: str = 'linear', step: float = 1.0e-2,
+                          **kwargs) -> numpy.ndarray:
+    r"""Chromaticity response to the sextupole strength of magnet families
+
+    Parameters:
+        ring:           Lattice description
+        families:       Sequence of element selections. The strength
+          *PolynomB[2]* of all the elements of a family is varied together.
+        method:         Computation method:
+
+          'linear'
+            :math:`\pm\frac{1}{2\pi}\int\beta_{x,y}\eta_x ds` over each
+            family, using average beta and dispersion functions.
+          'tracking'
+            Central difference of the chromaticities from
+            :py:func:`.get_chrom`
+        step:           Strength step for the 'tracking' method
+
+    Keyword Args:
+        **kwargs:       Keywords forwarded to :py:func:`.get_chrom` for the
+          'tracking' method
+
+    Returns:
+        resp:           (2, nfamilies) chromaticity response matrix
+    """
+    if method == 'linear':
+        ring4 = ring.disable_6d(copy=True) if ring.is_6d else ring
+        return _integrated(ring4, families,
+                           lambda beta, disp:
+                           2.0 * beta * disp[:, 0:1] * [1.0, -1.0])
+    elif method == 'tracking':
+        return _family_response(ring, families, 2, step, get_chrom, **kwargs)
+    else:
+        raise AtError(f'Unknown response matrix method: {method!r}')
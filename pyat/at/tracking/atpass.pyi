@@ -13,7 +13,8 @@ def atpass(line: List[Element], r_in: np.ndarray, nturns: int,
            reuse: bool = False,
            omp_num_thread: int = 0,
            losses: bool = False,
-           bunch_spos = None, bunch_current = None): ...
+           bunch_spos = None, bunch_current = None,
+           nseeds: int = 1): ...
 
 def elempass(element: Element, r_in,
              energy: Optional[float] = None,
@@ -23,3 +24,6 @@ def elempass(element: Element, r_in,
 def reset_rng(*, rank: int = 0, seed: Optional[int] = None) -> None: ...
 def common_rng() -> float: ...
 def thread_rng() -> float: ...
+def genbeam(lmat: np.ndarray, orbit: np.ndarray, rout: np.ndarray, *,
+            seed: int = ..., rank: int = 0,
+            truncation: float = 0.0, omp_num_threads: int = 0) -> None: ...
@@ -155,7 +155,8 @@ def lattice_pass(lattice: Iterable[Element], r_in, nturns: int = 1,
          the true voltage in each bucket and distributes the particles in the
          bunches defined by :code:`ring.fillpattern` using a 6D orbit search.
     """
-    lattice = initialize_lpass(lattice, nturns, kwargs)
+    npart = r_in.shape[1] if r_in.ndim > 1 else 1
+    lattice = initialize_lpass(lattice, nturns, kwargs, npart=npart)
     return internal_lpass(lattice, r_in, nturns=nturns, refpts=refpts,
                           no_varelem=False, **kwargs)
 
@@ -276,7 +277,8 @@ def patpass(lattice: Iterable[Element], r_in, nturns: int = 1,
     """
     kwargs['pool_size'] = pool_size
     kwargs['start_method'] = start_method
-    lattice = initialize_lpass(lattice, nturns, kwargs)
+    npart = r_in.shape[1] if r_in.ndim > 1 else 1
+    lattice = initialize_lpass(lattice, nturns, kwargs, npart=npart)
     return internal_plpass(lattice, r_in, nturns=nturns,
                            refpts=refpts, **kwargs)
 
@@ -3,8 +3,10 @@ Functions relating to particle generation
 """
 import numpy as np
 from numpy.linalg import cholesky, LinAlgError
+from typing import Optional
 from warnings import warn
-from ..lattice import AtError, AtWarning, Lattice, Orbit, random
+from ..lattice import AtError, AtWarning, Lattice, Orbit, DConstant, random
+from .atpass import genbeam
 
 __all__ = ['beam', 'sigma_matrix']
 
@@ -161,11 +163,29 @@ def sigma_matrix(ring: Lattice = None, **kwargs):
     return sigmat
 
 
-def beam(nparts: int, sigma, orbit: Orbit = None):
+def _normal_factor(sig):
+    """Factor *sig* as :math:`LL^T`, where each pair of columns of *L*
+    spans a normal mode"""
+    from ..physics import a_matrix, jmat
+    try:
+        amat, lmbd = a_matrix(sig @ jmat(sig.shape[0] // 2))
+    except AtError:
+        raise LinAlgError('Singular normal mode')
+    return amat * np.sqrt(np.repeat(np.abs(lmbd), 2))
+
+
+def beam(nparts: int, sigma, orbit: Orbit = None, *,
+         out: Optional[np.ndarray] = None, seed: Optional[int] = None,
+         truncation: Optional[float] = None, omp_num_threads: int = 0):
     r"""
     Generates an array of random particles according to the given
     :math:`\Sigma`-matrix
 
+    The particles are generated in C, in parallel if pyAT is compiled with
+    OpenMP, with the random generator used in tracking. Each block of
+    particles has its own random stream, so that the result depends only on
+    *seed*, not on the number of threads.
+
     Parameters:
         nparts:         Number of particles
         sigma:          :math:`\Sigma`-matrix as calculated by
@@ -173,20 +193,34 @@ def beam(nparts: int, sigma, orbit: Orbit = None):
         orbit:          An orbit can be provided to give a center of
           mass offset to the distribution
 
+    Keyword Args:
+        out:            (6, *nparts*) Fortran-ordered float64 array where
+          the particles are written, for instance a :py:class:`numpy.memmap`
+          for very large beams. Default: a new array is allocated
+        seed:           Seed of the random streams. Default: drawn from
+          :py:obj:`at.random.thread <.random>`
+        truncation:     If given, the distribution is truncated at
+          *truncation* sigmas in each normal mode: the particles are
+          generated in the normal modes of :math:`\Sigma` and the amplitude
+          of each mode is limited to *truncation* times its r.m.s. value,
+          so that the projected coordinates stay within *truncation* sigmas
+        omp_num_threads: Number of OpenMP threads (default: automatic)
+
     Returns:
         particle_dist:  a (6, *nparts*) matrix of coordinates
     """
+    # The truncation applies to the normal mode amplitudes
+    factor = cholesky if truncation is None else _normal_factor
+
     def _get_single_plane(slc):
         try:
-            return cholesky(sigma[slc, slc])
+            return factor(sigma[slc, slc])
         except LinAlgError:
             return np.zeros((2, 2))
 
-    v = random.thread.normal(size=(sigma.shape[1], nparts))
-
     try:
         # Try full 6x6 matrix
-        lmat = cholesky(sigma)
+        lmat = factor(sigma)
         print("h, v, delta")
     except LinAlgError:
         lmat = np.zeros((6, 6))
@@ -194,7 +228,7 @@ def beam(nparts: int, sigma, orbit: Orbit = None):
             # Try x-y 4x4 matrix
             sel = range(4)
             idx = np.ix_(sel, sel)
-            lmat[idx] = cholesky(sigma[idx])
+            lmat[idx] = factor(sigma[idx])
             lmat[4:, 4:] = _get_single_plane(slice(4, 6))
             print("h, v")
         except LinAlgError:
@@ -202,7 +236,7 @@ def beam(nparts: int, sigma, orbit: Orbit = None):
                 # Try x-delta 4x4 matrix
                 sel = [0, 1, 4, 5]
                 idx = np.ix_(sel, sel)
-                lmat[idx] = cholesky(sigma[idx])
+                lmat[idx] = factor(sigma[idx])
                 lmat[2:4, 2:4] = _get_single_plane(slice(2, 4))
                 print("h, delta")
             except LinAlgError:
@@ -212,9 +246,17 @@ def beam(nparts: int, sigma, orbit: Orbit = None):
                 lmat[4:, 4:] = _get_single_plane(slice(4, 6))
                 print("uncoupled")
 
-    particle_dist = np.asfortranarray(lmat @ v)
-
-    if orbit is not None:
-        particle_dist += orbit.reshape((6, 1))
-
-    return particle_dist
+    if out is None:
+        out = np.empty((6, nparts), order='F')
+    elif out.shape != (6, nparts):
+        raise AtError('out must have the shape (6, {0})'.format(nparts))
+    if orbit is None:
+        orbit = np.zeros(6)
+    if seed is None:
+        seed = random.thread.integers(0, high=np.iinfo(np.int64).max)
+    genbeam(np.ascontiguousarray(lmat, dtype=float),
+            np.ascontiguousarray(orbit, dtype=float).reshape(6), out,
+            seed=int(seed), rank=DConstant.rank,
+            truncation=0.0 if truncation is None else float(truncation),
+            omp_num_threads=omp_num_threads)
+    return out
@@ -1,15 +1,17 @@
 from __future__ import annotations
 import numpy
 from .atpass import atpass as _atpass, elempass as _elempass
-from .utils import fortran_align, has_collective, format_results
+from .utils import fortran_align, has_collective
 from .utils import initialize_lpass, disable_varelem, variable_refs
 from ..lattice import Lattice, Element, Refpts, End
 from ..lattice import get_uint32_index
 from ..lattice import AtError, AtWarning, DConstant, random
-from collections.abc import Iterable
+from collections.abc import Iterable, Sequence
 from typing import Optional
 from functools import partial
 import multiprocessing
+from multiprocessing import shared_memory
+import weakref
 from warnings import warn
 from .atpass import reset_rng
 from ..cconfig import iscuda
@@ -19,46 +21,161 @@ if iscuda() or isopencl():
     from .gpu import gpupass as _gpupass
     from .gpu import gpuinfo as _gpuinfo
 
-__all__ = ['lattice_track', 'element_track', 'internal_lpass',
+__all__ = ['lattice_track', 'ensemble_track', 'element_track',
+           'internal_lpass',
            'internal_epass', 'internal_plpass', 'gpu_info']
 
 _imax = numpy.iinfo(int).max
 _globring: Optional[list[Element]] = None
+_globreuse = False
+_globshared: dict[str, numpy.ndarray] = {}
+_coordinates = {'x': 0, 'xp': 1, 'y': 2, 'yp': 3, 'dp': 4, 'ct': 5}
+
+
+def _output_format(kwargs):
+    """Convert the output format options into atpass arguments"""
+    coords = kwargs.pop('output_coords', None)
+    dtype = numpy.dtype(kwargs.pop('output_dtype', numpy.float64))
+    if coords is not None:
+        try:
+            idx = [_coordinates[c] if isinstance(c, str) else int(c)
+                   for c in numpy.atleast_1d(coords)]
+        except KeyError as exc:
+            raise AtError('Allowed coordinates are {0}'.format(
+                ', '.join(_coordinates))) from exc
+        kwargs['coords'] = numpy.array(idx, dtype=numpy.uint32)
+    if dtype == numpy.float32:
+        kwargs['single'] = True
+    elif dtype != numpy.float64:
+        raise AtError('output_dtype must be float64 or float32')
+
+
+def _shared_array(shape, dtype):
+    """Fortran-ordered array in shared memory. The memory is released when
+    the array is deleted"""
+    dtype = numpy.dtype(dtype)
+    nbytes = max(int(numpy.prod(shape)) * dtype.itemsize, 1)
+    shm = shared_memory.SharedMemory(create=True, size=nbytes)
+    array = numpy.ndarray(shape, dtype=dtype, buffer=shm.buf, order='F')
+    weakref.finalize(array, shm.close)
+    return array, shm
+
+
+def _attach_array(name, shape, dtype):
+    """Access from a worker to an array in shared memory"""
+    shm = shared_memory.SharedMemory(name=name)
+    array = numpy.ndarray(shape, dtype=dtype, buffer=shm.buf, order='F')
+    weakref.finalize(array, shm.close)
+    return array
+
+
+def _atpass_init(ring, specs):
+    """Worker initialisation: the lattice is sent once to each process and
+    the shared result arrays are attached"""
+    global _globring, _globreuse, _globshared
+    _globring = ring
+    _globreuse = False
+    _globshared = {k: _attach_array(*spec) for k, spec in specs.items()}
 
 
-def _atpass_fork(seed, rank, rin, **kwargs):
-    """Single forked job"""
-    reset_rng(rank=rank, seed=seed)
-    result = _atpass(_globring, rin, **kwargs)
-    return rin, result
-
-
-def _atpass_spawn(ring, seed, rank, rin, **kwargs):
-    """Single spawned job"""
+def _atpass_job(seed, cache, job, **kwargs):
+    """Single work unit: a chunk of particles over a segment of turns.
+    The results are written in the shared arrays"""
+    global _globreuse
+    rank, cols, turn, t0, t1 = job
     reset_rng(rank=rank, seed=seed)
-    result = _atpass(ring, rin, **kwargs)
-    return rin, result
-
-
-def _pass(ring, r_in, pool_size, start_method, **kwargs):
+    # After its first work unit, a worker keeps its cached lattice
+    kwargs['reuse'] = kwargs.get('reuse', False) or (cache and _globreuse)
+    rin = numpy.asfortranarray(_globshared['rin'][:, cols])
+    result = _atpass(_globring, rin, nturns=t1-t0, turn=turn+t0, **kwargs)
+    _globreuse = True
+    if kwargs.get('losses', False):
+        result, ldic = result
+        lost = ldic['islost']
+        for k, v in ldic.items():
+            _globshared[k][..., cols[lost]] = v[..., lost]
+    _globshared['rin'][:, cols] = rin
+    _globshared['rout'][:, cols, :, t0:t1] = result
+    return len(cols)
+
+
+def _turn_segments(nturns, keep_counter):
+    """Turn segments of doubling length: 1/16, 1/16, 1/8, 1/4, 1/2 of the
+    turns. Lost particles are removed and the survivors are rebalanced
+    between segments"""
+    if keep_counter:
+        return [0, nturns]
+    stops = [nturns >> k for k in range(4, -1, -1)]
+    return numpy.unique([0] + stops)
+
+
+def _pass(ring, r_in, pool_size, start_method, nturns=1, refpts=None,
+          seed=None, rank_offset=0, **kwargs):
     ctx = multiprocessing.get_context(start_method)
-    # Split input in as many slices as processes
-    args = enumerate(numpy.array_split(r_in, pool_size, axis=1))
     # Generate a new starting point for C RNGs
-    seed = random.common.integers(0, high=_imax, dtype=int)
-    global _globring
-    _globring = ring
-    if ctx.get_start_method() == 'fork':
-        passfunc = partial(_atpass_fork, seed, **kwargs)
+    if seed is None:
+        seed = random.common.integers(0, high=_imax, dtype=int)
+    losses = kwargs.get('losses', False)
+    turn = kwargs.pop('turn', 0) or 0
+    segments = _turn_segments(nturns, kwargs.get('keep_counter', False))
+    cache = sum(variable_refs(ring)) == 0
+    npart = r_in.shape[1]
+    coords = kwargs.get('coords', slice(None))
+    ncoords = numpy.arange(6)[coords].size
+    dtype = numpy.float32 if kwargs.get('single', False) else numpy.float64
+    # The workers write their results directly in shared memory
+    shapes = {'rin': ((6, npart), numpy.float64),
+              'rout': ((ncoords, npart, len(refpts), nturns), dtype)}
+    if losses:
+        shapes.update(islost=((npart,), numpy.bool_),
+                      turn=((npart,), numpy.uint32),
+                      elem=((npart,), numpy.uint32),
+                      coord=((6, npart), numpy.float64))
+    shared = {}
+    specs = {}
+    shms = []
+    for k, (shape, dtype) in shapes.items():
+        shared[k], shm = _shared_array(shape, dtype)
+        specs[k] = (shm.name, shape, dtype)
+        shms.append(shm)
+    rin = shared['rin']
+    rout = shared['rout']
+    rin[:] = r_in
+    passfunc = partial(_atpass_job, seed, cache, refpts=refpts, **kwargs)
+    # Each work unit has its own random stream
+    rank = rank_offset
+    try:
+        # Work units are pulled dynamically from the task queue of the pool
+        with ctx.Pool(pool_size, initializer=_atpass_init,
+                      initargs=(ring, specs)) as pool:
+            for t0, t1 in zip(segments[:-1], segments[1:]):
+                # Lost particles do not move anymore
+                if t0 > 0:
+                    lost = numpy.isnan(rin[0])
+                else:
+                    lost = numpy.zeros(npart, dtype=bool)
+                rout[:, lost, :, t0:t1] = rin[coords][:, lost, numpy.newaxis,
+                                                      numpy.newaxis]
+                cols = numpy.flatnonzero(~lost)
+                nchunks = min(len(cols), pool_size * DConstant.patpass_chunks)
+                jobs = []
+                for c in numpy.array_split(cols, max(nchunks, 1)):
+                    if len(c) > 0:
+                        jobs.append((rank, c, turn, t0, t1))
+                        rank += 1
+                for _ in pool.imap_unordered(passfunc, jobs):
+                    pass
+    finally:
+        # The memory remains mapped until the arrays are deleted
+        for shm in shms:
+            shm.unlink()
+    r_in[:] = rin
+    if losses:
+        lossmap = {k: numpy.array(shared[k]) for k in
+                   ('islost', 'turn', 'elem', 'coord')}
+        return rout, lossmap
     else:
-        passfunc = partial(_atpass_spawn, ring, seed, **kwargs)
-    # Start the parallel jobs
-    with ctx.Pool(pool_size) as pool:
-        results = pool.starmap(passfunc, args)
-    _globring = None
-    # Gather the results
-    losses = kwargs.pop('losses', False)
-    return format_results(results, r_in, losses)
+        return rout
 
 
 @fortran_align
@@ -78,6 +195,8 @@ def _lattice_pass(lattice: list[Element], r_in, nturns: int = 1,
     refs = get_uint32_index(lattice, refpts)
     use_gpu = kwargs.pop('use_gpu', False)
     if use_gpu:
+        if 'coords' in kwargs or kwargs.get('single', False):
+            raise AtError("The output format cannot be selected on GPU")
         if not (iscuda() or isopencl()):
             raise AtError("No GPU support enabled")
         else:
@@ -107,9 +226,87 @@ def _plattice_pass(lattice: list[Element], r_in, nturns: int = 1,
             warn(AtWarning('Collective PassMethod found: use single process'))
         else:
             warn(AtWarning('no parallel computation for a single particle'))
+        kwargs.pop('seed', None)
+        kwargs.pop('rank_offset', None)
         return _atpass(lattice, r_in, nturns=nturns, refpts=refpts, **kwargs)
 
 
+def _mpi_track(lattice, r_in, nturns, refpts, in_place, **kwargs):
+    """Tracking of particles distributed over MPI ranks"""
+    try:
+        from mpi4py import MPI
+    except ImportError as exc:
+        raise AtError('use_mpi requires mpi4py') from exc
+    if has_collective(lattice) and not DConstant.mpi:
+        raise AtError('Collective elements need pyAT compiled with MPI')
+    comm = MPI.COMM_WORLD
+    rank = comm.Get_rank()
+    root = (rank == 0)
+    # Scatter the particles of rank 0 in contiguous shares
+    npart = comm.bcast(numpy.shape(r_in)[1] if root else None, root=0)
+    counts = numpy.full(comm.Get_size(), npart // comm.Get_size())
+    counts[:npart % comm.Get_size()] += 1
+    displs = numpy.cumsum(counts) - counts
+
+    def layout(size):
+        return (size*counts).tolist(), (size*displs).tolist()
+
+    r_glob = numpy.asfortranarray(r_in) if root else None
+    r_loc = numpy.empty((6, counts[rank]), order='F')
+    comm.Scatterv([r_glob.reshape(-1, order='F'), *layout(6), MPI.DOUBLE]
+                  if root else None, r_loc.reshape(-1, order='F'), root=0)
+    # Independent random streams on each rank
+    seed = random.common.integers(0, high=_imax, dtype=int) if root else None
+    seed = comm.bcast(seed, root=0)
+    reset_rng(rank=rank, seed=seed)
+    if kwargs.get('use_mp', False):
+        # The work units of each rank use disjoint ranges of streams
+        kwargs.update(seed=seed, rank_offset=rank << 32)
+
+    rout, trackparam, trackdata = lattice_track(lattice, r_loc, nturns,
+                                                refpts=refpts, in_place=True,
+                                                **kwargs)
+
+    # Gather the results on rank 0
+    ncoords = rout.shape[0]
+    outtype = MPI.FLOAT if rout.dtype == numpy.float32 else MPI.DOUBLE
+    if root:
+        r_fin = numpy.empty((6, npart), order='F')
+        rout_glob = numpy.empty((ncoords, npart) + rout.shape[2:],
+                                dtype=rout.dtype, order='F')
+        lm_glob = numpy.recarray((npart,), trackdata['loss_map'].dtype)
+    comm.Gatherv(r_loc.reshape(-1, order='F'),
+                 [r_fin.reshape(-1, order='F'), *layout(6), MPI.DOUBLE]
+                 if root else None, root=0)
+    # Each (refpt, turn) block of the output is contiguous. The shape is
+    # explicit because a rank may have no particles
+    nblocks = int(numpy.prod(rout.shape[2:]))
+    sendcols = rout.reshape((ncoords*counts[rank], nblocks), order='F')
+    if root:
+        recvcols = rout_glob.reshape((ncoords*npart, nblocks), order='F')
+    for k in range(sendcols.shape[1]):
+        comm.Gatherv(numpy.ascontiguousarray(sendcols[:, k]),
+                     [recvcols[:, k], *layout(ncoords), outtype] if root
+                     else None, root=0)
+    if kwargs.get('losses', False):
+        lm = trackdata['loss_map']
+        itemsize = lm.dtype.itemsize
+        comm.Gatherv(numpy.ascontiguousarray(lm).view(numpy.uint8),
+                     [lm_glob.view(numpy.uint8), *layout(itemsize),
+                      MPI.BYTE] if root else None, root=0)
+
+    if not root:
+        # Other ranks keep the results of their own share
+        return rout, trackparam, trackdata
+    if in_place:
+        r_in[:] = r_fin
+    else:
+        r_in = r_fin
+    trackparam.update({'npart': npart, 'rout': r_in})
+    trackdata.update({'loss_map': lm_glob})
+    return rout_glob, trackparam, trackdata
+
+
 def lattice_track(lattice: Iterable[Element], r_in,
                   nturns: int = 1, refpts: Refpts = End,
                   in_place: bool = False, **kwargs):
@@ -148,12 +345,33 @@ def lattice_track(lattice: Iterable[Element], r_in,
         losses (bool):          Boolean to activate loss maps output
         omp_num_threads (int):  Number of OpenMP threads
           (default: automatic)
-        use_mp (bool): Flag to activate multiprocessing (default: False)
+        output_coords:          Coordinates stored in *r_out*, as indices
+          or names among ``'x'``, ``'xp'``, ``'y'``, ``'yp'``, ``'dp'``,
+          ``'ct'``. Default: all 6 coordinates
+        output_dtype:           :py:obj:`numpy.float64` (default) or
+          :py:obj:`numpy.float32`: precision of *r_out*. The tracking
+          itself is always done in double precision
+        use_mp (bool): Flag to activate multiprocessing (default: False).
+          The particles are split in small work units pulled dynamically
+          by the processes. The turns are tracked in segments of doubling
+          length, lost particles being removed and the survivors
+          redistributed between segments. The number of work units per
+          process is set by *at.lattice.DConstant.patpass_chunks*. The
+          processes write their results directly in a shared memory
+          output array
         pool_size:              number of processes used when
           *use_mp* is :py:obj:`True`. If None, ``min(npart,nproc)``
           is used. It can be globally set using the variable
           *at.lattice.DConstant.patpass_poolsize*
         use_gpu (bool): Flag to activate GPU processing (default: False)
+        use_mpi (bool): Distribute the particles over the MPI ranks
+          (default: False). All ranks must call the function. The particles
+          given on rank 0 are scattered in equal shares, each rank tracks its
+          share with independent random streams, and rank 0 gathers the
+          results and loss map of all particles. The other ranks return the
+          results of their own share and may give :py:obj:`None` as *r_in*.
+          It may be combined with *use_mp*: the processes of all ranks then
+          have distinct random streams. Requires :py:mod:`mpi4py`
 	gpu_pool: List of GPU to use (default [0])
         start_method:           python multiprocessing start method.
           :py:obj:`None` uses the python default that is considered safe.
@@ -181,8 +399,8 @@ def lattice_track(lattice: Iterable[Element], r_in,
     *rest_energy* is ignored.
 
     Returns:
-        r_out: (6, N, R, T) array containing output coordinates of N particles
-          at R reference points for T turns
+        r_out: (C, N, R, T) array containing the C output coordinates
+          (default 6) of N particles at R reference points for T turns
         trackparam: A dictionary containing tracking input parameters with the
           following keys:
 
@@ -240,6 +458,9 @@ def lattice_track(lattice: Iterable[Element], r_in,
          the true voltage in each bucket and distributes the particles in the
          bunches defined by :code:`ring.fillpattern` using a 6D orbit search.
     """
+    if kwargs.pop('use_mpi', False):
+        return _mpi_track(lattice, r_in, nturns, refpts, in_place, **kwargs)
+    _output_format(kwargs)
     trackdata = {}
     trackparam = {}
     part_kw = ['energy', 'particle']
@@ -248,13 +469,13 @@ def lattice_track(lattice: Iterable[Element], r_in,
     except IndexError:
         npart = 1
 
-    [trackparam.update((kw, kwargs.get(kw))) for kw in kwargs if kw in part_kw]
+    [trackparam.update({kw: kwargs.get(kw)}) for kw in kwargs if kw in part_kw]
     trackparam.update({'npart': npart})
 
     if not in_place:
         r_in = r_in.copy()
 
-    lattice = initialize_lpass(lattice, nturns, kwargs)
+    lattice = initialize_lpass(lattice, nturns, kwargs, npart=npart)
     ldtype = [('islost', numpy.bool_),
               ('turn', numpy.uint32),
               ('elem', numpy.uint32),
@@ -262,7 +483,7 @@ def lattice_track(lattice: Iterable[Element], r_in,
               ]
     loss_map = numpy.recarray((npart,), ldtype)
     lat_kw = ['turn']
-    [trackparam.update((kw, kwargs.get(kw)))
+    [trackparam.update({kw: kwargs.get(kw)})
      for kw in kwargs if kw in lat_kw]
     trackparam.update({'refpts': get_uint32_index(lattice, refpts),
                        'nturns': nturns})
@@ -292,6 +513,197 @@ def lattice_track(lattice: Iterable[Element], r_in,
     return rout, trackparam, trackdata
 
 
+@fortran_align
+def _ensemble_pass(lattices: list[list[Element]], r_in, nturns: int = 1,
+                   refpts: Refpts = End, **kwargs):
+    kwargs['reuse'] = kwargs.pop('keep_lattice', False)
+    if any(sum(variable_refs(lat)) > 0 for lat in lattices):
+        kwargs['reuse'] = False
+    refs = get_uint32_index(lattices[0], refpts)
+    line = [elem for lat in lattices for elem in lat]
+    return _atpass(line, r_in, nturns, refpts=refs, nseeds=len(lattices),
+                   **kwargs)
+
+
+def _ensemble_job(seed, job, **kwargs):
+    """Single work unit: a group of seeds with their particles"""
+    rank, lattices, rin = job
+    reset_rng(rank=rank, seed=seed)
+    rin = numpy.asfortranarray(rin)
+    result = _ensemble_pass(lattices, rin, **kwargs)
+    return rin, result
+
+
+def _pensemble_pass(lattices: list[list[Element]], r_in, nturns: int = 1,
+                    refpts: Refpts = End, pool_size: int = None,
+                    start_method: str = None, **kwargs):
+    nseeds = len(lattices)
+    if pool_size is None:
+        pool_size = min(nseeds, multiprocessing.cpu_count(),
+                        DConstant.patpass_poolsize)
+    if start_method is None:
+        start_method = DConstant.patpass_startmethod
+    ctx = multiprocessing.get_context(start_method)
+    # Generate a new starting point for C RNGs
+    seed = random.common.integers(0, high=_imax, dtype=int)
+    # The worker processes have no persisted lattice
+    kwargs.pop('keep_lattice', None)
+    nper = r_in.shape[1] // nseeds
+    groups = [g for g in numpy.array_split(numpy.arange(nseeds), pool_size)
+              if len(g) > 0]
+    jobs = [(rank, [lattices[s] for s in g],
+             r_in[:, g[0]*nper:(g[-1]+1)*nper])
+            for rank, g in enumerate(groups)]
+    passfunc = partial(_ensemble_job, seed, nturns=nturns, refpts=refpts,
+                       **kwargs)
+    with ctx.Pool(len(jobs)) as pool:
+        results = pool.map(passfunc, jobs)
+    r_in[:] = numpy.concatenate([rin for rin, _ in results], axis=1)
+    if kwargs.get('losses', False):
+        routs, lms = zip(*(result for _, result in results))
+        lossmap = {k: numpy.concatenate([lm[k] for lm in lms], axis=-1)
+                   for k in lms[0]}
+        return numpy.concatenate(routs, axis=1), lossmap
+    else:
+        return numpy.concatenate([result for _, result in results], axis=1)
+
+
+def ensemble_track(lattices: Sequence[Iterable[Element]], r_in,
+                   nturns: int = 1, refpts: Refpts = End,
+                   in_place: bool = False, **kwargs):
+    """
+    :py:func:`ensemble_track` tracks particles through an ensemble of
+    lattices sharing the same structure, typically the error seeds of a
+    machine, in a single tracking call.
+
+    The lattices must have the same number of elements with the same
+    *PassMethod*, while all the other element attributes (misalignments,
+    field errors...) may differ. All lattices are advanced together element
+    by element: the element parameters are parsed once, and the group of
+    particles attached to each lattice is tracked by the element of its own
+    lattice.
+
+    Usage:
+      >>> seeds = [ring.deepcopy() for _ in range(100)]
+      >>> # ...apply errors to each seed...
+      >>> rout, *_ = ensemble_track(seeds, numpy.tile(r0, len(seeds)))
+
+    Parameters:
+        lattices: sequence of S lattices with the same structure
+        r_in: (6, S*N) array: input coordinates of N particles for each
+          lattice. Columns ``s*N`` to ``(s+1)*N-1`` are tracked in
+          ``lattices[s]``. Use :pycode:`numpy.tile(r0, S)` to track the
+          same (6, N) particles in all lattices. *r_in* is modified in-place
+          only if *in_place* is :py:obj:`True`.
+
+    Keyword arguments:
+        nturns: number of turns to be tracked
+        refpts: Selects the location of coordinates output.
+          See ":ref:`Selecting elements in a lattice <refpts>`"
+        in_place (bool): If True *r_in* is modified in-place and
+          reports the coordinates at the end of the element.
+          (default: False)
+        keep_lattice (bool):    Use elements persisted from a previous
+          call. If :py:obj:`True`, assume that the lattices have not changed
+          since the previous call.
+        keep_counter (bool):    Keep the turn number from the previous
+          call.
+        turn (int):             Starting turn number. Ignored if
+          *keep_counter* is :py:obj:`True`.
+        losses (bool):          Boolean to activate loss maps output
+        omp_num_threads (int):  Number of OpenMP threads
+          (default: automatic)
+        output_coords:          Coordinates stored in *r_out*, see
+          :py:func:`lattice_track`
+        output_dtype:           Precision of *r_out*, see
+          :py:func:`lattice_track`
+        use_mp (bool):          Flag to distribute the seeds over several
+          processes. Each process tracks a group of seeds in a single call
+          (default: False)
+        pool_size:              number of processes used when
+          *use_mp* is :py:obj:`True`. If None, ``min(nseeds,nproc)``
+          is used. It can be globally set using the variable
+          *at.lattice.DConstant.patpass_poolsize*
+        start_method:           python multiprocessing start method, see
+          :py:func:`lattice_track`
+        particle (Optional[Particle]): circulating particle.
+          Default: :code:`lattices[0].particle` if existing,
+          otherwise :code:`Particle('relativistic')`
+        energy (Optiona[float]): lattice energy. Default 0.
+
+    Returns:
+        r_out: (C, S*N, R, T) array containing output coordinates of the
+          particles at R reference points for T turns
+        trackparam: A dictionary containing tracking input parameters, as
+          for :py:func:`lattice_track`, with the additional key **nseeds**
+        trackdata: A dictionary containing tracking data, as for
+          :py:func:`lattice_track`
+
+    See also:
+        :py:func:`lattice_track`
+    """
+    if kwargs.pop('use_gpu', False):
+        raise AtError('ensemble_track does not support use_gpu')
+    use_mp = kwargs.pop('use_mp', False)
+    start_method = kwargs.pop('start_method', None)
+    pool_size = kwargs.pop('pool_size', None)
+    _output_format(kwargs)
+    trackdata = {}
+    trackparam = {}
+    part_kw = ['energy', 'particle']
+    try:
+        npart = numpy.shape(r_in)[1]
+    except IndexError:
+        npart = 1
+    nseeds = len(lattices)
+    if nseeds == 0 or npart % nseeds != 0:
+        raise AtError('The number of particles must be a multiple '
+                      'of the number of lattices')
+
+    [trackparam.update({kw: kwargs.get(kw)}) for kw in kwargs if kw in part_kw]
+    trackparam.update({'npart': npart, 'nseeds': nseeds})
+
+    if not in_place:
+        r_in = r_in.copy()
+
+    lattice0 = initialize_lpass(lattices[0], nturns, kwargs,
+                                npart=npart // nseeds)
+    lattices = [lattice0] + [initialize_lpass(lat, nturns, {},
+                                              npart=npart // nseeds)
+                             for lat in lattices[1:]]
+    if any(len(lat) != len(lattice0) for lat in lattices):
+        raise AtError('All lattices must have the same number of elements')
+    ldtype = [('islost', numpy.bool_),
+              ('turn', numpy.uint32),
+              ('elem', numpy.uint32),
+              ('coord', numpy.float64, (6,)),
+              ]
+    loss_map = numpy.recarray((npart,), ldtype)
+    [trackparam.update({kw: kwargs.get(kw)})
+     for kw in kwargs if kw == 'turn']
+    trackparam.update({'refpts': get_uint32_index(lattice0, refpts),
+                       'nturns': nturns})
+
+    if use_mp and not any(has_collective(lat) for lat in lattices):
+        rout = _pensemble_pass(lattices, r_in, nturns=nturns, refpts=refpts,
+                               pool_size=pool_size,
+                               start_method=start_method, **kwargs)
+    else:
+        rout = _ensemble_pass(lattices, r_in, nturns=nturns, refpts=refpts,
+                              **kwargs)
+
+    if kwargs.get('losses', False):
+        rout, lm = rout
+        lm['coord'] = lm['coord'].T
+        for k, v in lm.items():
+            loss_map[k] = v
+
+    trackdata.update({'loss_map': loss_map})
+    trackparam.update({'rout': r_in})
+
+    return rout, trackparam, trackdata
+
+
 def element_track(element: Element, r_in, in_place: bool = False, **kwargs):
     """
     :py:func:`element_track` tracks particles through one element of a
@@ -7,7 +7,7 @@ import functools
 from collections.abc import Sequence, Iterable
 from typing import Optional
 from ..lattice import Lattice, Element
-from ..lattice import BeamMoments, Collective, QuantumDiffusion
+from ..lattice import BeamMoments, TuneMonitor, Collective, QuantumDiffusion
 from ..lattice import SimpleQuantDiff, VariableMultipole
 from ..lattice import elements, refpts_iterator, set_value_refpts
 from ..lattice import DConstant, checktype, checkattr, get_bool_index
@@ -19,18 +19,22 @@ __all__ = ['fortran_align', 'get_bunches', 'format_results',
 
 
 DIMENSION_ERROR = 'Input to lattice_pass() must be a 6xN array.'
-_COLLECTIVE_ELEMS = (BeamMoments, Collective)
+_COLLECTIVE_ELEMS = (BeamMoments, TuneMonitor, Collective)
 _VAR_ELEMS = (QuantumDiffusion, SimpleQuantDiff, VariableMultipole)
 _DISABLE_ELEMS = _COLLECTIVE_ELEMS + _VAR_ELEMS
 
 
-def _set_beam_monitors(ring: Sequence[Element], nbunch: int, nturns: int):
+def _set_beam_monitors(ring: Sequence[Element], nbunch: int, nturns: int,
+                       npart: int = 1):
     """Function to initialize the beam monitors"""
     monitors = list(refpts_iterator(ring, elements.BeamMoments))
     monitors += list(refpts_iterator(ring, elements.SliceMoments))
     for m in monitors:
         m.set_buffers(nturns, nbunch)  
-    return len(monitors) == 0
+    tune_monitors = list(refpts_iterator(ring, elements.TuneMonitor))
+    for m in tune_monitors:
+        m.set_buffers(nturns, npart)
+    return len(monitors) + len(tune_monitors) == 0
 
 
 def variable_refs(ring):
@@ -67,14 +71,14 @@ def _get_bunch_config(lattice, unfoldbeam):
 
 
 def initialize_lpass(lattice: Iterable[Element], nturns: int,
-                     kwargs) -> list[Element]:
+                     kwargs, npart: int = 1) -> list[Element]:
     """Function to initialize keyword arguments for lattice tracking"""
     if not isinstance(lattice, list):
         lattice = list(lattice)
     unfoldbeam = kwargs.pop('unfold_beam', True)
     nbunch, bspos, bcurrents = _get_bunch_config(lattice, unfoldbeam)
     kwargs.update(bunch_currents=bcurrents, bunch_spos=bspos)
-    no_bm = _set_beam_monitors(lattice, nbunch, nturns)
+    no_bm = _set_beam_monitors(lattice, nbunch, nturns, npart)
     kwargs['keep_lattice'] = kwargs.get('keep_lattice', False) and no_bm
     pool_size = kwargs.pop('pool_size', None)
     start_method = kwargs.pop('start_method', None)
@@ -1,5 +1,6 @@
 import at
 import numpy
+import pytest
 from numpy.testing import assert_allclose
 
 
@@ -18,11 +19,94 @@ def test_1d_acceptance_refpts(hmba_lattice):
     assert_allclose(acceptance, expected, atol=1e-6)
 
 
-def test_2d_acceptance(hmba_lattice):
+@pytest.mark.parametrize('screen_turns', [None, 1024])
+def test_2d_acceptance(hmba_lattice, screen_turns):
     hmba_lattice = hmba_lattice.radiation_off(copy=True)
     acceptance, _, _ = hmba_lattice.get_acceptance(['x', 'y'], [10, 5],
                                                    [10.0e-3, 10.0e-3],
-                                                   grid_mode=at.GridMode.RECURSIVE)
+                                                   grid_mode=at.GridMode.RECURSIVE,
+                                                   screen_turns=screen_turns)
     expected = numpy.array([[-0.01125, -0.0053033, 0., 0.00574524, 0.010625],
                             [0., 0.0053033, 0.006875, 0.00574524, 0.]])
     assert_allclose(acceptance, expected, atol=1e-6, rtol=1.0e-4)
+
+
+def test_acceptances(hmba_lattice):
+    hmba_lattice = hmba_lattice.radiation_off(copy=True)
+    scans = [at.AcceptanceScan(['x', 'y'], [7, 5], [8.0e-3, 3.0e-3],
+                               refpt=r) for r in (0, 37)]
+    scans.append(at.AcceptanceScan('x', 10, 1.0e-3, refpt=10,
+                                   grid_mode=at.GridMode.RECURSIVE))
+    results = hmba_lattice.get_acceptances(scans, nturns=200, verbose=False)
+    for scan, (boundary, survived, _) in zip(scans, results):
+        mode = scan.grid_mode or at.GridMode.RADIAL
+        expected, s0, _ = hmba_lattice.get_acceptance(
+            scan.planes, scan.npoints, scan.amplitudes, nturns=200,
+            refpts=scan.refpt, grid_mode=mode, verbose=False)
+        assert_allclose(boundary, expected, atol=1e-12)
+        assert numpy.shape(survived) == numpy.shape(s0)
+
+
+@pytest.mark.parametrize('endrefpt', [None, 60])
+def test_projectrefpts(hmba_lattice, endrefpt):
+    # Comparison with the tracking of each reference point on the
+    # rotated ring. endrefpt=60 wraps around for the downstream refpts
+    from at.acceptance.momap_alternative import projectrefpts
+    ring = hmba_lattice.radiation_off(copy=True)
+    nelems = len(ring)
+    rps = numpy.array([0, 20, 70, 100])
+    particles = numpy.zeros((6, 3, len(rps), 1))
+    particles[0] = numpy.array([1.e-4, 2.e-3, 3.e-2])[:, None, None]
+    particles[2] = 1.e-5
+    kwargs = {} if endrefpt is None else {'endrefpt': endrefpt}
+    zout, lost = projectrefpts(ring, rps, particles, **kwargs)
+    end = nelems if endrefpt is None else endrefpt
+    for i, rp in enumerate(rps):
+        stop = end - rp if end >= rp else end - rp + nelems
+        zref, *_ = ring.rotate(rp).track(particles[:, :, i, 0].copy(),
+                                         nturns=1, refpts=stop)
+        numpy.testing.assert_array_equal(zout[:, :, i, 0], zref[:, :, 0, 0])
+        numpy.testing.assert_array_equal(lost[:, i],
+                                         numpy.isnan(zref[0, :, 0, 0]))
+    assert numpy.any(lost) and not numpy.all(lost)
+    with pytest.warns(at.AtWarning, match='use_mp'):
+        zmp, _ = projectrefpts(ring, rps, particles, use_mp=True, **kwargs)
+    numpy.testing.assert_array_equal(zmp, zout)
+
+
+def test_multirefpts_track_islost(hmba_lattice):
+    # Comparison with the tracking of each reference point on the
+    # rotated ring: first to the end of the ring, then for nturns turns
+    from at.acceptance.momap_alternative import multirefpts_track_islost
+    ring = hmba_lattice.radiation_off(copy=True)
+    nelems = len(ring)
+    rps = numpy.array([0, 20, 70, 100])
+    _, orbit = ring.find_orbit(rps)
+    offsets = numpy.full((2, len(rps)), 1.e-5)
+    dppos = numpy.array([0.01, 0.03, 0.05, 0.07])
+    lost = multirefpts_track_islost(ring, rps, dppos, -dppos, orbit, offsets,
+                                    50, 0, False)
+    for i, rp in enumerate(rps):
+        z = numpy.tile(orbit[i], (2, 1)).T
+        z[0] += offsets[0, i]
+        z[2] += offsets[1, i]
+        z[4] += [dppos[i], -dppos[i]]
+        zend, *_ = ring.rotate(rp).track(z, nturns=1, refpts=nelems - rp)
+        z = zend[:, :, 0, 0].copy()
+        ring.track(z, nturns=50, in_place=True)
+        numpy.testing.assert_array_equal(lost[2*i:2*i+2], numpy.isnan(z[0]))
+    assert numpy.any(lost) and not numpy.all(lost)
+
+
+def test_touschek_integral():
+    from scipy import integrate
+    from at.acceptance.touschek import int_piwinski, _int_piwinski_quad
+    km = numpy.arctan(numpy.array([0.01, 0.03, 0.05]))
+    B1 = numpy.array([6104.6, 1200.0, 350.0])
+    B2 = numpy.array([6088.0, 300.0, 10.0])
+    expected = [integrate.quad(int_piwinski, k, numpy.pi/2, args=(k, b1, b2),
+                               epsabs=1.0e-16, epsrel=1.0e-12)[0]
+                for k, b1, b2 in zip(km, B1, B2)]
+    assert_allclose(_int_piwinski_quad(km, B1, B2), expected, rtol=1.0e-9)
+    with pytest.warns(at.AtWarning):
+        _int_piwinski_quad(km, B1, B2, epsabs=0.0, epsrel=0.0, maxpanels=32)
@@ -4,8 +4,11 @@ import pytest
 import warnings
 from numpy.testing import assert_allclose as assert_close
 from at.collective import Wake, WakeElement, ResonatorElement
-from at.collective import WakeComponent, ResWallElement
+from at.collective import WakeComponent, WakeType, ResWallElement
+from at.collective import PhasorResonatorElement
 from at.collective import add_beamloading, remove_beamloading, BLMode
+from at.collective import beamloading_equilibrium
+from at.collective import ibs_rates, ibs_equilibrium, IBSMethod
 from at import lattice_track
 from at import lattice_pass, internal_lpass
 
@@ -176,3 +179,142 @@ def test_buffers(hmba_lattice):
         dvbbh = numpy.sum(vbbh[i-1, :, (nturns-i):]
                           - vbbh[i, :, (nturns-i-1):(nturns-1)])
     assert_close([dth, dvbh, dvgh, dvbbh], numpy.zeros(4), atol=1e-9)
+
+
+def test_wake_table_lookup(hmba_lattice):
+    # A linear wake is exactly interpolated on any table: uniform and
+    # non-uniform tables must give the same kicks
+    ring = hmba_lattice.enable_6d(copy=True)
+    ring.set_fillpattern(2)
+    ring.beam_current = 0.2
+    sunif = numpy.linspace(-0.1, 10.0, 1001)
+    snonunif = Wake.build_srange(-0.1, 0.1, 1.0e-4, 1.0e-2, 1.0, 10.0)
+    rin = numpy.zeros((6, 400))
+    rin[0] = numpy.linspace(-1.0e-4, 1.0e-4, 400)
+    rin[5] = numpy.linspace(-1.0e-2, 1.0e-2, 400)
+    r0 = rin.copy()
+    ring.track(r0, refpts=None, in_place=True)
+    rout = []
+    for srange in (sunif, snonunif):
+        wake = Wake(srange)
+        wake.add(WakeType.TABLE, WakeComponent.Z, srange, 1.0e12*(1+srange))
+        wake.add(WakeType.TABLE, WakeComponent.DX, srange, 1.0e15*srange)
+        wring = ring.deepcopy()
+        wring.append(WakeElement('WELEM', ring, wake, Nslice=21))
+        r = rin.copy()
+        wring.track(r, refpts=None, in_place=True)
+        rout.append(r)
+    assert not numpy.allclose(rout[0], r0, rtol=1e-6, atol=0)
+    assert_close(rout[0], rout[1], rtol=1e-10, atol=1e-20)
+
+
+def test_phasor_resonator_modes(hmba_lattice):
+    # Modes in a single element must give the same kicks as separate elements
+    ring = hmba_lattice.enable_6d(copy=True)
+    ring.set_fillpattern(4)
+    ring.beam_current = 0.2
+    frf = ring.get_rf_frequency()
+    freq = frf*numpy.array([2.3, 3.7])
+    qfactor = numpy.array([1.0e4, 3.0e4])
+    rshunt = numpy.array([1.0e5, 2.0e5])
+    ring1 = ring.deepcopy()
+    hom = PhasorResonatorElement('HOMS', ring, freq, qfactor, rshunt, Nslice=11)
+    ring1.append(hom)
+    assert hom.Vbeam.shape == (2, 2)
+    ring2 = ring.deepcopy()
+    homs = [PhasorResonatorElement('HOM', ring, f, q, r, Nslice=11)
+            for f, q, r in zip(freq, qfactor, rshunt)]
+    ring2.extend(homs)
+    rin = numpy.zeros((6, 400))
+    rin[5] = numpy.linspace(-1.0e-2, 1.0e-2, 400)
+    r1 = rin.copy()
+    r2 = rin.copy()
+    ring1.track(r1, nturns=3, refpts=None, in_place=True)
+    ring2.track(r2, nturns=3, refpts=None, in_place=True)
+    assert_close(r1, r2, rtol=1e-10, atol=1e-16)
+    assert_close(hom.Vbeam, numpy.vstack([h.Vbeam for h in homs]), rtol=1e-10)
+    assert numpy.all(hom.Vbeam[:, 0] > 0)
+
+
+def test_beamloading_equilibrium(hmba_lattice):
+    ring = hmba_lattice.enable_6d(copy=True)
+    ring.periodicity = 1
+    fp = numpy.zeros(ring.harmonic_number)
+    fp[:8] = 1
+    ring.set_fillpattern(fp)
+    ring.beam_current = 0.2
+    add_beamloading(ring, 44e3, 400e3)
+    eq = beamloading_equilibrium(ring)
+    assert eq.converged
+    cav = ring.get_elements(at.RFCavity)[0]
+    assert_close(cav.Vgen, eq.vgen[0], rtol=0)
+    # Start tracking from the equilibrium profiles
+    nb = ring.nbunch
+    npb = 100
+    rng = numpy.random.default_rng(1)
+    rin = numpy.zeros((6, nb*npb))
+    rin[4] = rng.normal(0, 9.3e-4, nb*npb)
+    for ib in range(nb):
+        cdf = numpy.cumsum(eq.profile[ib])
+        rin[5, ib::nb] = numpy.interp((numpy.arange(npb)+0.5)/npb,
+                                      cdf/cdf[-1], eq.z[ib])
+    ring.track(rin, nturns=2, refpts=[], in_place=True)
+    assert_close(cav.Vbeam, eq.vbeam[0], rtol=2.e-3)
+    assert_close(cav.Vgen, eq.vgen[0], rtol=2.e-3)
+
+
+def test_haissinski_jacobian(hmba_lattice):
+    from at.collective.haissinski import Haissinski
+    ring = hmba_lattice.radiation_on(copy=True)
+    srange = Wake.build_srange(0., 0.36, 1.0e-5, 1.0e-2,
+                               ring.circumference, ring.circumference)
+    wobj = Wake.long_resonator(srange, 10e9, 1, 1e4, ring.beta)
+    ha = Haissinski(wobj, ring, m=10, kmax=6, current=5e-4)
+    ha.dFi_dphij()
+    # vectorised Jacobian matches the element-wise expression
+    jac = numpy.array([[ha.dFi_ij(i, j) for j in range(ha.npoints)]
+                       for i in range(ha.npoints)])
+    assert_close(ha.alldFi_dphij, jac, rtol=1e-12, atol=0)
+    ha.solve()
+    ha.Fi()
+    assert numpy.amax(numpy.abs(ha.allFi)) < 1e-10*ha.Ic
+
+
+
+def test_haissinski_warm_start(hmba_lattice, capsys):
+    from at.collective.haissinski import Haissinski
+    ring = hmba_lattice.radiation_on(copy=True)
+    srange = Wake.build_srange(0., 0.36, 1.0e-5, 1.0e-2,
+                               ring.circumference, ring.circumference)
+    wobj = Wake.long_resonator(srange, 10e9, 1, 1e4, ring.beta)
+    ha = Haissinski(wobj, ring, m=10, kmax=6, current=5e-4)
+    ha.solve()
+    res = ha.res.copy()
+    ha.phi = ha.phi_1.copy()
+    capsys.readouterr()
+    # The first step starts from the existing solution
+    ha.solve_steps([5e-4, 1e-3])
+    out = capsys.readouterr().out.split('Running step  2')
+    assert 'Iteration:  1' not in out[0]
+    assert_close(ha.res_steps[0], res, rtol=1e-10, atol=1e-10*abs(ha.Ic))
+
+
+def test_ibs(hmba_lattice):
+    ring = hmba_lattice.radiation_on(copy=True)
+    ring.periodicity = 1
+    rp = ring.radiation_parameters()
+    args = (rp.emittances[0], 1.0e-11, rp.sigma_e, rp.sigma_l, 8.0e-4)
+    rbm, lbm = ibs_rates(ring, *args, method=IBSMethod.BM)
+    rbane, _ = ibs_rates(ring, *args, method=IBSMethod.BANE)
+    assert lbm.shape == (len(ring)+1, 3)
+    # Bane's high energy approximation agrees with Bjorken-Mtingwa
+    assert_close(rbane[[0, 2]], rbm[[0, 2]], rtol=0.1)
+    eq = ibs_equilibrium(ring, 8.0e-4, emity=1.0e-11)
+    assert eq.converged
+    assert eq.emitx > rp.emittances[0]
+    assert eq.sigma_e > rp.sigma_e
+    assert_close(eq.emity, 1.0e-11, rtol=1e-3)
+    with pytest.warns(at.AtWarning, match='not converged'):
+        eq = ibs_equilibrium(ring, 8.0e-4, emity=1.0e-11, maxiter=1)
+    assert not eq.converged
+    assert eq.niter == 1
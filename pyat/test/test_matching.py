@@ -98,3 +98,82 @@ def test_envelope_matching(test_ring):
     lopresidual = lopcst.evaluate(newring.radiation_on(copy=True))
     assert_close(linresidual, 0, rtol=0.0, atol=6e-9)
     assert_close(lopresidual, 0, rtol=0.0, atol=3e-8)
+
+
+@pytest.mark.parametrize('workers, broyden', [(1, True), (2, False)])
+def test_matching_jacobian(test_ring, workers, broyden):
+    names = ['QF1*', 'QD2*']
+    variables = [at.ElementVariable(at.get_refpts(test_ring, nm), 'PolynomB',
+                                    index=1, name=nm) for nm in names]
+    cst = at.LinoptConstraints(test_ring)
+    cst.add('tunes', [0.38, 0.85], name='tunes')
+
+    newring = at.match(test_ring, variables, (cst,), verbose=1,
+                       workers=workers, broyden=broyden)
+
+    assert_close(cst.evaluate(newring), 0, rtol=0.0, atol=1e-8)
+
+
+def test_broyden_not_converged(test_ring):
+    variables = [at.ElementVariable(at.get_refpts(test_ring, 'QF1*'),
+                                    'PolynomB', index=1, name='QF1')]
+    cst = at.LinoptConstraints(test_ring)
+    cst.add('tunes', 0.38, index=0, name='tunex')
+    with pytest.warns(at.AtWarning):
+        at.match(test_ring, variables, (cst,), verbose=0, max_nfev=2,
+                 broyden=True)
+
+
+def test_fit_tune(hmba_lattice):
+    ring = hmba_lattice.deepcopy()
+    at.fit_tune(ring, 'QF1*', 'QD2*', [0.38, 0.85])
+    assert_close(ring.get_tune()[:2], [0.38, 0.85], rtol=0.0, atol=1e-6)
+
+
+def test_fit_chrom(hmba_lattice):
+    ring = hmba_lattice.deepcopy()
+    at.fit_chrom(ring, 'SF*', 'SD*', [1.0, 1.0])
+    assert_close(ring.get_chrom()[:2], [1.0, 1.0], rtol=0.0, atol=1e-6)
+
+
+@pytest.mark.parametrize('broyden', [False, True])
+def test_matching_in_place(test_ring, broyden, monkeypatch, capsys):
+    from at.matching import matching
+    names = ['QF1*', 'QD2*']
+    variables = [at.ElementVariable(at.get_refpts(test_ring, nm), 'PolynomB',
+                                    index=1, name=nm) for nm in names]
+    cst = at.LinoptConstraints(test_ring)
+    cst.add('tunes', [0.38, 0.85], name='tunes')
+
+    # Record the solution returned by the solver
+    solution = []
+    least_squares = matching.least_squares
+    broyden_solve = matching._broyden_solve
+
+    def lsq(*args, **kwargs):
+        res = least_squares(*args, **kwargs)
+        solution.append(res.x)
+        return res
+
+    def brd(*args, **kwargs):
+        res = broyden_solve(*args, **kwargs)
+        solution.append(res[0])
+        return res
+
+    monkeypatch.setattr(matching, 'least_squares', lsq)
+    monkeypatch.setattr(matching, '_broyden_solve', brd)
+    ring = test_ring.deepcopy()
+    result = at.match(ring, variables, (cst,), verbose=1, copy=False,
+                      broyden=broyden)
+    printed = [float(line.split()[-1]) for line in
+               capsys.readouterr().out.splitlines()
+               if line.strip().startswith('tunes')]
+    assert result is ring
+    # The lattice is left at the solution, not at the last evaluation
+    assert len(solution) == 1
+    assert_close([var.get(ring) for var in variables], solution[0],
+                 rtol=0.0, atol=0.0)
+    residual = cst.evaluate(ring)
+    assert_close(residual, 0, rtol=0.0, atol=1e-8)
+    # The printed residuals are those of the solution
+    assert_close(np.abs(printed), residual, rtol=1e-5, atol=1e-20)
@@ -0,0 +1,48 @@
+"""Tests of the MPI-distributed tracking. They are meant to be run with
+several ranks::
+
+    mpirun -n 3 python -m pytest test/test_mpi.py
+
+With a single process, all the particles are tracked by rank 0.
+"""
+import numpy
+import pytest
+from at import lattice_track
+from at.physics import gen_quantdiff_elem
+
+MPI = pytest.importorskip('mpi4py.MPI')
+comm = MPI.COMM_WORLD
+
+
+def test_mpi_empty_share(hmba_lattice):
+    # Fewer particles than ranks: some ranks have no particle
+    ring = hmba_lattice.disable_6d(copy=True)
+    npart = max(comm.Get_size() - 1, 1)
+    rin = numpy.zeros((6, npart))
+    rin[0] = numpy.linspace(1.e-4, 1.e-3, npart)
+    ref, _, refdata = lattice_track(ring, rin.copy(), 5, refpts=[0, 50],
+                                    losses=True)
+    rout, param, data = lattice_track(ring,
+                                      rin if comm.Get_rank() == 0 else None,
+                                      5, refpts=[0, 50], losses=True,
+                                      use_mpi=True)
+    if comm.Get_rank() == 0:
+        assert param['npart'] == npart
+        numpy.testing.assert_array_equal(rout, ref)
+        numpy.testing.assert_array_equal(data['loss_map'].islost,
+                                         refdata['loss_map'].islost)
+    else:
+        assert rout.shape[1] <= 1
+
+
+@pytest.mark.parametrize('use_mp', [False, True])
+def test_mpi_random_streams(hmba_lattice, use_mp):
+    # Identical particles must diverge through quantum diffusion
+    ring = hmba_lattice.enable_6d(copy=True)
+    ring.append(gen_quantdiff_elem(ring))
+    npart = 4 * comm.Get_size()
+    rin = numpy.zeros((6, npart)) if comm.Get_rank() == 0 else None
+    rout, *_ = lattice_track(ring, rin, 2, use_mpi=True, use_mp=use_mp,
+                             pool_size=2)
+    if comm.Get_rank() == 0:
+        assert len(numpy.unique(rout[4, :, 0, -1])) == npart
@@ -35,3 +35,40 @@ def test_patpass_multiple_particles_and_turns(func):
         # All other particles are all zeros.
         for j in range(1, nparticles):
             numpy.testing.assert_equal(rout[:, j, 0, i], zeros)
+
+
+def test_patpass_losses(hmba_lattice):
+    # Lost particles are removed between turn segments: the results must
+    # be identical to single-process tracking
+    ring = hmba_lattice.radiation_off(copy=True)
+    rin = numpy.zeros((6, 40))
+    rin[0] = numpy.linspace(-0.02, 0.02, 40)
+    rin[2] = 1.0e-4
+    r1 = numpy.asfortranarray(rin)
+    r2 = numpy.asfortranarray(rin)
+    rout1, _, data1 = lattice_track(ring, r1, 40, refpts=[0, 50],
+                                    losses=True, in_place=True)
+    rout2, _, data2 = lattice_track(ring, r2, 40, refpts=[0, 50],
+                                    losses=True, in_place=True,
+                                    use_mp=True, pool_size=2)
+    lm1, lm2 = data1['loss_map'], data2['loss_map']
+    assert numpy.any(lm1.islost) and not numpy.all(lm1.islost)
+    numpy.testing.assert_array_equal(rout1, rout2)
+    numpy.testing.assert_array_equal(r1, r2)
+    for key in ('islost', 'turn', 'elem', 'coord'):
+        numpy.testing.assert_array_equal(lm1[key], lm2[key])
+
+
+def test_mpi_track(hmba_lattice):
+    # Without mpirun, the particles are all tracked by the single rank
+    pytest.importorskip('mpi4py')
+    ring = hmba_lattice.radiation_off(copy=True)
+    rin = numpy.zeros((6, 20))
+    rin[0] = numpy.linspace(-0.02, 0.02, 20)
+    rout1, _, data1 = lattice_track(ring, rin, 10, refpts=[0, 50],
+                                    losses=True)
+    rout2, _, data2 = lattice_track(ring, rin, 10, refpts=[0, 50],
+                                    losses=True, use_mpi=True)
+    numpy.testing.assert_array_equal(rout1, rout2)
+    numpy.testing.assert_array_equal(data1['loss_map'].islost,
+                                     data2['loss_map'].islost)
@@ -247,6 +247,74 @@ def test_linopt_no_refpts(dba_lattice):
     assert len(physics.linopt(dba_lattice, DP, get_chrom=True)) == 4
 
 
+def test_multi_dp(hmba_lattice):
+    dps = [-0.01, 0.0, 0.003]
+    refpts = [0, 20, 121]
+    o0, o = physics.find_orbit4(hmba_lattice, dp=dps, refpts=refpts)
+    m44, ms = physics.find_m44(hmba_lattice, dp=dps, refpts=refpts)
+    assert o0.shape == (3, 6)
+    assert o.shape == (3, 3, 6)
+    assert ms.shape == (3, 3, 4, 4)
+    for i, dp in enumerate(dps):
+        o0i, oi = physics.find_orbit4(hmba_lattice, dp=dp, refpts=refpts)
+        m44i, msi = physics.find_m44(hmba_lattice, dp=dp, refpts=refpts)
+        assert_close(o0[i], o0i, rtol=0, atol=1e-15)
+        assert_close(o[i], oi, rtol=0, atol=1e-15)
+        assert_close(m44[i], m44i, rtol=0, atol=1e-12)
+        assert_close(ms[i], msi, rtol=0, atol=1e-12)
+
+
+@pytest.mark.parametrize('method', (at.linopt2, at.linopt6))
+def test_get_optics_multi_dp(hmba_lattice, method):
+    dps = numpy.array([-0.01, 0.0, 0.003])
+    l0, rd, ld = hmba_lattice.get_optics(refpts=at.All, dp=dps, method=method,
+                                         get_chrom=True)
+    assert ld.shape == (3, len(hmba_lattice)+1)
+    for i, dp in enumerate(dps):
+        l0i, rdi, ldi = hmba_lattice.get_optics(refpts=at.All, dp=dp,
+                                                method=method, get_chrom=True)
+        assert_close(rd.tune[i], rdi.tune, rtol=0, atol=1e-12)
+        assert_close(rd.chromaticity[i], rdi.chromaticity, rtol=1e-9)
+        assert_close(ld.beta[i], ldi.beta, rtol=1e-12)
+        assert_close(ld.dispersion[i], ldi.dispersion, rtol=0, atol=1e-12)
+        assert_close(l0.closed_orbit[i], l0i.closed_orbit, rtol=0, atol=1e-15)
+
+
+def test_multi_dp_6d(hmba_lattice):
+    ring = hmba_lattice.enable_6d(copy=True)
+    dps = numpy.array([-0.002, 0.0, 0.001])
+    refpts = [0, 20, 121]
+    o0, o = physics.find_orbit(ring, dp=dps, refpts=refpts)
+    m66, ms = physics.find_m66(ring, dp=dps, refpts=refpts)
+    tunes = physics.get_tune(ring, dp=dps)
+    assert o.shape == (3, 3, 6)
+    assert ms.shape == (3, 3, 6, 6)
+    for i, dp in enumerate(dps):
+        o0i, oi = physics.find_orbit6(ring, dp=dp, refpts=refpts)
+        m66i, msi = physics.find_m66(ring, dp=dp, refpts=refpts)
+        assert_close(o0[i], o0i, rtol=0, atol=1e-15)
+        assert_close(o[i], oi, rtol=0, atol=1e-15)
+        assert_close(ms[i], msi, rtol=0, atol=1e-12)
+        assert_close(tunes[i], physics.get_tune(ring, dp=dp), rtol=0,
+                     atol=1e-12)
+
+
+def test_avlinopt_defocusing(hmba_lattice):
+    # Average beta in a defocusing quadrupole, compared with the average
+    # of the beta functions sampled through the sliced quadrupole
+    ring = hmba_lattice.disable_6d(copy=True)
+    iq = 9
+    assert ring[iq].PolynomB[1] < 0.0
+    _, avebeta, *_ = physics.avlinopt(ring, 0.0, refpts=[iq])
+    nslices = 200
+    sliced = at.Lattice(ring[:iq] + ring[iq].divide([1.0/nslices]*nslices) +
+                        ring[iq+1:], energy=ring.energy)
+    _, _, ld = sliced.get_optics(refpts=range(iq, iq+nslices+1))
+    beta = ld.beta
+    expected = (numpy.sum(beta, axis=0) - 0.5*(beta[0]+beta[-1])) / nslices
+    assert_close(avebeta[0], expected, rtol=1e-5)
+
+
 @pytest.mark.parametrize('refpts', ([121], [1, 2, 3, 121]))
 def test_linopt_line(hmba_lattice, refpts):
 #    refpts.append(len(hmba_lattice))
@@ -288,6 +356,11 @@ def test_nl_detuning_chromaticity(hmba_lattice):
                       [-3258.24669916,  1615.13729938]],
                  atol=1e-12, rtol=1e-5)
 
+    # Perturbation theory, cross-checked against tracking
+    q0a, q1a, _, _, _, _ = at.nonlinear.detuning(hmba_lattice, analytic=True)
+    assert_close(q0a, q0, rtol=1e-6)
+    assert_close(q1a, q1, rtol=0.06)
+
 
 def test_quantdiff(hmba_lattice):
     hmba_lattice = hmba_lattice.radiation_on(copy=True)
@@ -411,3 +484,137 @@ def test_ohmi_envelope(hmba_lattice, refpts):
     assert_close(obs['emitXYZ'],
                  [1.322242916634e-10, 4.872515915668e-38, 2.858404580719e-06],
                  atol=3e-12)
+
+
+def test_diffmatrix(hmba_lattice):
+    from at.physics.radiation import _dmatr
+    ring = hmba_lattice.radiation_on(copy=True)
+    bbcum, orbs = _dmatr(ring)
+    # Element-by-element reference
+    orbit = orbs[0]
+    cumul = numpy.zeros((6, 6))
+    for elem, orb in zip(ring, orbs):
+        m = physics.find_elem_m66(elem, orb, energy=ring.energy,
+                                  particle=ring.particle)
+        if elem.PassMethod.endswith('RadPass'):
+            b = physics.find_mpole_raddiff_matrix(elem, orb, ring.energy)
+        else:
+            b = numpy.zeros((6, 6))
+        cumul = m.dot(cumul).dot(m.T) + b
+        orbit = internal_lpass([elem], orbit.copy())[:, 0, 0, 0]
+    assert_close(orbs[-1], orbit, rtol=0, atol=1e-15)
+    assert_close(bbcum[-1], cumul, rtol=1e-12, atol=1e-30)
+
+
+@pytest.mark.parametrize('is_6d', [False, True])
+def test_orbit_response_matrix(hmba_lattice, is_6d):
+    ring = hmba_lattice.enable_6d(copy=True) if is_6d \
+        else hmba_lattice.disable_6d(copy=True)
+    bpms = ring.get_uint32_index(at.Monitor)
+    sext = ring.get_uint32_index('S*')
+    orm = physics.orbit_response_matrix(ring, bpms, sext[:4], sext[2:6])
+    ormt = physics.orbit_response_matrix(ring, bpms, sext[:4], sext[2:6],
+                                         method='tracking')
+    assert_close(ormt, orm, rtol=0, atol=5.e-4)
+    # Brute force column for the 2nd horizontal corrector
+    j = sext[1]
+    orbits = []
+    for kick in (1.e-5, -1.e-5):
+        rg = ring.deepcopy()
+        rg.insert(j, at.Corrector('COR', 0.0, [kick, 0.0]))
+        _, orb = physics.find_orbit(rg, numpy.where(bpms > j, bpms+1, bpms))
+        orbits.append(numpy.concatenate((orb[:, 0], orb[:, 2])))
+    assert_close(ormt[:, 1], (orbits[0]-orbits[1]) / 2.e-5,
+                 rtol=0, atol=1.e-8)
+    # RF frequency response
+    assert_close(physics.frequency_response(ring, bpms),
+                 physics.frequency_response(ring, bpms, method='tracking'),
+                 rtol=1.e-3, atol=1.e-12)
+
+
+def test_orbit_response_matrix_maxiter(hmba_lattice):
+    ring = hmba_lattice.disable_6d(copy=True)
+    bpms = ring.get_uint32_index(at.Monitor)
+    sext = ring.get_uint32_index('S*')
+    with pytest.warns(AtWarning, match='Maximum number of iterations'):
+        physics.orbit_response_matrix(ring, bpms, sext[:2], sext[2:4],
+                                      method='tracking', max_iterations=1)
+    with pytest.raises(at.AtError, match='diverged'):
+        physics.orbit_response_matrix(ring, bpms, sext[:2], sext[2:4],
+                                      method='tracking', kick=0.1)
+
+
+
+def test_tune_chrom_response(hmba_lattice):
+    ring = hmba_lattice.disable_6d(copy=True)
+    quads = [ring.get_uint32_index('QF*'), ring.get_uint32_index('QD*')]
+    sexts = [ring.get_uint32_index('SD*'), ring.get_uint32_index('SF*')]
+    assert_close(physics.tune_response(ring, quads),
+                 physics.tune_response(ring, quads, method='tracking'),
+                 rtol=1.e-5)
+    assert_close(physics.chromaticity_response(ring, sexts),
+                 physics.chromaticity_response(ring, sexts,
+                                               method='tracking'),
+                 rtol=1.e-2)
+
+
+def test_tunes_harmonic_naff():
+    nturns = 512
+    t = numpy.arange(nturns)
+    nu = numpy.array([0.11, 0.2345678, 0.41])
+    x = (numpy.cos(2*numpy.pi*nu[:, None]*t + 0.3) +
+         0.05*numpy.cos(4*numpy.pi*nu[:, None]*t))
+    x[2, 10] = numpy.nan
+    with pytest.warns(AtWarning, match='1/3 signals contain NaN'):
+        tunes = physics.get_tunes_harmonic(x, method='naff', hann=True)
+    assert_close(tunes[:2], nu[:2], atol=1e-8)
+    assert numpy.isnan(tunes[2])
+    freq, amp, _ = physics.nafflib.naff(
+        numpy.exp(2j*numpy.pi*nu[:, None]*t), nfreq=1)
+    assert_close(freq[:, 0], nu, atol=1e-12)
+    assert_close(amp[:, 0], 1.0, rtol=1e-10)
+
+
+def test_fmap_lost_row(hmba_lattice):
+    # The second row (y = 40 mm) is entirely lost
+    fmap, _ = physics.fmap_parallel_track(hmba_lattice, coords=[-1, 1, 0, 40],
+                                          steps=[4, 2], turns=128,
+                                          verbose=False)
+    assert fmap.shape == (5, 7)
+    assert_close(fmap[:, 0], [-1.0, -0.5, 0.0, 0.5, 1.0])
+    assert_close(fmap[:, 1], 0.0)
+    assert numpy.all(numpy.isfinite(fmap))
+
+
+def test_tune_monitor(hmba_lattice):
+    ring = hmba_lattice.radiation_off(copy=True)
+    _, rd, ld = ring.get_optics(refpts=0)
+    mon = at.TuneMonitor('tm', ld.beta[0], ld.alpha[0], NWindows=2)
+    r_in = numpy.zeros((6, 2))
+    r_in[[0, 2], 0] = 1.0e-6
+    r_in[0, 1] = 1.0     # lost at the first turn
+    lattice_track(ring + [mon], r_in, nturns=512, refpts=None)
+    assert mon.tunes.shape == (2, 2, 2)
+    assert_close(mon.tunes[:, 0, 0], rd.tune, atol=1e-9)
+    assert_close(mon.tunes[:, 0, 1], rd.tune, atol=1e-9)
+    assert numpy.all(numpy.isnan(mon.tunes[:, 1, :]))
+
+
+def test_rdts(hmba_lattice):
+    ring = hmba_lattice.deepcopy()
+    refpts = [0, 40, 121]
+    rdts = physics.get_rdts(ring, refpts, physics.RDTType.CHROMATIC)
+    # h11001 and h00111 are pi times the chromaticities
+    chrom = numpy.pi * ring.get_chrom()
+    assert_close(rdts.h11001.real, chrom[0], rtol=0.1)
+    assert_close(rdts.h00111.real, chrom[1], rtol=0.15)
+    # Incremental update
+    calc = physics.RDTCalculator(ring, refpts)
+    sexts = ring.get_uint32_index(at.Sextupole)
+    ring[sexts[0]].PolynomB[2] *= 1.1
+    ring[sexts[1]].PolynomB = numpy.append(ring[sexts[1]].PolynomB[:3], 50.0)
+    rdts = calc.update(sexts[:2])
+    expected = physics.get_rdts(ring, refpts)
+    for name in expected.dtype.names:
+        assert_close(rdts[name], expected[name], rtol=0,
+                     atol=1e-9*numpy.max(numpy.abs(expected[name])))
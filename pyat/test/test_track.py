@@ -53,3 +53,167 @@ def test_in_place_flag_tracking():
     numpy.testing.assert_equal(r_original, rin.reshape(6, 1))
     rout, *_ = lattice_track(lattice, rin, in_place=True)
     numpy.testing.assert_equal(rin, rout.reshape(6, 1))
+
+
+def test_ensemble_track(hmba_lattice):
+    from at import ensemble_track, AtError
+    ring = hmba_lattice.disable_6d(copy=True)
+    quads = ring.get_uint32_index('Q*')
+    rng = numpy.random.default_rng(1)
+    seeds = []
+    for _ in range(3):
+        rg = ring.replace(quads)
+        for i in quads:
+            rg[i].PolynomB[1] *= 1.0 + 1.e-3 * rng.standard_normal()
+            rg[i].T1 = numpy.array([1.e-5 * rng.standard_normal(), 0.0,
+                                    1.e-5 * rng.standard_normal(), 0, 0, 0])
+            rg[i].T2 = -rg[i].T1
+        seeds.append(rg)
+    r0 = numpy.zeros((6, 2))
+    r0[0, 1] = 1.e-4
+    r0[2, 1] = 1.e-4
+    refpts = [0, 10, len(ring)]
+    rout, param, _ = ensemble_track(seeds, numpy.tile(r0, 3), nturns=3,
+                                    refpts=refpts)
+    assert rout.shape == (6, 6, 3, 3)
+    assert param['nseeds'] == 3
+    for s, rg in enumerate(seeds):
+        ref, *_ = lattice_track(rg, r0, nturns=3, refpts=refpts)
+        numpy.testing.assert_equal(rout[:, 2*s:2*s+2], ref)
+    # Lattices must share the same structure
+    bad = seeds[1].deepcopy()
+    bad[quads[0]].PassMethod = 'DriftPass'
+    with pytest.raises(ValueError):
+        ensemble_track([seeds[0], bad], numpy.tile(r0, 2))
+    with pytest.raises(AtError):
+        ensemble_track(seeds, r0)
+
+
+def test_lattice_track_parameters(hmba_lattice):
+    # energy, particle and turn are reported in trackparam
+    ring = hmba_lattice.disable_6d(copy=True)
+    _, param, _ = lattice_track(ring, numpy.zeros((6, 2)), 2,
+                                energy=ring.energy, particle=ring.particle,
+                                turn=3)
+    assert param['energy'] == ring.energy
+    assert param['particle'] is ring.particle
+    assert param['turn'] == 3
+
+
+def test_ensemble_track_tune_monitor(hmba_lattice):
+    from at import ensemble_track, TuneMonitor
+    ring = hmba_lattice.disable_6d(copy=True)
+    _, _, ld = ring.get_optics(refpts=0)
+    quads = ring.get_uint32_index('QF1*')
+    seeds, monitors = [], []
+    for dk in (0.0, 1.e-3):
+        rg = ring.replace(quads)
+        for i in quads:
+            rg[i].PolynomB[1] *= 1.0 + dk
+        mon = TuneMonitor('tm', ld.beta[0], ld.alpha[0], NWindows=2)
+        seeds.append(rg + [mon])
+        monitors.append(mon)
+    r0 = numpy.zeros((6, 2))
+    r0[[0, 2], :] = 1.0e-6
+    r0[0, 1] = 2.0e-6
+    ensemble_track(seeds, numpy.tile(r0, 2), nturns=512, refpts=None)
+    # Each monitor analyses the particles of its own lattice
+    for rg, mon in zip(seeds, monitors):
+        assert mon.tunes.shape == (2, 2, 2)
+        tunes = rg[:-1].get_tune()
+        numpy.testing.assert_allclose(mon.tunes[:, 0, 0], tunes, atol=1e-9)
+        numpy.testing.assert_allclose(mon.tunes[:, 0, 1], tunes, atol=1e-9)
+
+
+def test_ensemble_track_parameters(hmba_lattice):
+    from at import ensemble_track
+    ring = hmba_lattice.disable_6d(copy=True)
+    _, param, _ = ensemble_track([ring, ring], numpy.zeros((6, 2)), 2,
+                                 energy=ring.energy, particle=ring.particle,
+                                 turn=3)
+    assert param['energy'] == ring.energy
+    assert param['particle'] is ring.particle
+    assert param['turn'] == 3
+    assert param['nseeds'] == 2
+
+
+def test_ensemble_track_mp(hmba_lattice):
+    from at import ensemble_track
+    ring = hmba_lattice.disable_6d(copy=True)
+    quads = ring.get_uint32_index('Q*')
+    rng = numpy.random.default_rng(2)
+    seeds = []
+    for _ in range(5):
+        rg = ring.replace(quads)
+        for i in quads:
+            rg[i].PolynomB[1] *= 1.0 + 1.e-2 * rng.standard_normal()
+        seeds.append(rg)
+    r0 = numpy.zeros((6, 3))
+    r0[0] = [1.e-4, 5.e-3, 2.e-2]
+    r0[2] = 1.e-5
+    rin1 = numpy.tile(r0, 5)
+    rin2 = rin1.copy()
+    rout1, _, td1 = ensemble_track(seeds, rin1, nturns=20, refpts=[0, 50],
+                                   losses=True, in_place=True)
+    rout2, _, td2 = ensemble_track(seeds, rin2, nturns=20, refpts=[0, 50],
+                                   losses=True, in_place=True, use_mp=True,
+                                   pool_size=2)
+    lm1 = td1['loss_map']
+    lm2 = td2['loss_map']
+    assert numpy.any(lm1.islost) and not numpy.all(lm1.islost)
+    numpy.testing.assert_array_equal(rout1, rout2)
+    numpy.testing.assert_array_equal(rin1, rin2)
+    for key in ('islost', 'turn', 'elem', 'coord'):
+        numpy.testing.assert_array_equal(lm1[key], lm2[key])
+
+
+def test_beam():
+    from at.tracking.particles import beam, sigma_matrix
+    sigma = sigma_matrix(betax=10.0, alphax=1.0, emitx=1.0e-9,
+                         betay=5.0, alphay=-0.5, emity=1.0e-11,
+                         blength=3.0e-3, espread=1.0e-3)
+    b1 = beam(100000, sigma, seed=42, omp_num_threads=1)
+    b2 = beam(100000, sigma, seed=42, omp_num_threads=2)
+    assert b1.flags.f_contiguous
+    # The result does not depend on the number of threads
+    numpy.testing.assert_array_equal(b1, b2)
+    scale = numpy.sqrt(numpy.outer(numpy.diag(sigma), numpy.diag(sigma)))
+    numpy.testing.assert_allclose(numpy.cov(b1) / scale, sigma / scale,
+                                  atol=0.03)
+    out = numpy.empty((6, 1000), order='F')
+    b3 = beam(1000, sigma, seed=1, out=out, truncation=2.0)
+    assert b3 is out
+    # The amplitude of each normal mode is truncated
+    for slc in (slice(0, 2), slice(2, 4), slice(4, 6)):
+        z = b3[slc]
+        amp2 = numpy.sum(z * numpy.linalg.solve(sigma[slc, slc], z), axis=0)
+        assert numpy.all(amp2 <= 4.0*(1.0 + 1.e-9))
+    for i in range(6):
+        assert numpy.all(numpy.abs(b3[i]) <= 2.0*numpy.sqrt(sigma[i, i]))
+
+
+@pytest.mark.parametrize('use_mp', [False, True])
+def test_output_format(hmba_lattice, use_mp):
+    from at import AtError
+    ring = hmba_lattice.enable_6d(copy=True)
+    r0 = numpy.zeros((6, 4))
+    r0[0] = [1.e-4, 2.e-4, 3.e-4, 5.e-2]     # The last particle is lost
+    r0[2] = 1.e-5
+    refpts = [0, 20, len(ring)]
+    kwargs = dict(nturns=5, refpts=refpts, losses=True, use_mp=use_mp,
+                  pool_size=2)
+    ref, _, td = lattice_track(ring, r0.copy(), **kwargs)
+    rout, _, td2 = lattice_track(ring, r0.copy(), output_coords=['x', 'dp'],
+                                 output_dtype=numpy.float32, **kwargs)
+    assert rout.dtype == numpy.float32
+    assert rout.shape == (2, 4, 3, 5)
+    numpy.testing.assert_array_equal(rout, ref[[0, 4]].astype(numpy.float32))
+    numpy.testing.assert_array_equal(td2['loss_map'].islost,
+                                     td['loss_map'].islost)
+    rout, *_ = lattice_track(ring, r0.copy(), output_coords=5, **kwargs)
+    assert rout.dtype == numpy.float64
+    numpy.testing.assert_array_equal(rout, ref[5:])
+    with pytest.raises(AtError):
+        lattice_track(ring, r0.copy(), output_coords='z')
+    with pytest.raises(AtError):
+        lattice_track(ring, r0.copy(), output_dtype=numpy.int32)
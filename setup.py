@@ -144,11 +144,16 @@ if not sys.platform.startswith('win32'):
 # sufficient.
 integrator_src_orig = 'atintegrators'
 diffmatrix_orig = join('atmat', 'atphysics', 'Radiation')
+nafflib_orig = join('atmat', 'atphysics', 'nafflib')
+rdt_orig = join('atmat', 'atphysics', 'NonLinearDynamics')
 
 c_pass_methods = glob.glob(join(integrator_src_orig, '*Pass.c'))
 cpp_pass_methods = glob.glob(join(integrator_src_orig, '*Pass.cc'))
 gpu_pass_methods = glob.glob(join('atgpu', '*Pass.cpp'))
 diffmatrix_source = join(diffmatrix_orig, 'findmpoleraddiffmatrix.c')
+nafflib_sources = [join(nafflib_orig, src) for src in
+                   ('nafflib.c', 'modnaff.c', 'complexe.c')]
+rdt_source = join(rdt_orig, 'RDTelegantAT.cpp')
 at_source = join('pyat', 'at.c')
 
 
@@ -182,7 +187,7 @@ at = Extension(
     'at.tracking.atpass',
     sources=[at_source],
     define_macros=macros + omp_macros + mpi_macros,
-    include_dirs=[numpy.get_include(), integrator_src_orig],
+    include_dirs=[numpy.get_include(), integrator_src_orig, diffmatrix_orig],
     extra_compile_args=cflags + omp_cflags,
     extra_link_args=omp_lflags
 )
@@ -202,6 +207,24 @@ diffmatrix = Extension(
     extra_compile_args=cflags
 )
 
+nafflib = Extension(
+    name='at.physics.nafflib',
+    sources=nafflib_sources,
+    include_dirs=[numpy.get_include(), integrator_src_orig, nafflib_orig],
+    define_macros=macros + omp_macros,
+    extra_compile_args=cflags + omp_cflags,
+    extra_link_args=omp_lflags
+)
+
+rdtlib = Extension(
+    name='at.physics.rdtlib',
+    sources=[rdt_source],
+    include_dirs=[numpy.get_include(), integrator_src_orig],
+    define_macros=macros + omp_macros,
+    extra_compile_args=cppflags + omp_cflags,
+    extra_link_args=omp_lflags
+)
+
 gpusource = (gpu_pass_methods +
            [join('atgpu', 'AbstractGPU.cpp'),
             join('atgpu', 'AbstractInterface.cpp'),
@@ -228,7 +251,7 @@ openclext = Extension(
 )
 
 setup(
-    ext_modules=[at, cconfig, diffmatrix] +
+    ext_modules=[at, cconfig, diffmatrix, nafflib, rdtlib] +
                 ([cudaext] if cuda else []) +
                 ([openclext] if opencl else []) +
                 [c_integrator_ext(pm) for pm in c_pass_methods] +